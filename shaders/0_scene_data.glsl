@@ -11,4 +11,6 @@ layout (set = 0, binding = 0) uniform SceneData {
 	vec4 sunlightColor;
     mat4 sunViewProj[3];
 	vec4 time; //.x = time, .y = time/2
+	mat4 inverseViewProj;
+	mat4 previousViewProj; //viewProj of the last frame, for reprojection
 } sceneData;
\ No newline at end of file
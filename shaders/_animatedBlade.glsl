@@ -0,0 +1,81 @@
+
+//per blade animation state, written by grass_animate.comp and read by grass.vert
+//	must match AnimatedGrassBlade in vk_types.hpp
+struct AnimatedBlade {
+	vec3 position;
+	uint rotation;	//packSnorm2x16(cos, sin) of the rotation towards the player
+	vec3 wind;		//wind direction at the blade
+	uint params;	//packUnorm4x8(height scale, random, color variation, segments / GRASS_MAX_SEGMENTS)
+};
+
+#define GRASS_MAX_SEGMENTS 4 //must match GRASS_BLADE_SEGMENTS in vk_engine_settings.hpp
+#define GRASS_LOD_COUNT 3 //lod i has GRASS_MAX_SEGMENTS >> i segments, must match GRASS_LOD_COUNT in vk_engine_settings.hpp
+#define GRASS_BLADE_HEIGHT 1.1
+#define GRASS_BLADE_WIDTH 0.03
+
+const vec3 bladeBottomColor = vec3(0.14,0.32,0.08);
+const vec3 bladeTopColor = vec3(0.38,0.56,0.25);
+
+//shared by grass.vert and grass.mesh
+float getWindStrength(float height) {
+	return clamp(height*height,0,2);
+}
+
+mat3 getGrassRotationMatrix(vec2 rotation) {
+	float c = rotation.x;
+	float s = rotation.y;
+	mat3 matrix;
+	matrix[0] = vec3(c,0,-s);
+	matrix[1] = vec3(0,1,0);
+	matrix[2] = vec3(s,0,c);
+	return matrix;
+}
+
+uint getBladeSegments(AnimatedBlade blade) {
+	return max(1, uint(round(unpackUnorm4x8(blade.params).w * GRASS_MAX_SEGMENTS)));
+}
+
+struct BladeVertex {
+	vec3 position;	//world space
+	vec3 bend;		//wind offset at this vertex
+	float side;		//1 = right edge, -1 = left edge, 0 = tip
+	float t;		//0 at the root, 1 at the tip
+};
+
+//blades are (right, left) vertex pairs up a quadratic bezier followed by the tip, so n segments are 2n+1 vertices
+//	pairs past the segment count collapse onto the tip, which makes their triangles degenerate
+BladeVertex getBladeVertex(AnimatedBlade blade, uint vertexIndex, uint segments) {
+	float height = GRASS_BLADE_HEIGHT * unpackUnorm4x8(blade.params).x;
+	uint row = vertexIndex / 2;
+
+	BladeVertex v;
+	v.side = row >= segments ? 0 : (vertexIndex % 2 == 0 ? 1 : -1);
+	v.t = row >= segments ? 1 : float(row) / float(segments);
+
+	//the control point keeps the root upright, only the tip follows the wind
+	vec3 tipWind = blade.wind * getWindStrength(height);
+	tipWind.y += -length(tipWind)*0.5;
+	vec3 control = vec3(0,height*0.6,0);
+	vec3 tip = vec3(0,height,0) + tipWind;
+	vec3 curve = 2*(1-v.t)*v.t*control + v.t*v.t*tip;
+
+	mat3 rotationTowardsPlayer = getGrassRotationMatrix(unpackSnorm2x16(blade.rotation));
+	v.position = blade.position + rotationTowardsPlayer * vec3(v.side*GRASS_BLADE_WIDTH,0,0) + curve;
+	v.bend = v.t*v.t*tipWind;
+	return v;
+}
+
+//shading inputs of a blade vertex, also rebuilt per pixel by grass_material.comp
+//	note: the normal is not normalized, the callers transform it first
+vec3 getBladeNormal(AnimatedBlade blade, BladeVertex v, vec3 sunlightDirection) {
+	float sideOffset = v.side*GRASS_BLADE_WIDTH;
+	return -vec3(
+		sunlightDirection.x-(sideOffset+v.bend.x*3),
+		0.3*abs(unpackUnorm4x8(blade.params).y),
+		sunlightDirection.z-(sideOffset+v.bend.z*3));
+}
+
+vec3 getBladeColor(AnimatedBlade blade, BladeVertex v) {
+	vec3 color = mix(bladeBottomColor,bladeTopColor,v.t);
+	return mix(color*0.8,color*1.2,unpackUnorm4x8(blade.params).z);
+}
@@ -0,0 +1,316 @@
+//deferred shading, compiled once per output, see deferred.comp and deferred_swapchain.comp
+layout (local_size_x = 16, local_size_y = 16) in;
+
+#include "0_scene_data.glsl"
+
+#include "noise.glsl"
+
+#include "_deferredTiles.glsl"
+
+//every pipeline variant shades the tiles of one class, see VulkanEngine::initDeferredPipelines
+layout (constant_id = 0) const int TILE_CLASS = TILE_CLASS_REFLECTIVE;
+//QualitySettings::reflectionSteps and reflectionRefineSteps
+layout (constant_id = 1) const int REFLECTION_MAX_STEPS = 100;
+layout (constant_id = 2) const int REFLECTION_REFINE_STEPS = 28;
+
+#ifdef DEFERRED_SWAPCHAIN_OUTPUT
+//	note: the swapchain is bgra, which has no format qualifier, needs shaderStorageImageWriteWithoutFormat
+layout (set=3,binding=0) uniform writeonly image2D finalDrawImage;
+#else
+layout (rgba16f, set=3,binding=0) uniform writeonly image2D finalDrawImage;
+#endif
+
+//todo jesus clean this up
+layout (set=1,binding=1) uniform sampler2D colorImage;
+layout (set=1,binding=2) uniform sampler2D depthImage;
+layout (set=1,binding=3) uniform sampler2D normalImage;
+layout (set=1,binding=4) uniform sampler2D specularMapImage;
+layout (set=1,binding=5) uniform sampler2D positionImage;
+layout (set=1,binding=6) uniform sampler2D shadowMask; //see shadow_mask.comp
+layout (set=1,binding=7) uniform sampler2D ssrImage; //half resolution reflections, see ssr.comp
+
+//push constants block
+layout( push_constant ) uniform constants
+{
+	//data1.xyz = player pos
+	//data2.x = pixels per shadow mask texel (1 or 2)
+	//data2.y = 1 to use the hi-z traced reflections in ssrImage instead of getReflectedColor
+	//data2.z = tile capacity per class
+	//data3.xy = draw extent
+	vec4 data1;
+	vec4 data2;
+	vec4 data3;
+	vec4 data4;
+} PushConstants;
+
+// based on https://theorangeduck.com/page/pure-depth-ssao
+vec3 normal_from_depth(float depth, vec2 uv) {
+  
+  const vec2 offset1 = vec2(0.0,0.01);
+  const vec2 offset2 = vec2(0.01,0.0);
+  
+  float depth1 = texture(depthImage, uv + offset1).r;
+  float depth2 = texture(depthImage, uv + offset2).r;
+  
+  vec3 p1 = vec3(offset1, depth1 - depth);
+  vec3 p2 = vec3(offset2, depth2 - depth);
+  
+  vec3 normal = cross(p1, p2);
+  normal.z = -normal.z;
+  
+  return normalize(normal);
+}
+
+// screen space reflections
+// based on https://lettier.github.io/3d-game-shaders-for-beginners/screen-space-reflection.html
+vec4 getReflectedColor(vec2 texCoord)
+{	
+	vec4 color = vec4(0);
+	int maxSteps = REFLECTION_MAX_STEPS;
+	float maxDistance = 238;
+	float resolution = 1.0;
+	int steps = REFLECTION_REFINE_STEPS;
+	float thickness = 0.3;
+
+	ivec2 texSize = textureSize(colorImage,0).xy;
+	vec4 uv = vec4(0);
+
+	vec4 startPos = vec4(texture(positionImage,texCoord).xyz,1);///todo vector from camera to world position
+	startPos.z *= -1;
+
+	vec3 normalizedStartPos = normalize(startPos.xyz);
+
+	mat3 v = mat3(sceneData.view);
+	mat3 normalMatrix = transpose(inverse(v));
+
+
+	vec3 normal = normalize(normalMatrix * texture(normalImage,texCoord).xyz);//might have to normalize
+	normal.z *= -1;
+	vec2 jitter = (hash(startPos.xy)+1)*0.5;
+	normal.xz += jitter*0.01;
+	normal = normalize(normal);
+	vec3 pivot = normalize(reflect(normalizedStartPos,normal));
+	vec4 nextPos = startPos;
+
+	vec4 startView = vec4(startPos.xyz + (pivot * 0.0),1.0);
+	vec4 endView = vec4(startPos.xyz + (pivot * maxDistance),1.0);
+	if(endView.z<=0.1) return texture(colorImage,texCoord);
+
+	//transform viewspace coords to screen space
+	mat4 p = sceneData.proj;
+	vec4 startFrag = p * startView;
+	startFrag /= startFrag.w;
+	startFrag.xy = startFrag.xy * vec2(-0.5,-0.5) + 0.5;
+	startFrag.xy *= texSize;
+	vec4 endFrag = p * endView;
+	endFrag /= endFrag.w;
+	endFrag.xy = endFrag.xy * vec2(-0.5,-0.5) + 0.5;
+	endFrag.xy *= texSize;
+	vec2 frag = startFrag.xy;
+
+	float dX = endFrag.x - startFrag.x;
+	float dY = endFrag.y - startFrag.y;
+	float useX = abs(dX)>=abs(dY)? 1.0 : 0.0;
+	float delta = mix(abs(dY),abs(dX),useX) * clamp(resolution,0.0,1.0);
+	delta = min(delta,maxSteps);
+	vec2 increment = vec2(dX,dY) / max(delta,0.001);
+
+	float search0 = 0;
+	float search1 = 0;
+
+	int hit0 = 0;
+	int hit1 = 0;
+
+	float viewDistance = startView.z;
+	float depth = thickness;
+	float i = 0;
+	for(i=0;i<int(delta);i++)
+	{
+		frag += increment;
+		uv.xy = frag / texSize;
+		nextPos = vec4(texture(positionImage,uv.xy).xyz,1);
+		nextPos.z = -nextPos.z;
+
+		search1 = mix((frag.y-startFrag.y)/dY,(frag.x-startFrag.x)/dX,useX);
+		search1 = clamp(search1,0.0,1.0);
+
+		viewDistance = (startView.z * endView.z) / mix(endView.z,startView.z,search1);
+		depth = viewDistance - nextPos.z;
+
+		if((depth>0 && depth<thickness))
+		{
+			hit0 = 1;
+			break;
+		}
+		else
+		{
+			search0 = search1;
+		}
+	}
+	search1 = search0 + ((search1-search0)/2.0);
+
+	steps *= hit0;
+
+	for(i=0;i<steps && i < maxSteps;i++)
+	{
+		frag = mix(startFrag.xy,endFrag.xy,search1);
+		uv.xy = frag / texSize;
+		nextPos = vec4(texture(positionImage,uv.xy).xyz,1);
+		nextPos.z = -nextPos.z;
+
+		viewDistance = (startView.z * endView.z) / mix(endView.z, startView.z, search1);
+		depth = viewDistance - nextPos.z;
+
+		if((depth > 0 && depth < thickness))
+		{
+			hit1 = 1;
+			search1 = search0 + ((search1-search0)/2);
+		}		
+		else
+		{
+			float temp = search1;
+			search1 = search1 + ((search1-search0)/2);
+			search0 = temp;
+		}
+	}
+
+	float visibility = hit1 * nextPos.w * startPos.w *
+		(1-max(dot(-normalizedStartPos,pivot),0)) *
+		(1-clamp(depth / thickness,0,1)) *
+		(1-clamp(length(nextPos-startPos)/maxDistance,0,1)) *
+		(uv.x < 0 || uv.x > 1 ? 0 : 1) * (uv.y < 0 || uv.y > 1 ? 0 :1);
+
+	visibility = clamp(visibility,0,1);
+
+	uv.zw = vec2(visibility);
+	
+	if(visibility<0.5)
+	{
+		uv.xy = vec2(endFrag.xy)/texSize;
+		if(uv.x<0 || uv.x >1 || uv.y < 0 || uv.y > 1)
+			color = texture(colorImage,texCoord);
+		else
+		{	
+			vec4 regColor = texture(colorImage,texCoord);
+			color = texture(colorImage,uv.xy);
+			color = mix(regColor,color,clamp(1-6*dot(uv.xy-vec2(0.5),uv.xy-vec2(0.5)),0,1));
+		}
+	}
+	else 
+	{
+		color = texture(colorImage,uv.xy);
+	}
+
+	return color;
+}
+
+float linearDepth(float depth)
+{
+	return sceneData.proj[3][2] / (depth + sceneData.proj[2][2]);
+}
+
+//bilinear upsample of a half resolution image whose texels hold the top left pixel of their 2x2 block
+//	every texel is weighted by how close its depth is, so nothing bleeds over silhouettes
+vec4 upsampleDepthAware(sampler2D image, ivec2 pixel)
+{
+	float depth = linearDepth(texelFetch(depthImage, pixel, 0).r);
+	vec2 halfCoord = vec2(pixel) / 2;
+	ivec2 base = ivec2(halfCoord);
+	vec2 f = fract(halfCoord);
+	ivec2 halfSize = (textureSize(depthImage, 0) + 1) / 2;
+	vec4 value = vec4(0);
+	float weightSum = 0;
+	for(int i=0;i<4;i++)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 texel = min(base + offset, halfSize - 1);
+		float sampleDepth = linearDepth(texelFetch(depthImage, texel * 2, 0).r);
+		vec2 bilinear = mix(1 - f, f, vec2(offset));
+		float weight = bilinear.x * bilinear.y / (0.001 + abs(sampleDepth - depth) / depth);
+		value += texelFetch(image, texel, 0) * weight;
+		weightSum += weight;
+	}
+	return value / max(weightSum, 1e-5);
+}
+
+//sun shadowing of a pixel
+float getShadow(ivec2 pixel)
+{
+	if(int(PushConstants.data2.x) <= 1) return texelFetch(shadowMask, pixel, 0).r;
+	return upsampleDepthAware(shadowMask, pixel).r;
+}
+
+// inspired from https://imanolfotia.com/blog/1
+//	to determine the coefficients into reflection strength
+float fresnelSchlick(vec2 texCoord)
+{
+	mat3 v = mat3(sceneData.view);
+	mat3 normalMatrix = transpose(inverse(v));
+	vec3 normal = normalize(normalMatrix*normalize(texture(normalImage,texCoord).xyz));
+	vec3 position = normalize(texture(positionImage,texCoord).xyz);
+	normal.z = normal.z;
+	position.z = position.z;
+
+	float cosTheta = max(-dot(normal.xyz,position.xyz),0);
+
+	const float R0 = 0.6;
+	return R0 + (1.0-R0)*pow(1.0-cosTheta,5.0);
+}
+
+void main()
+{
+	//one workgroup per tile of the class
+	uint tile = deferredTiles[TILE_CLASS * uint(PushConstants.data2.z) + gl_WorkGroupID.x];
+	ivec2 pixel = ivec2(tile & 0xffff, tile >> 16) * TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+	vec2 size = textureSize(colorImage,0).xy;
+	vec2 texCoord = pixel / size;
+
+	//	note: the output is written at the pixel, the swapchain image is only as large as the draw extent
+	if(pixel.x < PushConstants.data3.x && pixel.y < PushConstants.data3.y)
+	{
+		vec4 color = texture(colorImage, texCoord);
+		if(TILE_CLASS == TILE_CLASS_SKY)
+		{
+			imageStore(finalDrawImage, pixel, color);
+			return;
+		}
+		vec4 specular = texture(specularMapImage,texCoord);
+		//	note: specular.g is the part of the color that is lit by the sun, see mesh.frag
+		color.rgb *= 1 - getShadow(pixel) * specular.g;
+		float depth = texture(depthImage, vec2(texCoord)).r;
+		mat3 v = mat3(sceneData.view); //todo put this in scene data or smth
+		mat3 normalMatrix = transpose(inverse(v));
+		vec3 normal = normalize(normalMatrix*normalize(texture(normalImage, texCoord).xyz));
+		vec4 position = texture(positionImage,texCoord);
+		normal.z = -normal.z;
+		position.z = -position.z;
+
+		vec4 finalColor = color;
+		if(TILE_CLASS == TILE_CLASS_REFLECTIVE && specular.r>0)
+		{
+			vec4 reflectedColor;
+			if(PushConstants.data2.y > 0)
+			{
+				vec4 reflection = upsampleDepthAware(ssrImage, pixel);
+				reflectedColor = vec4(mix(color.rgb, reflection.rgb, reflection.a), 1);
+			}
+			else
+				reflectedColor = getReflectedColor(texCoord);
+			float fresnelCoefficient = fresnelSchlick(texCoord);
+			vec3 reflected = normalize(reflect(normalize(position.xyz), normalize(normal.xyz)));
+ 
+			vec2 dCoords = smoothstep(0.2, 0.6, abs(vec2(0.5, 0.5) - texCoord.xy));
+ 
+ 
+			float screenEdgefactor = clamp(1.0 - (dCoords.x + dCoords.y), 0.0, 1.0);
+			float reflectionMultiplier = pow(1.0, 3.0) * 
+                screenEdgefactor * 
+                reflected.z;
+			finalColor = mix(color,reflectedColor * clamp(reflectionMultiplier, 0.0, 1.0),fresnelCoefficient);
+		}
+		//if(gl_GlobalInvocationID.x%4>=2 &&gl_GlobalInvocationID.y % 4<2)
+			imageStore(finalDrawImage, pixel, finalColor);
+		//else
+		//	imageStore(finalDrawImage, pixel, vec4(0,0,0,1));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+//tiles of the deferred pass sorted by what they need, written by deferred_classify.comp
+//	note: the lists and dispatches are in set 2 of the deferred pipeline layout
+const int TILE_SIZE = 16;
+const int TILE_CLASS_SKY = 0;			//nothing but sky, the color is copied
+const int TILE_CLASS_LIT = 1;			//shadowed geometry without reflections
+const int TILE_CLASS_REFLECTIVE = 2;	//at least one pixel with a specular mask
+const int TILE_CLASS_COUNT = 3;
+
+layout(std430, set = 2, binding = 0) buffer deferredDispatchBuffer {
+	uint deferredDispatches[]; //VkDispatchIndirectCommand per class, x counts the tiles
+};
+layout(std430, set = 2, binding = 1) buffer deferredTileBuffer {
+	uint deferredTiles[]; //x | y << 16, the list of class c starts at c * tile capacity
+};
@@ -0,0 +1,18 @@
+//shared by grass.task and grass.mesh
+
+//blades tested by one task workgroup
+#define GRASS_CLUSTER_SIZE 32
+//a high lod blade has GRASS_MAX_SEGMENTS segments (9 vertices / 7 triangles), a low lod blade one (3 vertices / 1 triangle)
+#define GRASS_HIGH_LOD_VERTICES 9
+#define GRASS_HIGH_LOD_TRIANGLES 7
+#define GRASS_LOW_LOD_VERTICES 3
+#define GRASS_LOW_LOD_TRIANGLES 1
+//blades per mesh workgroup, keeps both lods below 256 vertices and primitives
+#define GRASS_HIGH_LOD_BLADES_PER_GROUP 16
+#define GRASS_LOW_LOD_BLADES_PER_GROUP GRASS_CLUSTER_SIZE
+
+struct GrassTaskPayload {
+	uint highLodCount;
+	uint lowLodCount;
+	uint blades[GRASS_CLUSTER_SIZE]; //instance indices, high lod from the front and low lod from the back
+};
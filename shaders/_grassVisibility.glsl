@@ -0,0 +1,26 @@
+//visibility buffer of the grass, written by grass_visibility.frag and shaded by grass_material.comp
+//	a texel holds the blade index, the segments it was drawn with and its triangle within the blade
+//	note: 26 bits are left for the blade index
+#define VISIBILITY_EMPTY 0xffffffffu
+
+uint packBladeVisibility(uint blade, uint segments) {
+	return blade << 6 | (segments - 1) << 3;
+}
+
+uint getVisibilityBlade(uint visibility) { return visibility >> 6; }
+uint getVisibilitySegments(uint visibility) { return ((visibility >> 3) & 7) + 1; }
+uint getVisibilityTriangle(uint visibility) { return visibility & 7; }
+
+//vertices of a blade triangle, in the order of the grass index buffer and grass.mesh
+//	the first vertex is the provoking one and no two triangles share it, so the flat visibility carries the triangle
+//	the last triangle's third vertex is past the tip, getBladeVertex collapses it onto the tip
+uvec3 getBladeTriangle(uint triangle) {
+	uint right = triangle / 2 * 2;
+	return triangle % 2 == 0 ? uvec3(right + 1, right, right + 3) : uvec3(right, right + 2, right + 3);
+}
+
+//the triangle a blade vertex provokes, inverse of getBladeTriangle(triangle).x
+//	note: the tip provokes no triangle, its value is never read
+uint getProvokedTriangle(uint vertexIndex) {
+	return (vertexIndex ^ 1) & 7;
+}
@@ -5,4 +5,5 @@ layout( push_constant ) uniform constants
 	vec4 playerPosition;
 	vec4 data;
 	VertexBuffer vertexBuffer;
+	ivec2 shadow; //x = 1 in the layered shadow pass, see _shadowCascade.glsl
 } PushConstants;
\ No newline at end of file
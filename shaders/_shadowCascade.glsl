@@ -0,0 +1,8 @@
+//layered shadow pass, every cascade is a layer of the shadow map array and the vertex shader routes primitives with gl_Layer
+//	note: needs GL_ARB_shader_viewport_layer_array and the push constants, PushConstants.shadow.x = 1 in the shadow pass
+//	returns the cascade's view projection, or the camera's outside of the shadow pass
+mat4 getViewProj(int cascade) {
+	if (PushConstants.shadow.x == 0) return sceneData.viewProj;
+	gl_Layer = cascade;
+	return sceneData.sunViewProj[cascade];
+}
@@ -0,0 +1,32 @@
+
+//procedural terrain height, what the default terrain file is baked from
+//	note: TerrainHeightMap mirrors it on the CPU, terrain_validate.comp checks that they agree
+//	note: requires noise.glsl to be included first
+//	coord is in heightmap texel space, mapCenter is the texel the world origin maps to
+float getTerrainHeight(vec2 coord, vec2 mapCenter) {
+	//return 6*fbm(coord,7,1.0,1.0,2.0,0.9);
+	float height = 64*layeredNoise(coord*0.04,3,0.1,4,0.1)+96;
+	height += 2*layeredNoise(coord*0.2,4,0.4,2,0.2);
+	//float a = 1.0/(0.1*distance(coord,mapCenter)+1);
+    //float u = a*a*(3.0-2.0*a);
+	//height += -25*(u);
+
+	float a = 0.006*clamp(distance(coord,mapCenter),0,100);
+	height += 128.0*(a*a*(3.0-2.0*a))-128.0;
+	return height;
+}
+
+//grass density rules, evaluated per blade from the terrain texel
+//	returns 0..1, the fraction of the placement pattern that is kept
+float getGrassDensity(vec4 terrainData, vec2 coord) {
+	float density = 1;
+	//no grass on steep slopes
+	density *= smoothstep(0.2,0.5,terrainData.y);
+	//no grass under water, sparse on the shore
+	density *= smoothstep(0,2,terrainData.w);
+	//thin out on high ground
+	density *= 1-0.8*smoothstep(140,180,terrainData.w);
+	//patches
+	density *= mix(0.6,1,clamp(layeredNoise(coord*0.02,3,1)+0.5,0,1));
+	return density;
+}
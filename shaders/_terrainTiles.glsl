@@ -0,0 +1,38 @@
+//streamed terrain tiles, see TerrainTileCache in terrain_tile_cache.hpp
+//	note: define TERRAIN_TILE_SET before including, binding 0 and 1 are the tile caches and binding 2 the indirection table
+layout(set = TERRAIN_TILE_SET, binding = 0) uniform sampler2DArray terrainHeightTiles;	//R16_UNORM, see terrainHeightRange
+layout(set = TERRAIN_TILE_SET, binding = 1) uniform sampler2DArray terrainNormalTiles;	//R8G8_SNORM normal xz
+
+layout(std430, set = TERRAIN_TILE_SET, binding = 2) readonly buffer terrainTileTable {
+	ivec4 terrainTileInfo;		//x = texels per tile side, y = tiles per map side, z = map size in texels
+	vec4 terrainHeightRange;	//x = scale, y = bias of the unorm heights
+	int terrainTileLayers[];	//cache layer of every tile, row major, -1 if only the overview covers it
+};
+
+int getTerrainMapSize() {
+	return terrainTileInfo.z;
+}
+
+vec4 fetchTerrainTexel(vec3 uvLayer) {
+	float height = textureLod(terrainHeightTiles, uvLayer, 0).r * terrainHeightRange.x + terrainHeightRange.y;
+	vec2 normalXZ = textureLod(terrainNormalTiles, uvLayer, 0).rg;
+	vec3 normal = vec3(normalXZ.x, sqrt(max(1 - dot(normalXZ, normalXZ), 0)), normalXZ.y);
+	return vec4(normal, height);
+}
+
+//returns (normal, height) at texel coordinate p (world xz + map size/2), bilinear filtered
+//	every layer has one extra column and row, so the filter never has to leave the tile
+vec4 sampleTerrainTiles(vec2 p) {
+	int tileSize = terrainTileInfo.x;
+	int tileCount = terrainTileInfo.y;
+	float layerSize = float(tileSize + 1);
+
+	p = clamp(p, vec2(0), vec2(terrainTileInfo.z - 1));
+	ivec2 tile = min(ivec2(p) / tileSize, ivec2(tileCount - 1));
+	int layer = terrainTileLayers[tile.x + tile.y * tileCount];
+	if(layer >= 0)
+		return fetchTerrainTexel(vec3((p - vec2(tile * tileSize) + 0.5) / layerSize, layer));
+
+	//not streamed in, the overview in layer 0 spans the whole map
+	return fetchTerrainTexel(vec3((p * tileSize / terrainTileInfo.z + 0.5) / layerSize, 0));
+}
@@ -1,11 +1,15 @@
 @echo off
 for %%i in (*.vert *.frag *.comp) do (
-	%VULKAN_SDK%/Bin/glslangValidator.exe -V "%%~i" -o "%%~i.spv"
+	%VULKAN_SDK%/Bin/glslangValidator.exe -V "%%~i" -o "%%~i.spv" || exit /b 1
+)
+rem mesh shaders need spir-v 1.4
+for %%i in (*.task *.mesh) do (
+	%VULKAN_SDK%/Bin/glslangValidator.exe -V --target-env vulkan1.3 "%%~i" -o "%%~i.spv" || exit /b 1
 )
 chdir scene
 for %%i in (*.vert *.frag *.comp) do (
-	%VULKAN_SDK%/Bin/glslangValidator.exe -V "%%~i" -o "%%~i.spv"
+	%VULKAN_SDK%/Bin/glslangValidator.exe -V "%%~i" -o "%%~i.spv" || exit /b 1
 )
 chdir ..
 echo success
-pause
\ No newline at end of file
+if not "%~1"=="nopause" pause
\ No newline at end of file
@@ -2,20 +2,36 @@
 
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_ARB_shader_viewport_layer_array : require
 
 #include "0_scene_data.glsl"
 
-layout (std140,set = 2, binding = 0) readonly buffer GrassData {
-	vec4 positions[];
-} grassData;
+#include "_animatedBlade.glsl"
+#include "_grassVisibility.glsl"
 
-layout(rgba16f,set = 2, binding = 1) readonly uniform image2D WindMap;
+//	note: blades are animated once per frame by grass_animate.comp, this only places the vertices
+//		  so the main pass and every shadow cascade share the same work
+//		  the blade is generated from gl_VertexIndex, no vertex buffer is read
+layout (std430,set = 2, binding = 4) readonly buffer AnimatedBladeData {
+	AnimatedBlade blades[];
+} animatedBladeData;
+
+//instance lists built by grass_animate.comp, per cascade for the shadow pass and per segment lod for the main pass
+layout (std430,set = 2, binding = 7) readonly buffer ShadowInstanceData {
+	uint shadowInstances[];
+};
+
+layout (std430,set = 2, binding = 9) readonly buffer LodInstanceData {
+	uint lodInstances[];
+};
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
 layout (location = 3) out vec3 outCameraPos;
 layout (location = 4) out vec3 outPos;
+layout (location = 5) flat out vec4 outMaterialData;
+layout (location = 6) flat out uint outVisibility; //read by grass_visibility.frag only
 
 struct Vertex {
 	vec3 position;
@@ -29,87 +45,28 @@ layout(buffer_reference, std430) readonly buffer VertexBuffer {
 	Vertex vertices[];
 };
 
+//	note: data.x = max segments of this pass, data.y = 1 when drawing a shadow cascade's instance list
+//		  otherwise every draw is one segment lod, its index range has no degenerate triangles
 #include "_pushConstantsDraw.glsl"
-
-#include "noise.glsl"
-
-mat3 getGrassRotationMatrix(vec3 a,vec3 b) {
-	mat3 matrix;
-	a.y = 0;
-	b.y =0 ;
-	float c = dot(a,b);
-	float s =  (a.z * b.x - a.x * b.z);
-	matrix[0] = vec3(c,0,-s);
-	matrix[1] = vec3(0,1,0);
-	matrix[2] = vec3(s,0,c);
-	return matrix;
-}
-
-float getWindStrength(float height) {
-	return clamp(height*height,0,2);
-}
-
-vec3 getWindDirection(vec3 grassBladePosition) {
-    vec3 i = floor(grassBladePosition);
-    vec3 f = fract(grassBladePosition);
-	ivec2 mapCenter = imageSize(WindMap)/2;
-    // Four corners in 2D of a tile
-    vec3 a = imageLoad(WindMap,mapCenter+ivec2(i.x,i.z)).xyz;
-    vec3 b = imageLoad(WindMap,mapCenter+ivec2(i.x,i.z)+ivec2(1,0)).xyz;
-    vec3 c = imageLoad(WindMap,mapCenter+ivec2(i.x,i.z)+ivec2(0,1)).xyz;
-    vec3 d = imageLoad(WindMap,mapCenter+ivec2(i.x,i.z)+ivec2(1,1)).xyz;
-
-    // Smooth Interpolation
-
-    // Cubic Hermine Curve.  Same as SmoothStep()
-    vec3 u = f*f*(3.0-2.0*f);
-
-    // Mix 4 coorners percentages
-    return mix(a, b, u.x) +
-            (c - a)* u.z * (1.0 - u.x) +
-            (d - b) * u.x * u.z;
-}
-
-mat3 getGrassRotationMatrix(vec3 vNormal,vec3 playerPosition, vec3 grassPosition) {
-	vec3 a = vNormal;
-	vec3 b = normalize((playerPosition + 10*(random(grassPosition.xz)-0.5))-grassPosition);
-	mat3 matrix;
-	a.y = 0;
-	b.y =0 ;
-	float c = dot(a,b);
-	float s =  (a.z * b.x - a.x * b.z);
-	matrix[0] = vec3(c,0,-s);
-	matrix[1] = vec3(0,1,0);
-	matrix[2] = vec3(s,0,c);
-	return matrix;
-}
+#include "_shadowCascade.glsl"
 
 void main() {
-	vec3 grassBladePosition = grassData.positions[gl_InstanceIndex].xyz;
-	vec3 windDirection = getWindDirection(grassBladePosition);
-
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
-
-	mat3 rotationTowardsPlayer = getGrassRotationMatrix(v.normal,PushConstants.playerPosition.xyz,grassData.positions[gl_InstanceIndex].xyz);
-	vec3 relativePosition = rotationTowardsPlayer * v.position;
-	vec3 position = relativePosition + grassBladePosition;
+	uint instance = PushConstants.data.y > 0 ? shadowInstances[gl_InstanceIndex] : lodInstances[gl_InstanceIndex];
+	AnimatedBlade blade = animatedBladeData.blades[instance];
 
-	vec3 windOffset = (windDirection * getWindStrength(v.position.y));
-	windOffset.y += -length(windOffset)*0.5;
-	position+= windOffset;
+	uint segments = min(getBladeSegments(blade), uint(PushConstants.data.x));
+	BladeVertex v = getBladeVertex(blade, gl_VertexIndex, segments);
 
-	gl_Position = sceneData.viewProj * PushConstants.render_matrix * vec4(position,1.0);
+	//the shadow pass is one multi draw, command i draws the instance list of cascade i
+	gl_Position = getViewProj(gl_DrawID) * PushConstants.render_matrix * vec4(v.position,1.0);
 
-	outNormal = normalize((PushConstants.render_matrix * -vec4(
-		sceneData.sunlightDirection.x-(v.position.x+windOffset.x*3),
-		0.3*abs(random(grassBladePosition.xz)),
-		sceneData.sunlightDirection.z-(v.position.x+windOffset.z*3),
-		0)).xyz);
-
-	outColor = mix(v.color.xyz*0.8,v.color.xyz*1.2,(clamp(rnoise(position.xz*0.02),0,1)));
-	outUV.x = v.uv_x;
-	outUV.y = v.uv_y;
+	outNormal = normalize((PushConstants.render_matrix * vec4(getBladeNormal(blade, v, sceneData.sunlightDirection.xyz), 0)).xyz);
+	outColor = getBladeColor(blade, v);
+	outUV.x = v.side > 0 ? 1 : 0;
+	outUV.y = 1;
 
 	outCameraPos = PushConstants.playerPosition.xyz;
-	outPos = position;
-}
\ No newline at end of file
+	outPos = v.position;
+	outMaterialData = vec4(0);
+	outVisibility = packBladeVisibility(instance, segments) | getProvokedTriangle(gl_VertexIndex);
+}
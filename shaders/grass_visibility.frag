@@ -0,0 +1,11 @@
+#version 460
+
+//grass in visibility buffer mode only stores which blade triangle is visible, see grass_material.comp
+//	note: the flat input comes from the triangle's provoking vertex, which already holds the triangle
+layout (location = 6) flat in uint inVisibility;
+
+layout (location = 0) out uint outVisibility;
+
+void main() {
+	outVisibility = inVisibility;
+}
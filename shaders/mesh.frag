@@ -5,54 +5,31 @@
 
 #include "0_scene_data.glsl"
 
-const int SHADOW_CASCADE_COUNT = 3;
-
-layout (set = 1, binding = 0) uniform sampler2DArray shadowMaps;
-
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec3 inColor;
 layout (location = 2) in vec2 inUV;
 layout (location = 3) in vec3 inPlayerPos;
 layout (location = 4) in vec3 inPos;
+layout (location = 5) flat in vec4 inMaterialData; //x > 0 for ground, y = far field grass blend start, z = max grass distance
 
 #include "_fragOutput.glsl"
 
-float ShadowCalculation() 
-{
-	vec3 projCoords = vec3(2);
-	int cascade = 4;
-	for(int i=0;i<SHADOW_CASCADE_COUNT;i++)
-	{
-		if(projCoords.x>1.0 || projCoords.x<0.0 || projCoords.y > 1.0 || projCoords.y < 0.0)
-		{
-			vec4 fragPosLightSpace = sceneData.sunViewProj[i] * vec4(inPos,1.0);
-			projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-			projCoords.xy = projCoords.xy *0.5 + 0.5;
-			cascade = i;
-		}
-	}
+#include "noise.glsl"
 
-	float currentDepth = projCoords.z;
-	//TODO we need a low bias for the grass shadows, but a higher bias to prevent moire on mesh --> different fragment shader?
-    float bias = 0.0001; 
-	float shadow = 0;
-	vec2 texelSize = 1.0/textureSize(shadowMaps,0).xy;
-	for(int x=-1;x<=1;x++)
-	{
-		for(int y=-1;y<=1;y++)
-		{
-			float closestDepth = texture(shadowMaps,vec3(projCoords.xy+vec2(x,y)*texelSize,cascade)).r; //z is the array indictaor
-			shadow += currentDepth  - bias > closestDepth ? 0.4 : 0.0;
-		}
-	}
-	shadow/=9.0;
-	//shadow = float(cascade)/SHADOW_CASCADE_COUNT;
-	//shadow = texture(shadowMaps,vec3(projCoords.xy*texelSize,2)).r;
-	//shadow = currentDepth;
-    //if(projCoords.z > 1.0 || projCoords.z < 0.0)
-    //    shadow = 0.0;
+//far field grass, shades the ground like a field of subpixel blades where the real blades have faded out
+//	density follows the same slope/water rules as the grass placement (_terrain.glsl)
+float getFarFieldGrass(inout vec3 color, inout vec3 normal) {
+	if(inMaterialData.x <= 0) return 0;
 
-	return shadow;
+	float blend = smoothstep(inMaterialData.y,inMaterialData.z,distance(inPos.xz,inPlayerPos.xz));
+	float density = smoothstep(0.2,0.5,normal.y) * smoothstep(0,2,inPos.y) * blend;
+
+	//same colors and variation as the blades (grass.vert), blades are mostly seen from the side so lean the normal up
+	vec3 grassColor = mix(vec3(0.14,0.32,0.08),vec3(0.38,0.56,0.25),0.6);
+	grassColor = mix(grassColor*0.8,grassColor*1.2,clamp(rnoise(inPos.xz*0.02),0,1));
+	color = mix(color,grassColor,density);
+	normal = normalize(mix(normal,vec3(0,1,0),0.5*density));
+	return density;
 }
 
 void main() {
@@ -60,21 +37,23 @@ void main() {
 	vec3 halfwayDir = normalize(-sceneData.sunlightDirection.xyz + viewDir);
 	
 	vec3 color = inColor;// * texture(colorTex,inUV).xyz;
+	vec3 normal = inNormal;
+	float farFieldGrass = getFarFieldGrass(color,normal);
 
-	float diffuseLight = max(dot(inNormal, normalize(-sceneData.sunlightDirection.xyz)),0.3f);
+	float diffuseLight = max(dot(normal, normalize(-sceneData.sunlightDirection.xyz)),0.3f);
 	vec3 ambientLight = vec3(0.1);//sceneData.ambientColor.xyz;
-	vec3 specularLight = vec3(1)*pow(max(dot(inNormal, halfwayDir), 0.0), 16);
-	
-	float shadow = ShadowCalculation();
+	vec3 specularLight = (1-farFieldGrass)*vec3(1)*pow(max(dot(normal, halfwayDir), 0.0), 16);
 	
-	vec3 light = ambientLight + (1.0-shadow) * (diffuseLight+specularLight) * sceneData.sunlightDirection.w;
-	//light = vec3(1.0-shadow);
+	//shadows are applied per pixel by deferred.comp (shadow_mask.comp), so the sun light is left unshadowed here
+	//	and its share of the light goes into the specular map for the deferred pass to scale down
+	vec3 sunLight = max((diffuseLight+specularLight) * sceneData.sunlightDirection.w, vec3(0));
+	vec3 light = ambientLight + sunLight;
 
 	outFragColor = vec4(color * light, 1.0f);
 	//outFragColor = vec4(color,1.0f);
 	//outFragColor = vec4(light,1.0f);
 
-	outNormal = vec4(inNormal,1);
+	outNormal = vec4(normal,1);
 	outPosition = sceneData.view * vec4(inPos,1);
-	outSpecularMap = vec4(0);
+	outSpecularMap = vec4(0, sunLight.x / light.x, 0, 1);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_ARB_shader_viewport_layer_array : require
 
 #include "0_scene_data.glsl"
 
@@ -10,6 +11,7 @@ layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
 layout (location = 3) out vec3 outCameraPos;
 layout (location = 4) out vec3 outPos;
+layout (location = 5) flat out vec4 outMaterialData;
 
 struct Vertex {
 	vec3 position;
@@ -24,12 +26,14 @@ layout(buffer_reference, std430) readonly buffer VertexBuffer {
 };
 
 #include "_pushConstantsDraw.glsl"
+#include "_shadowCascade.glsl"
 
 void main() {
 	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
 	vec4 position = vec4(v.position, 1.0f);
 
-	gl_Position = sceneData.viewProj * PushConstants.render_matrix * position;
+	//	note: in the shadow pass there is one instance per cascade the mesh overlaps, firstInstance is the cascade
+	gl_Position = getViewProj(gl_InstanceIndex) * PushConstants.render_matrix * position;
 	//gl_Position = sceneData.viewProj * position;
 
 	outNormal = (PushConstants.render_matrix * vec4(v.normal, 0.f)).xyz;
@@ -39,4 +43,5 @@ void main() {
 	
 	outCameraPos = PushConstants.playerPosition.xyz;
 	outPos = position.xyz;
+	outMaterialData = PushConstants.data;
 }
\ No newline at end of file
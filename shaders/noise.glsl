@@ -65,6 +65,13 @@ vec2 hash( vec2 p ) {
 	return -1.0 + 2.0*fract(sin(p)*43758.5453123);
 }
 
+//integer hash for lattice points, unlike hash() it gives the same bits on the CPU (see terrain_heightmap.cpp)
+vec2 ihash( vec2 p ) {
+	uvec2 q = uvec2(ivec2(p)) * UI2;
+	q = (q.x ^ q.y) * UI2;
+	return -1. + 2. * vec2(q) * UIF;
+}
+
 float rnoise( in vec2 p ) {
     const float K1 = 0.366025404; // (sqrt(3)-1)/2;
     const float K2 = 0.211324865; // (3-sqrt(3))/6;
@@ -74,7 +81,7 @@ float rnoise( in vec2 p ) {
     vec2 b = a - o + K2;
 	vec2 c = a - 1.0 + 2.0*K2;
     vec3 h = max(0.5-vec3(dot(a,a), dot(b,b), dot(c,c) ), 0.0 );
-	vec3 n = h*h*h*h*vec3( dot(a,hash(i+0.0)), dot(b,hash(i+o)), dot(c,hash(i+1.0)));
+	vec3 n = h*h*h*h*vec3( dot(a,ihash(i+0.0)), dot(b,ihash(i+o)), dot(c,ihash(i+1.0)));
     return dot(n, vec3(70.0));	
 }
 float layeredNoise(vec2 p, int octaves, float initialPersistence) {
@@ -0,0 +1,23 @@
+#version 460
+
+//scales the draw extent of _finalDrawImage to the swapchain and converts it to its format in one pass,
+//	drawn in the same rendering as the ui, see VulkanEngine::drawImGui
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+layout (set = 0, binding = 0) uniform sampler2D finalDrawImage;
+
+//push constants block
+layout( push_constant ) uniform constants
+{
+	vec4 data1; //xy = draw extent / image size
+	vec4 data2;
+	vec4 data3;
+	vec4 data4;
+} PushConstants;
+
+void main()
+{
+	outFragColor = vec4(textureLod(finalDrawImage, inUV * PushConstants.data1.xy, 0).rgb, 1);
+}
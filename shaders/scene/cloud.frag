@@ -27,6 +27,10 @@ layout(buffer_reference, std430) readonly buffer VertexBuffer {
 //	float coverage;
 //} PushConstants;
 
+//QualitySettings::cloudSteps and cloudLightSteps
+layout (constant_id = 0) const int CLOUD_STEPS = 100;
+layout (constant_id = 1) const int CLOUD_LIGHT_STEPS = 10;
+
 const float LIGHT_ABSORPTION = 9.1; //greater = darker - consider using this in weather map in 1 channel
 const float DARKNESS_THRESHOLD = 0.5;
 //TODO : currently hard coded
@@ -174,7 +178,7 @@ vec4 getCloudColor(vec3 raySrc, vec3 rayHit, int resolution)
         if(nextDensity>0)
         {
             float hg = HenyeyGreenstein(lightDir,rayDir,PushConstants.data.y);
-            float lightTransmittance = getLightStrength(pos,10) * hg;
+            float lightTransmittance = getLightStrength(pos,CLOUD_LIGHT_STEPS) * hg;
             light += nextDensity * transmittance * lightTransmittance *stepSize;
             transmittance *= exp(-nextDensity * stepSize);
         }
@@ -228,11 +232,12 @@ void main() {
     //float cloud = getCloudDensity(inPlayerPos,inPosition,50);
 	//outFragColor = vec4(1,1,1,cloud);
     vec3 inPlayerPos = PushConstants.playerPosition.xyz;
-    vec4 cloudColor = getCloudColor(inPlayerPos,inPosition,100);
+    vec4 cloudColor = getCloudColor(inPlayerPos,inPosition,CLOUD_STEPS);
     //cloudColor += vec4(0.1,0.1,0.1,0.5);
     outFragColor = cloudColor;
 
     outNormal = vec4(0,-1,0,1);
 	outPosition = sceneData.view * vec4(inPosition,1);
-	outSpecularMap = vec4(0);
+	//	note: covers the sun share (g) of what is behind, so the shadow mask fades out under the clouds
+	outSpecularMap = vec4(0,0,0,cloudColor.a);
 }
\ No newline at end of file
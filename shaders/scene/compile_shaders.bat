@@ -1,6 +1,6 @@
 @echo off
 for %%i in (*.vert *.frag *.comp) do (
-	%VULKAN_SDK%/Bin/glslangValidator.exe -V "%%~i" -o "%%~i.spv"
+	%VULKAN_SDK%/Bin/glslangValidator.exe -V "%%~i" -o "%%~i.spv" || exit /b 1
 )
 echo success
-pause
\ No newline at end of file
+if not "%~1"=="nopause" pause
\ No newline at end of file
@@ -7,7 +7,8 @@
 
 const int SHADOW_CASCADE_COUNT = 3;
 
-layout (set = 1, binding = 0) uniform sampler2DArray shadowMaps;
+layout (set = 1, binding = 0) uniform sampler2DArray shadowMaps; //animated grass
+layout (set = 1, binding = 1) uniform sampler2DArray staticShadowMaps; //terrain and meshes
 
 layout (set = 2, binding = 0) uniform sampler2D displacementTex;
 layout (set = 2, binding = 1) uniform sampler2D derivativesTex;
@@ -46,7 +47,8 @@ float ShadowCalculation()
 	{
 		for(int y=-1;y<=1;y++)
 		{
-			float closestDepth = texture(shadowMaps,vec3(projCoords.xy+vec2(x,y)*texelSize,cascade)).r; //z is the array indictaor
+			vec3 uvw = vec3(projCoords.xy+vec2(x,y)*texelSize,cascade); //z is the array indictaor
+			float closestDepth = min(texture(shadowMaps,uvw).r, texture(staticShadowMaps,uvw).r);
 			shadow += currentDepth  - bias > closestDepth ? 0.4 : 0.0;
 		}
 	}
@@ -115,7 +117,8 @@ void main() {
 
 	outNormal = vec4(inNormal,1);
 	//outNormal = vec4(0,1,0,1);
-	outSpecularMap = vec4(1-foam);
+	//water is lit and shadowed here, the shadow mask only keeps shading the ground seen through it
+	outSpecularMap = vec4(1-foam,0,0,clamp(color.a,0,1));
 	//outSpecularMap = vec4(0);
 	//outFragColor = vec4(vec3(foam),1);
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_ARB_shader_viewport_layer_array : require
+
+#include "0_scene_data.glsl"
+
+//CDLOD terrain patch, see TerrainLod in terrain_lod.hpp
+//	the vertex buffer is the shared patch grid (x and z in grid units), every instance places it
+//	on the terrain and morphs the odd vertices into the next coarser grid towards the end of its lod range
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outCameraPos;
+layout (location = 4) out vec3 outPos;
+layout (location = 5) flat out vec4 outMaterialData;
+
+#include "_vertex.glsl"
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer {
+	Vertex vertices[];
+};
+
+#include "_pushConstantsDraw.glsl"
+#include "_shadowCascade.glsl"
+
+#define TERRAIN_PATCH_RESOLUTION 16 //must match TerrainLod::PATCH_RESOLUTION
+
+#define TERRAIN_TILE_SET 2
+#include "_terrainTiles.glsl"
+
+//must match TerrainPatch in terrain_lod.hpp
+struct TerrainPatch {
+	vec4 data; //xy = world origin (xz), z = size, w = lod level
+	vec4 morph; //x = morph start distance, y = morph end distance, z = shadow cascade
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer patchData {
+	TerrainPatch patches[];
+};
+
+vec4 getHeightData(vec2 p) {
+	return sampleTerrainTiles(p + getTerrainMapSize()/2);
+}
+
+void main() {
+	TerrainPatch terrainPatch = patches[gl_InstanceIndex];
+	vec2 gridPosition = PushConstants.vertexBuffer.vertices[gl_VertexIndex].position.xz;
+	float spacing = terrainPatch.data.z / TERRAIN_PATCH_RESOLUTION;
+	vec2 position = terrainPatch.data.xy + gridPosition * spacing;
+
+	//morph by the distance to the unmorphed vertex, the same distance the lod selection uses
+	float height = getHeightData(position).a;
+	float morph = clamp((distance(vec3(position.x, height, position.y), PushConstants.playerPosition.xyz) - terrainPatch.morph.x)
+		/ (terrainPatch.morph.y - terrainPatch.morph.x), 0, 1);
+	position -= fract(gridPosition * 0.5) * 2 * spacing * morph;
+
+	vec4 mapData = getHeightData(position);
+	float y = mapData.a;
+
+	gl_Position = getViewProj(int(terrainPatch.morph.z)) * vec4(position.x, y, position.y, 1);
+
+	vec4 color = vec4(0.07,0.15*(1+y/10),0.09,1.0);
+	color = mix(color,vec4(0.451,0.243,0.039,1.0),clamp(abs(min(y,0)),0,1));
+
+	outNormal = mapData.xyz;
+	outColor = color.xyz;
+	outUV = vec2(0);
+	outCameraPos = PushConstants.playerPosition.xyz;
+	outPos = vec3(position.x, y, position.y);
+	outMaterialData = PushConstants.data;
+}
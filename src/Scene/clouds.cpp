@@ -60,6 +60,7 @@ void CloudMesh::init(VulkanEngine* engine)
 		VkImageUsageFlags imageUsageFlags{};
 		imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;			//compute shader can write to image
 		if (bUseValidationLayers) imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageUsageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT; //goes through the asset cache
 
 		VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(_baseNoiseImage.imageFormat, imageUsageFlags, imageExtent, VK_IMAGE_TYPE_3D);
 
@@ -90,6 +91,7 @@ void CloudMesh::init(VulkanEngine* engine)
 		VkImageUsageFlags imageUsageFlags{};
 		imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;			//compute shader can write to image
 		if (bUseValidationLayers) imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageUsageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT; //goes through the asset cache
 
 		VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(_detailNoiseImage.imageFormat, imageUsageFlags, imageExtent, VK_IMAGE_TYPE_3D);
 
@@ -120,6 +122,7 @@ void CloudMesh::init(VulkanEngine* engine)
 		VkImageUsageFlags imageUsageFlags{};
 		imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;			//compute shader can write to image
 		if (bUseValidationLayers) imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageUsageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT; //goes through the asset cache
 
 		VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(_fluidNoiseImage.imageFormat, imageUsageFlags, imageExtent, VK_IMAGE_TYPE_2D);
 
@@ -150,6 +153,7 @@ void CloudMesh::init(VulkanEngine* engine)
 		VkImageUsageFlags imageUsageFlags{};
 		imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;			//compute shader can write to image
 		if (bUseValidationLayers) imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageUsageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT; //goes through the asset cache
 
 		VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(_weatherImage.imageFormat, imageUsageFlags, imageExtent, VK_IMAGE_TYPE_2D);
 
@@ -239,7 +243,11 @@ void CloudMesh::init(VulkanEngine* engine)
 	//clean structures
 	vkDestroyShaderModule(engine->_device, computeShader, nullptr);
 
-	engine->immediateSubmit(
+	//the noise volumes and weather map are static, generate them once and reuse them on later runs
+	//	note: cloudmap.comp does not read the time it is pushed, the shader binary and the sizes are the whole key
+	AssetCache::Key key;
+	key.addFile("./shaders/scene/cloudmap.comp.spv").add((int)CLOUD_MAP_SIZE).add((int)CLOUD_MAP_HEIGHT).add(RENDER_DISTANCE);
+	engine->generateCachedImages("clouds", key, { &_baseNoiseImage, &_detailNoiseImage, &_fluidNoiseImage, &_weatherImage },
 		[&](VkCommandBuffer cmd) {
 			update(cmd, engine);
 		}
@@ -370,8 +378,8 @@ void CloudMesh::init(VulkanEngine* engine)
 		writer.updateSet(engine->_device, _cloudMapSamplerDescriptorSet);
 	}
 
-	VkShaderModule fragShader;
-	if (!vkutil::loadShaderModule("./shaders/scene/cloud.frag.spv", engine->_device, &fragShader))
+	//	note: kept for the quality permutations, see draw
+	if (!vkutil::loadShaderModule("./shaders/scene/cloud.frag.spv", engine->_device, &_cloudFragmentShader))
 	{
 		fmt::print("error when building cloud fragmentshader module");
 	}
@@ -379,8 +387,7 @@ void CloudMesh::init(VulkanEngine* engine)
 	{
 		fmt::print("cloud fragment shader loaded");
 	}
-	VkShaderModule vertShader;
-	if (!vkutil::loadShaderModule("./shaders/scene/cloud.vert.spv", engine->_device, &vertShader))
+	if (!vkutil::loadShaderModule("./shaders/scene/cloud.vert.spv", engine->_device, &_cloudVertexShader))
 	{
 		fmt::print("error when building cloud vertex shader module");
 	}
@@ -419,42 +426,46 @@ void CloudMesh::init(VulkanEngine* engine)
 		engine->_positionsImage.imageFormat
 	};
 	//CREATE PIPELINE
-	vkutil::PipelineBuilder pipelineBuilder;
-
-	//	pipeline layout
-	pipelineBuilder._pipelineLayout = _cloudPipelineLayout;
-	//	connect vertex and fragment shaders to pipeline
-	pipelineBuilder.setShaders(vertShader, fragShader);
-	//	input topology
-	pipelineBuilder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-	//	polygon mode
-	pipelineBuilder.setPolygonMode(VK_POLYGON_MODE_FILL);
-	//	cull mode
-	pipelineBuilder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
-	//	disable multisampling
-	pipelineBuilder.setMultisamplingNone();
-	//	BLENDING
-	std::vector<vkutil::ColorBlendingMode> modes = {
-		vkutil::ALPHABLEND,
-		vkutil::ALPHABLEND,
-		vkutil::ALPHABLEND,
-		vkutil::ALPHABLEND,
-	};
-	pipelineBuilder.setBlendingModes(modes);
-	// depth testing
-	pipelineBuilder.enableDepthTest(true, VK_COMPARE_OP_LESS_OR_EQUAL);
-	//pipelineBuilder.disableDepthTest();
+	//	the march step counts are specialization constants, one pipeline per quality setting
+	_cloudPipelines.init([=, this](const std::pair<int, int>& steps) {
+		vkutil::PipelineBuilder pipelineBuilder;
+
+		//	pipeline layout
+		pipelineBuilder._pipelineLayout = _cloudPipelineLayout;
+		//	connect vertex and fragment shaders to pipeline
+		pipelineBuilder.setShaders(_cloudVertexShader, _cloudFragmentShader);
+		//	input topology
+		pipelineBuilder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+		//	polygon mode
+		pipelineBuilder.setPolygonMode(VK_POLYGON_MODE_FILL);
+		//	cull mode
+		pipelineBuilder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+		//	disable multisampling
+		pipelineBuilder.setMultisamplingNone();
+		//	BLENDING
+		std::vector<vkutil::ColorBlendingMode> modes = {
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+		};
+		pipelineBuilder.setBlendingModes(modes);
+		// depth testing
+		pipelineBuilder.enableDepthTest(true, VK_COMPARE_OP_LESS_OR_EQUAL);
+		//pipelineBuilder.disableDepthTest();
 
-	//connect image format we will draw to, from draw image
-	pipelineBuilder.setColorAttachmentFormats(colorAttachmentFormats);
-	pipelineBuilder.setDepthFormat(engine->_depthImage.imageFormat);
+		//connect image format we will draw to, from draw image
+		pipelineBuilder.setColorAttachmentFormats(colorAttachmentFormats);
+		pipelineBuilder.setDepthFormat(engine->_depthImage.imageFormat);
 
-	//build pipeline
-	_cloudPipeline = pipelineBuilder.buildPipeline(engine->_device);
+		vkutil::SpecializationConstants constants;
+		constants.add(0, steps.first)
+			.add(1, steps.second);
+		pipelineBuilder.setSpecialization(constants.info());
 
-	//clean structures
-	vkDestroyShaderModule(engine->_device, fragShader, nullptr);
-	vkDestroyShaderModule(engine->_device, vertShader, nullptr);
+		//build pipeline
+		return pipelineBuilder.buildPipeline(engine->_device);
+	});
 
 
 }
@@ -468,7 +479,7 @@ int CloudMesh::draw(VkCommandBuffer cmd, VkDescriptorSet* sceneDataDescriptorSet
 
 	pushConstants.vertexBuffer = _cloudMesh->meshBuffers.vertexBufferAddress;
 	pushConstants.data = glm::vec4(settings.coverage, settings.hgConstant, 1, settings.coverage);
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _cloudPipeline);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _cloudPipelines.get({ _engine->_quality.cloudSteps, _engine->_quality.cloudLightSteps }));
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _cloudPipelineLayout, 0, 1, sceneDataDescriptorSet, 0, nullptr);
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _cloudPipelineLayout, 1, 1, &_cloudMapSamplerDescriptorSet, 0, nullptr);
 	vkCmdPushConstants(cmd, _cloudPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);	
@@ -508,5 +519,7 @@ void CloudMesh::cleanup()
 	_engine->destroyBuffer(_cloudMesh->meshBuffers.indexBuffer);
 
 	vkDestroyPipelineLayout(_engine->_device, _cloudPipelineLayout, nullptr);
-	vkDestroyPipeline(_engine->_device, _cloudPipeline, nullptr);
+	_cloudPipelines.destroy(_engine->_device);
+	vkDestroyShaderModule(_engine->_device, _cloudVertexShader, nullptr);
+	vkDestroyShaderModule(_engine->_device, _cloudFragmentShader, nullptr);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "../vk_types.hpp"
 #include "../vk_loader.hpp"
 #include "../vk_descriptors.hpp"
+#include "../vk_pipelines.hpp"
 
 
 class CloudMesh 
@@ -16,6 +17,8 @@ public:
 	int draw(VkCommandBuffer cmd, VkDescriptorSet* sceneDataDescriptorSet, GPUDrawPushConstants pushConstants); //returns number of tris
 
 	void drawGUI();
+	//pipelines of earlier quality settings, see VulkanEngine::releaseQualityPipelines
+	std::vector<VkPipeline> releasePipelines() { return _cloudPipelines.release(); }
 
 	void cleanup();
 private:
@@ -44,7 +47,9 @@ private:
 	VkPipeline _cloudMapComputePipeline;
 	std::shared_ptr<MeshAsset> _cloudMesh;
 	VkPipelineLayout _cloudPipelineLayout;
-	VkPipeline _cloudPipeline;
+	vkutil::PipelinePermutations<std::pair<int, int>> _cloudPipelines; //keyed on the view and light steps
+	VkShaderModule _cloudVertexShader;
+	VkShaderModule _cloudFragmentShader;
 
 	VkSampler _sampler;
 };
\ No newline at end of file
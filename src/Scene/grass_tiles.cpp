@@ -0,0 +1,166 @@
+#include "grass_tiles.hpp"
+#include "terrain_heightmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+void GrassTilePool::configure(int tileSize, float radius, uint32_t bladesPerTile)
+{
+	_tileSize = tileSize;
+	_radius = radius;
+	_bladesPerTile = bladesPerTile;
+
+	//every tile touching the view circle has to fit, plus a ring of slack
+	//	so tiles that just left the circle dont have to be evicted immediately (hysteresis)
+	float tileRadius = radius / tileSize + 1.4143f;
+	_capacity = (uint32_t)std::ceil(3.14159f * tileRadius * tileRadius) + (uint32_t)std::ceil(2 * 3.14159f * tileRadius);
+
+	_tiles.clear();
+	_freeSlots.clear();
+	for (uint32_t i = _capacity; i > 0; i--)
+	{
+		_freeSlots.push_back(i - 1);
+	}
+}
+
+float GrassTilePool::distanceToTile(glm::ivec2 coord) const
+{
+	glm::vec2 tileMin = glm::vec2(coord) * (float)_tileSize;
+	glm::vec2 tileMax = tileMin + (float)_tileSize;
+	glm::vec2 closest = glm::clamp(_cameraPosition, tileMin, tileMax);
+	return glm::distance(closest, _cameraPosition);
+}
+
+void GrassTilePool::update(glm::vec3 cameraPosition)
+{
+	_cameraPosition = glm::vec2(cameraPosition.x, cameraPosition.z);
+
+	//evict tiles that are well outside the view distance
+	for (auto it = _tiles.begin(); it != _tiles.end();)
+	{
+		if (distanceToTile(it->second.coord) > _radius + _tileSize)
+		{
+			_freeSlots.push_back(it->second.slot);
+			it = _tiles.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	//find tiles inside the view distance that are not resident yet
+	std::vector<glm::ivec2> missingTiles;
+	glm::ivec2 minCoord = glm::ivec2(glm::floor((_cameraPosition - _radius) / (float)_tileSize));
+	glm::ivec2 maxCoord = glm::ivec2(glm::floor((_cameraPosition + _radius) / (float)_tileSize));
+	for (int x = minCoord.x; x <= maxCoord.x; x++)
+	{
+		for (int y = minCoord.y; y <= maxCoord.y; y++)
+		{
+			glm::ivec2 coord(x, y);
+			if (distanceToTile(coord) < _radius && !_tiles.contains(key(coord)))
+				missingTiles.push_back(coord);
+		}
+	}
+	if (missingTiles.empty()) return;
+
+	std::sort(missingTiles.begin(), missingTiles.end(), [&](glm::ivec2 a, glm::ivec2 b) {
+		return distanceToTile(a) < distanceToTile(b);
+		});
+
+	for (glm::ivec2 coord : missingTiles)
+	{
+		if (_freeSlots.empty())
+		{
+			//pool is full, steal the slot of the furthest tile that is outside the view distance
+			auto furthest = _tiles.end();
+			float furthestDistance = _radius;
+			for (auto it = _tiles.begin(); it != _tiles.end(); it++)
+			{
+				float distance = distanceToTile(it->second.coord);
+				if (distance >= furthestDistance)
+				{
+					furthestDistance = distance;
+					furthest = it;
+				}
+			}
+			//	note: cant happen with the capacity from configure(), but dont overwrite visible tiles if it does
+			if (furthest == _tiles.end()) return;
+
+			_freeSlots.push_back(furthest->second.slot);
+			_tiles.erase(furthest);
+		}
+
+		Tile tile;
+		tile.coord = coord;
+		//	note: blades bend with the wind, so pad the bounds
+		tile.boundsMin = glm::vec3(coord.x * _tileSize - 2.f, TILE_MIN_HEIGHT, coord.y * _tileSize - 2.f);
+		tile.boundsMax = glm::vec3((coord.x + 1) * _tileSize + 2.f, TILE_MAX_HEIGHT, (coord.y + 1) * _tileSize + 2.f);
+		float low, high;
+		if (_terrain && _terrain->getHeightRange(glm::vec2(tile.boundsMin.x, tile.boundsMin.z), glm::vec2(tile.boundsMax.x, tile.boundsMax.z), low, high))
+		{
+			tile.boundsMin.y = low - TILE_HEIGHT_PADDING;
+			tile.boundsMax.y = high + TILE_HEIGHT_PADDING;
+		}
+		tile.slot = _freeSlots.back();
+		tile.dirty = true;
+		_freeSlots.pop_back();
+
+		_tiles[key(coord)] = tile;
+	}
+}
+
+uint32_t GrassTilePool::dirtyCount() const
+{
+	uint32_t count = 0;
+	for (const auto& [k, tile] : _tiles)
+	{
+		if (tile.dirty) count++;
+	}
+	return count;
+}
+
+std::vector<GrassTilePool::Tile> GrassTilePool::takeDirtyTiles(int maxCount)
+{
+	std::vector<Tile*> dirtyTiles;
+	for (auto& [k, tile] : _tiles)
+	{
+		if (tile.dirty) dirtyTiles.push_back(&tile);
+	}
+
+	std::sort(dirtyTiles.begin(), dirtyTiles.end(), [&](Tile* a, Tile* b) {
+		return distanceToTile(a->coord) < distanceToTile(b->coord);
+		});
+
+	std::vector<Tile> result;
+	for (int i = 0; i < (int)dirtyTiles.size() && i < maxCount; i++)
+	{
+		dirtyTiles[i]->dirty = false;
+		result.push_back(*dirtyTiles[i]);
+	}
+	return result;
+}
+
+int GrassTilePool::cull(const Frustum& frustum, std::vector<DrawRange>& ranges) const
+{
+	std::vector<uint32_t> visibleSlots;
+	for (auto& [k, tile] : _tiles)
+	{
+		if (!tile.dirty && frustum.intersectsAABB(tile.boundsMin, tile.boundsMax))
+			visibleSlots.push_back(tile.slot);
+	}
+	std::sort(visibleSlots.begin(), visibleSlots.end());
+
+	//merge neighbouring slots so they can share a draw call
+	ranges.clear();
+	for (uint32_t slot : visibleSlots)
+	{
+		if (!ranges.empty() && ranges.back().firstSlot + ranges.back().slotCount == slot)
+			ranges.back().slotCount++;
+		else
+			ranges.push_back({ slot, 1 });
+	}
+	return (int)visibleSlots.size();
+}
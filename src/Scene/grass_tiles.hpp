@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "../frustum.hpp"
+
+class TerrainHeightMap;
+
+//push constants for generating a single grass tile (grass_data.comp)
+struct GrassTilePushConstants
+{
+	glm::vec4 tileData;		//xy = tile origin (world xz), z = tile size
+	glm::uvec4 instanceData;	//x = first instance of the tile, y = blades per tile (pattern size), z = tile slot
+};
+
+//streams fixed size world space grass tiles in and out around the camera.
+//	every tile owns one slot in the grass data buffer (up to bladesPerTile instances), so the buffer
+//	only depends on the view distance and never on how big the world is.
+//	this is CPU only, the engine dispatches the dirty tiles and draws the visible slots.
+class GrassTilePool
+{
+public:
+	struct Tile
+	{
+		glm::ivec2 coord;		//tile coordinate, world origin of the tile is coord * tileSize
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		uint32_t slot;			//instance range starts at slot * bladesPerTile, the GPU appends the accepted blades
+		bool dirty;				//slot contents still need to be generated, dirty tiles are never drawn
+	};
+
+	//contiguous run of slots that can be drawn with a single instanced draw
+	struct DrawRange
+	{
+		uint32_t firstSlot;
+		uint32_t slotCount;
+	};
+
+	//conservative vertical bounds of a tile that is not covered by the terrain map
+	static constexpr float TILE_MIN_HEIGHT = -256.f;
+	static constexpr float TILE_MAX_HEIGHT = 256.f;
+	//blades stick out of the ground and bend with the wind
+	static constexpr float TILE_HEIGHT_PADDING = 2.f;
+
+	//clears all tiles and resizes the pool for the new settings
+	void configure(int tileSize, float radius, uint32_t bladesPerTile);
+
+	//new tiles get their vertical bounds from the terrain
+	void setTerrain(const TerrainHeightMap* terrain) { _terrain = terrain; }
+
+	//evicts far away tiles and assigns slots to new tiles around the camera
+	void update(glm::vec3 cameraPosition);
+
+	//returns up to maxCount dirty tiles, nearest first, and marks them as generated
+	std::vector<Tile> takeDirtyTiles(int maxCount);
+	//resident tiles that still have to be generated
+	uint32_t dirtyCount() const;
+
+	//fills ranges with the generated tiles that intersect the frustum, returns number of visible tiles
+	int cull(const Frustum& frustum, std::vector<DrawRange>& ranges) const;
+
+	uint32_t capacity() const { return _capacity; }
+	uint32_t residentCount() const { return (uint32_t)_tiles.size(); }
+	uint32_t bladesPerTile() const { return _bladesPerTile; }
+	int tileSize() const { return _tileSize; }
+
+private:
+	static int64_t key(glm::ivec2 coord) { return ((int64_t)coord.x << 32) | (uint32_t)coord.y; }
+	float distanceToTile(glm::ivec2 coord) const; //distance from camera to the tile rectangle on xz
+
+	int _tileSize = 16;
+	float _radius = 0;
+	uint32_t _bladesPerTile = 0;
+	uint32_t _capacity = 0;
+	glm::vec2 _cameraPosition = glm::vec2(0);
+	const TerrainHeightMap* _terrain = nullptr;
+
+	std::unordered_map<int64_t, Tile> _tiles;
+	std::vector<uint32_t> _freeSlots;
+};
@@ -0,0 +1,373 @@
+#include "terrain_heightmap.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <thread>
+
+#include <immintrin.h>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+//	note: everything below mirrors noise.glsl and _terrain.glsl operation by operation, keep them in sync
+namespace
+{
+	constexpr uint32_t UI0 = 1597334673U;
+	constexpr uint32_t UI1 = 3812015801U;
+	constexpr float UIF = 1.0f / float(0xffffffffU);
+	constexpr float K1 = 0.366025404f;
+	constexpr float K2 = 0.211324865f;
+
+	//ihash in noise.glsl
+	void ihash(float x, float y, float& hx, float& hy)
+	{
+		uint32_t n = ((uint32_t)(int32_t)x * UI0) ^ ((uint32_t)(int32_t)y * UI1);
+		hx = -1.f + 2.f * (float)(n * UI0) * UIF;
+		hy = -1.f + 2.f * (float)(n * UI1) * UIF;
+	}
+
+	float rnoise(float px, float py)
+	{
+		float s = (px + py) * K1;
+		float ix = std::floor(px + s);
+		float iy = std::floor(py + s);
+		float t = (ix + iy) * K2;
+		float ax = px - ix + t;
+		float ay = py - iy + t;
+		float ox = ax > ay ? 1.f : 0.f;
+		float oy = ax > ay ? 0.f : 1.f;
+		float bx = ax - ox + K2;
+		float by = ay - oy + K2;
+		float cx = ax - 1.f + 2.f * K2;
+		float cy = ay - 1.f + 2.f * K2;
+
+		float ha = std::max(0.5f - (ax * ax + ay * ay), 0.f);
+		float hb = std::max(0.5f - (bx * bx + by * by), 0.f);
+		float hc = std::max(0.5f - (cx * cx + cy * cy), 0.f);
+
+		float gx, gy;
+		ihash(ix, iy, gx, gy);
+		float na = ha * ha * ha * ha * (ax * gx + ay * gy);
+		ihash(ix + ox, iy + oy, gx, gy);
+		float nb = hb * hb * hb * hb * (bx * gx + by * gy);
+		ihash(ix + 1.f, iy + 1.f, gx, gy);
+		float nc = hc * hc * hc * hc * (cx * gx + cy * gy);
+		return na * 70.f + nb * 70.f + nc * 70.f;
+	}
+
+	float layeredNoise(float px, float py, int octaves, float initialFrequency, float lacunarity, float persistence)
+	{
+		float n = 0;
+		float amplitude = 1.f;
+		float frequency = initialFrequency;
+		float maxAmplitude = 0.f;
+		for (int i = 0; i < octaves; i++)
+		{
+			maxAmplitude += amplitude;
+			n += rnoise(px * frequency, py * frequency) * amplitude;
+			amplitude *= persistence;
+			frequency *= lacunarity;
+		}
+		return n / maxAmplitude;
+	}
+
+	//4 wide versions of the above, one lane per texel
+	//	note: SSE4.1 for floor and 32 bit multiplies
+	inline __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+	inline __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+	inline __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+	inline __m128 splat(float f) { return _mm_set1_ps(f); }
+
+	//exact uint -> float conversion, both halves convert without rounding so only the sum rounds
+	inline __m128 uintToFloat(__m128i u)
+	{
+		__m128 high = _mm_cvtepi32_ps(_mm_srli_epi32(u, 16));
+		__m128 low = _mm_cvtepi32_ps(_mm_and_si128(u, _mm_set1_epi32(0xffff)));
+		return _mm_add_ps(_mm_mul_ps(high, splat(65536.f)), low);
+	}
+
+	inline void ihash4(__m128 x, __m128 y, __m128& hx, __m128& hy)
+	{
+		const __m128i ui0 = _mm_set1_epi32((int)UI0);
+		const __m128i ui1 = _mm_set1_epi32((int)UI1);
+		__m128i n = _mm_xor_si128(_mm_mullo_epi32(_mm_cvttps_epi32(x), ui0), _mm_mullo_epi32(_mm_cvttps_epi32(y), ui1));
+		hx = add(splat(-1.f), mul(mul(splat(2.f), uintToFloat(_mm_mullo_epi32(n, ui0))), splat(UIF)));
+		hy = add(splat(-1.f), mul(mul(splat(2.f), uintToFloat(_mm_mullo_epi32(n, ui1))), splat(UIF)));
+	}
+
+	inline __m128 pow4(__m128 h)
+	{
+		return mul(mul(mul(h, h), h), h);
+	}
+
+	__m128 rnoise4(__m128 px, __m128 py)
+	{
+		__m128 s = mul(add(px, py), splat(K1));
+		__m128 ix = _mm_floor_ps(add(px, s));
+		__m128 iy = _mm_floor_ps(add(py, s));
+		__m128 t = mul(add(ix, iy), splat(K2));
+		__m128 ax = add(sub(px, ix), t);
+		__m128 ay = add(sub(py, iy), t);
+		__m128 xGreater = _mm_cmpgt_ps(ax, ay);
+		__m128 ox = _mm_and_ps(xGreater, splat(1.f));
+		__m128 oy = _mm_andnot_ps(xGreater, splat(1.f));
+		__m128 bx = add(sub(ax, ox), splat(K2));
+		__m128 by = add(sub(ay, oy), splat(K2));
+		__m128 cx = add(sub(ax, splat(1.f)), splat(2.f * K2));
+		__m128 cy = add(sub(ay, splat(1.f)), splat(2.f * K2));
+
+		__m128 ha = _mm_max_ps(sub(splat(0.5f), add(mul(ax, ax), mul(ay, ay))), _mm_setzero_ps());
+		__m128 hb = _mm_max_ps(sub(splat(0.5f), add(mul(bx, bx), mul(by, by))), _mm_setzero_ps());
+		__m128 hc = _mm_max_ps(sub(splat(0.5f), add(mul(cx, cx), mul(cy, cy))), _mm_setzero_ps());
+
+		__m128 gx, gy;
+		ihash4(ix, iy, gx, gy);
+		__m128 na = mul(pow4(ha), add(mul(ax, gx), mul(ay, gy)));
+		ihash4(add(ix, ox), add(iy, oy), gx, gy);
+		__m128 nb = mul(pow4(hb), add(mul(bx, gx), mul(by, gy)));
+		ihash4(add(ix, splat(1.f)), add(iy, splat(1.f)), gx, gy);
+		__m128 nc = mul(pow4(hc), add(mul(cx, gx), mul(cy, gy)));
+		return add(add(mul(na, splat(70.f)), mul(nb, splat(70.f))), mul(nc, splat(70.f)));
+	}
+
+	__m128 layeredNoise4(__m128 px, __m128 py, int octaves, float initialFrequency, float lacunarity, float persistence)
+	{
+		__m128 n = _mm_setzero_ps();
+		float amplitude = 1.f;
+		float frequency = initialFrequency;
+		float maxAmplitude = 0.f;
+		for (int i = 0; i < octaves; i++)
+		{
+			maxAmplitude += amplitude;
+			n = add(n, mul(rnoise4(mul(px, splat(frequency)), mul(py, splat(frequency))), splat(amplitude)));
+			amplitude *= persistence;
+			frequency *= lacunarity;
+		}
+		return _mm_div_ps(n, splat(maxAmplitude));
+	}
+
+	//getTerrainHeight in _terrain.glsl
+	__m128 terrainHeight4(__m128 cx, __m128 cy, float centerX, float centerY)
+	{
+		__m128 height = add(mul(splat(64.f), layeredNoise4(mul(cx, splat(0.04f)), mul(cy, splat(0.04f)), 3, 0.1f, 4.f, 0.1f)), splat(96.f));
+		height = add(height, mul(splat(2.f), layeredNoise4(mul(cx, splat(0.2f)), mul(cy, splat(0.2f)), 4, 0.4f, 2.f, 0.2f)));
+
+		__m128 dx = sub(cx, splat(centerX));
+		__m128 dy = sub(cy, splat(centerY));
+		__m128 distance = _mm_sqrt_ps(add(mul(dx, dx), mul(dy, dy)));
+		__m128 a = mul(splat(0.006f), _mm_min_ps(_mm_max_ps(distance, _mm_setzero_ps()), splat(100.f)));
+		__m128 bowl = mul(splat(128.f), mul(mul(a, a), sub(splat(3.f), mul(splat(2.f), a))));
+		return add(height, sub(bowl, splat(128.f)));
+	}
+}
+
+float TerrainHeightMap::evaluateHeight(glm::vec2 coord, glm::vec2 mapCenter)
+{
+	float height = 64.f * layeredNoise(coord.x * 0.04f, coord.y * 0.04f, 3, 0.1f, 4.f, 0.1f) + 96.f;
+	height += 2.f * layeredNoise(coord.x * 0.2f, coord.y * 0.2f, 4, 0.4f, 2.f, 0.2f);
+
+	float a = 0.006f * std::clamp(glm::distance(coord, mapCenter), 0.f, 100.f);
+	height += 128.f * (a * a * (3.f - 2.f * a)) - 128.f;
+	return height;
+}
+
+void TerrainHeightMap::build(int size)
+{
+	_file = nullptr;
+	_size = size;
+	//texels -1..size, padded to whole SSE lanes
+	_stride = (size + 2 + 3) & ~3;
+	_heights.assign((size_t)_stride * (size + 2), 0.f);
+
+	float center = (float)(size / 2);
+
+	auto buildRows = [this, center](int firstRow, int lastRow) {
+		for (int row = firstRow; row < lastRow; row++)
+		{
+			float* heights = &_heights[(size_t)row * _stride];
+			__m128 y = _mm_set1_ps((float)(row - 1));
+			for (int i = 0; i < _stride; i += 4)
+			{
+				__m128 x = _mm_setr_ps((float)(i - 1), (float)(i), (float)(i + 1), (float)(i + 2));
+				_mm_storeu_ps(heights + i, terrainHeight4(x, y, center, center));
+			}
+		}
+		};
+
+	//one contiguous block of rows per core
+	int rowCount = size + 2;
+	int workerCount = std::max(1u, std::thread::hardware_concurrency());
+	int rowsPerWorker = (rowCount + workerCount - 1) / workerCount;
+	std::vector<std::future<void>> workers;
+	for (int firstRow = 0; firstRow < rowCount; firstRow += rowsPerWorker)
+	{
+		workers.push_back(std::async(std::launch::async, buildRows, firstRow, std::min(firstRow + rowsPerWorker, rowCount)));
+	}
+	for (auto& worker : workers) worker.get();
+
+	buildBounds();
+}
+
+void TerrainHeightMap::map(const TerrainTileFile& file)
+{
+	_file = &file;
+	_size = file.mapSize();
+	_stride = 0;
+	_heights.clear();
+	_heights.shrink_to_fit();
+
+	_boundsBlocksPerSide = TerrainTileFile::boundsBlocksPerSide(_size);
+	_bounds.clear();
+	for (int level = 0; level < file.boundsLevelCount(); level++)
+	{
+		const HeightBounds* blocks = file.boundsLevel(level);
+		_bounds.emplace_back(blocks, blocks + (size_t)_boundsBlocksPerSide[level] * _boundsBlocksPerSide[level]);
+	}
+}
+
+void TerrainHeightMap::buildBounds()
+{
+	_bounds.clear();
+	_boundsBlocksPerSide = TerrainTileFile::boundsBlocksPerSide(_size);
+
+	//level 0 from the texels, the last block stops at the map edge
+	int blocksPerSide = _boundsBlocksPerSide[0];
+	std::vector<HeightBounds> blocks((size_t)blocksPerSide * blocksPerSide);
+	for (int by = 0; by < blocksPerSide; by++)
+	{
+		for (int bx = 0; bx < blocksPerSide; bx++)
+		{
+			HeightBounds& block = blocks[bx + by * blocksPerSide];
+			block = { FLT_MAX, -FLT_MAX };
+			int lastX = std::min((bx + 1) * BOUNDS_BLOCK_SIZE, _size - 1);
+			int lastY = std::min((by + 1) * BOUNDS_BLOCK_SIZE, _size - 1);
+			for (int y = by * BOUNDS_BLOCK_SIZE; y <= lastY; y++)
+			{
+				for (int x = bx * BOUNDS_BLOCK_SIZE; x <= lastX; x++)
+				{
+					float height = texelHeight(x, y);
+					block.low = std::min(block.low, height);
+					block.high = std::max(block.high, height);
+				}
+			}
+		}
+	}
+	_bounds.push_back(std::move(blocks));
+
+	//every other level from its up to 4 children
+	for (int level = 1; level < (int)_boundsBlocksPerSide.size(); level++)
+	{
+		int childrenPerSide = _boundsBlocksPerSide[level - 1];
+		blocksPerSide = _boundsBlocksPerSide[level];
+		const std::vector<HeightBounds>& children = _bounds.back();
+		std::vector<HeightBounds> parents((size_t)blocksPerSide * blocksPerSide, HeightBounds{ FLT_MAX, -FLT_MAX });
+		for (int y = 0; y < childrenPerSide; y++)
+		{
+			for (int x = 0; x < childrenPerSide; x++)
+			{
+				HeightBounds& parent = parents[x / 2 + (y / 2) * blocksPerSide];
+				parent.low = std::min(parent.low, children[x + y * childrenPerSide].low);
+				parent.high = std::max(parent.high, children[x + y * childrenPerSide].high);
+			}
+		}
+		_bounds.push_back(std::move(parents));
+	}
+}
+
+glm::vec3 TerrainHeightMap::texelNormal(int x, int y) const
+{
+	//the file stores the normals the GPU filters
+	if (_file) return _file->texelNormal(x, y);
+
+	//	  T
+	//	L O R
+	//	  B
+	float T = texelHeight(x, y + 1);
+	float B = texelHeight(x, y - 1);
+	float L = texelHeight(x - 1, y);
+	float R = texelHeight(x + 1, y);
+	return glm::normalize(glm::vec3(L - R, 2, B - T));
+}
+
+glm::vec2 TerrainHeightMap::clampToMap(glm::vec2 samplePoint) const
+{
+	//same clamp as sampleTerrainTiles in _terrainTiles.glsl
+	return glm::clamp(samplePoint, glm::vec2(0), glm::vec2((float)(_size - 1)));
+}
+
+float TerrainHeightMap::getHeight(float x, float z) const
+{
+	glm::vec2 mapCenter = glm::vec2((float)(_size / 2));
+	glm::vec2 samplePoint = clampToMap(glm::vec2(x, z) + mapCenter);
+
+	int tx = (int)std::floor(samplePoint.x);
+	int ty = (int)std::floor(samplePoint.y);
+	float fx = samplePoint.x - tx;
+	float fy = samplePoint.y - ty;
+
+	float bl = texelHeight(tx, ty);
+	float tl = texelHeight(tx, ty + 1);
+	float br = texelHeight(tx + 1, ty);
+	float tr = texelHeight(tx + 1, ty + 1);
+	float left = bl + (tl - bl) * fy;
+	float right = br + (tr - br) * fy;
+	return left + (right - left) * fx;
+}
+
+glm::vec3 TerrainHeightMap::getNormal(float x, float z) const
+{
+	glm::vec2 mapCenter = glm::vec2((float)(_size / 2));
+	glm::vec2 samplePoint = clampToMap(glm::vec2(x, z) + mapCenter);
+
+	int tx = (int)std::floor(samplePoint.x);
+	int ty = (int)std::floor(samplePoint.y);
+	float fx = samplePoint.x - tx;
+	float fy = samplePoint.y - ty;
+
+	glm::vec3 left = glm::mix(texelNormal(tx, ty), texelNormal(tx, ty + 1), fy);
+	glm::vec3 right = glm::mix(texelNormal(tx + 1, ty), texelNormal(tx + 1, ty + 1), fy);
+	return glm::normalize(glm::mix(left, right, fx));
+}
+
+bool TerrainHeightMap::getHeightRange(glm::vec2 min, glm::vec2 max, float& low, float& high) const
+{
+	glm::vec2 mapCenter = glm::vec2((float)(_size / 2));
+	glm::vec2 first = glm::floor(min + mapCenter);
+	glm::vec2 last = glm::ceil(max + mapCenter);
+	if (!isBuilt()) return false;
+
+	getTexelRange(glm::ivec2(first), glm::ivec2(last), low, high);
+	return true;
+}
+
+void TerrainHeightMap::getTexelRange(glm::ivec2 first, glm::ivec2 last, float& low, float& high) const
+{
+	first = glm::clamp(first, glm::ivec2(0), glm::ivec2(_size - 1));
+	last = glm::clamp(last, first, glm::ivec2(_size - 1));
+
+	//the finest level with blocks at least as large as the rectangle, at most 2x2 of its blocks cover it
+	int extent = std::max(last.x - first.x, last.y - first.y);
+	int level = 0;
+	while ((BOUNDS_BLOCK_SIZE << level) < extent && level + 1 < boundsLevelCount()) level++;
+
+	//	note: a texel on a block edge is also the last texel of the previous block
+	int blockSize = BOUNDS_BLOCK_SIZE << level;
+	int blocksPerSide = _boundsBlocksPerSide[level];
+	glm::ivec2 firstBlock = first / blockSize;
+	glm::ivec2 lastBlock = glm::clamp((last - 1) / blockSize, firstBlock, glm::ivec2(blocksPerSide - 1));
+
+	const std::vector<HeightBounds>& blocks = _bounds[level];
+	low = FLT_MAX;
+	high = -FLT_MAX;
+	for (int y = firstBlock.y; y <= lastBlock.y; y++)
+	{
+		for (int x = firstBlock.x; x <= lastBlock.x; x++)
+		{
+			low = std::min(low, blocks[x + y * blocksPerSide].low);
+			high = std::max(high, blocks[x + y * blocksPerSide].high);
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "terrain_tile_file.hpp"
+
+//CPU terrain queries, see _terrain.glsl
+//	build() evaluates the procedural terrain with the same noise and in the same order of operations as the shader,
+//	4 texels at a time with SSE and rows spread over all cores, that is what the default terrain file is baked from.
+//	once a terrain file is mapped every query reads through it, so the CPU sees the same texels as the GPU.
+//	queries use the same texel space as the shaders: texel = world xz + size/2
+class TerrainHeightMap
+{
+public:
+	//bump whenever the procedural terrain changes, baked terrain files are keyed by it
+	static constexpr uint32_t GENERATOR_VERSION = 1;
+	//the min/max pyramid has the same layout as the bounds of a terrain file
+	static constexpr int BOUNDS_BLOCK_SIZE = TerrainTileFile::BOUNDS_BLOCK_SIZE;
+	using HeightBounds = TerrainTileFile::HeightBounds;
+
+	//evaluates the procedural terrain for every texel of a size x size map
+	void build(int size);
+	//reads the texels from the terrain file from now on, the file has to stay open
+	//	note: the min/max pyramid is copied from the bounds the file was baked with, no texel is touched
+	void map(const TerrainTileFile& file);
+
+	//bilinear height at world xz, same as the filtered heightmap fetch in grass_data.comp
+	//	outside of the map the edge texels are clamped, like the shaders do
+	float getHeight(float x, float z) const;
+	//bilinear normal at world xz
+	glm::vec3 getNormal(float x, float z) const;
+	//range of the texels over the world xz rectangle clamped to the map, false if there is no map
+	//	reads at most 2x2 blocks of the min/max pyramid, so the range is conservative, not tight
+	bool getHeightRange(glm::vec2 min, glm::vec2 max, float& low, float& high) const;
+	//same as getHeightRange for the inclusive texel rectangle first..last, clamped to the map
+	void getTexelRange(glm::ivec2 first, glm::ivec2 last, float& low, float& high) const;
+
+	//height and normal of a texel, the same values as the terrain tile textures once a file is mapped
+	float texelHeight(int x, int y) const { return _file ? _file->texelHeight(x, y) : _heights[(x + 1) + (y + 1) * _stride]; }
+	glm::vec3 texelNormal(int x, int y) const;
+
+	int size() const { return _size; }
+	bool isBuilt() const { return _size > 0; }
+
+	//scalar version of getTerrainHeight in _terrain.glsl
+	static float evaluateHeight(glm::vec2 coord, glm::vec2 mapCenter);
+
+	//min/max pyramid, see TerrainTileFile::HeightBounds and TerrainTileFile::boundsBlocksPerSide
+	int boundsLevelCount() const { return (int)_bounds.size(); }
+	int boundsBlocksPerSide(int level) const { return _boundsBlocksPerSide[level]; }
+	const std::vector<HeightBounds>& boundsLevel(int level) const { return _bounds[level]; }
+
+private:
+	glm::vec2 clampToMap(glm::vec2 samplePoint) const;
+	//builds the min/max pyramid from the texels
+	void buildBounds();
+
+	int _size = 0;
+	int _stride = 0;			//row stride of _heights, the map has a one texel border so edge normals match the shader
+	std::vector<float> _heights;
+	const TerrainTileFile* _file = nullptr;
+	std::vector<std::vector<HeightBounds>> _bounds;	//per level, row major
+	std::vector<int> _boundsBlocksPerSide;			//per level
+};
@@ -0,0 +1,143 @@
+#include "terrain_lod.hpp"
+#include "terrain_heightmap.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/common.hpp>
+
+void TerrainLod::configure(const TerrainHeightMap& terrain, float leafNodeSize, int levelCount)
+{
+	_leafNodeSize = leafNodeSize;
+	_levelCount = levelCount;
+	_origin = glm::vec2(-nodeSize(levelCount - 1) / 2);
+	_bounds.assign(levelCount, {});
+	_ranges.assign(levelCount, FLT_MAX);
+
+	//leaves from the min/max pyramid of the heightmap, every other level from its 4 children
+	//	note: texels and meters are the same, texel = world + size/2
+	int texelOffset = terrain.size() / 2;
+	int leafTexels = (int)leafNodeSize;
+	for (int level = 0; level < levelCount; level++)
+	{
+		int nodesPerSide = 1 << (levelCount - 1 - level);
+		std::vector<NodeBounds>& bounds = _bounds[level];
+		bounds.resize(nodesPerSide * nodesPerSide);
+		for (int y = 0; y < nodesPerSide; y++)
+		{
+			for (int x = 0; x < nodesPerSide; x++)
+			{
+				NodeBounds& node = bounds[x + y * nodesPerSide];
+				if (level == 0)
+				{
+					//edges are shared with the neighbours, the terrain clamps at the map edge like the samplers
+					glm::ivec2 first = glm::ivec2(_origin) + texelOffset + glm::ivec2(x, y) * leafTexels;
+					terrain.getTexelRange(first, first + leafTexels, node.minHeight, node.maxHeight);
+				}
+				else
+				{
+					const std::vector<NodeBounds>& children = _bounds[level - 1];
+					int childrenPerSide = nodesPerSide * 2;
+					node.minHeight = FLT_MAX;
+					node.maxHeight = -FLT_MAX;
+					for (int child = 0; child < 4; child++)
+					{
+						const NodeBounds& c = children[(x * 2 + (child & 1)) + (y * 2 + (child >> 1)) * childrenPerSide];
+						node.minHeight = std::min(node.minHeight, c.minHeight);
+						node.maxHeight = std::max(node.maxHeight, c.maxHeight);
+					}
+				}
+			}
+		}
+	}
+}
+
+void TerrainLod::setScreenSpaceError(float projectionScale, float pixelError)
+{
+	//vertex spacing s at distance d covers s * projectionScale / d pixels
+	//	a level has to reach at least a node diagonal past the one below it, otherwise neighbouring patches
+	//	can be more than one level apart at large pixel errors and crack
+	for (int level = 0; level < _levelCount; level++)
+	{
+		float spacing = nodeSize(level) / (2 * PATCH_RESOLUTION);
+		_ranges[level] = spacing * projectionScale / std::max(pixelError, 0.01f);
+		if (level > 0)
+			_ranges[level] = std::max(_ranges[level], _ranges[level - 1] + nodeSize(level) * std::sqrt(2.f));
+	}
+	//the root is always selected
+	_ranges[_levelCount - 1] = FLT_MAX;
+}
+
+void TerrainLod::nodeAABB(int level, int x, int y, glm::vec3& min, glm::vec3& max) const
+{
+	int nodesPerSide = 1 << (_levelCount - 1 - level);
+	const NodeBounds& bounds = _bounds[level][x + y * nodesPerSide];
+	float size = nodeSize(level);
+	min = glm::vec3(_origin.x + x * size, bounds.minHeight, _origin.y + y * size);
+	max = glm::vec3(min.x + size, bounds.maxHeight, min.z + size);
+}
+
+int TerrainLod::select(glm::vec3 cameraPosition, const Frustum& frustum, std::vector<TerrainPatch>& patches) const
+{
+	size_t firstPatch = patches.size();
+	if (_levelCount > 0) selectNode(_levelCount - 1, 0, 0, cameraPosition, frustum, patches);
+	return (int)(patches.size() - firstPatch);
+}
+
+bool TerrainLod::selectNode(int level, int x, int y, glm::vec3 cameraPosition, const Frustum& frustum, std::vector<TerrainPatch>& patches) const
+{
+	glm::vec3 min, max;
+	nodeAABB(level, x, y, min, max);
+
+	//sphere around the camera against the node's box
+	glm::vec3 d = glm::max(glm::max(min - cameraPosition, cameraPosition - max), glm::vec3(0));
+	float distanceSq = d.x * d.x + d.y * d.y + d.z * d.z;
+	auto inRange = [&](int lodLevel) {
+		return _ranges[lodLevel] == FLT_MAX || distanceSq <= _ranges[lodLevel] * _ranges[lodLevel];
+		};
+
+	//too far for this level, the parent covers it
+	if (!inRange(level)) return false;
+	//culled, but handled
+	if (!frustum.intersectsAABB(min, max)) return true;
+
+	float size = nodeSize(level);
+	if (level == 0 || !inRange(level - 1))
+	{
+		addPatch(level, glm::vec2(min.x, min.z), size, patches);
+		return true;
+	}
+
+	//children that are out of their range are drawn as a quarter of this node
+	for (int child = 0; child < 4; child++)
+	{
+		int childX = x * 2 + (child & 1);
+		int childY = y * 2 + (child >> 1);
+		if (!selectNode(level - 1, childX, childY, cameraPosition, frustum, patches))
+		{
+			glm::vec2 childOrigin = glm::vec2(min.x, min.z) + glm::vec2((float)(child & 1), (float)(child >> 1)) * (size / 2);
+			addPatch(level, childOrigin, size / 2, patches);
+		}
+	}
+	return true;
+}
+
+void TerrainLod::addPatch(int level, glm::vec2 origin, float size, std::vector<TerrainPatch>& patches) const
+{
+	//morph into the next level towards the end of this level's range
+	float rangeEnd = _ranges[level];
+	float rangeStart = level > 0 ? _ranges[level - 1] : 0.f;
+	//	note: the root never morphs, keep the range finite so the shader does not divide by 0
+	glm::vec4 morph = rangeEnd == FLT_MAX ? glm::vec4(FLT_MAX / 2, FLT_MAX, 0, 0) : glm::vec4(glm::mix(rangeStart, rangeEnd, MORPH_START), rangeEnd, 0, 0);
+
+	//a node is 2x2 patches, a quarter node is a single patch
+	float patchSize = nodeSize(level) / 2;
+	for (float y = 0; y < size; y += patchSize)
+	{
+		for (float x = 0; x < size; x += patchSize)
+		{
+			patches.push_back(TerrainPatch{ glm::vec4(origin.x + x, origin.y + y, patchSize, level), morph });
+		}
+	}
+}
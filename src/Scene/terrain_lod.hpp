@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "../frustum.hpp"
+
+class TerrainHeightMap;
+
+//one instance of the shared patch mesh, must match TerrainPatch in terrain.vert
+struct TerrainPatch
+{
+	glm::vec4 data;		//xy = world origin (xz), z = size, w = lod level
+	glm::vec4 morph;	//x = distance where the patch starts morphing into the next level, y = where it is fully morphed
+						//z = shadow cascade the patch was selected for, set by the engine
+};
+
+//CDLOD quadtree over the heightmap, see Strugar - Continuous Distance-Dependent Level of Detail for Rendering Heightmaps
+//	every node is drawn as 2x2 patches of PATCH_RESOLUTION^2 quads, the vertex shader samples the heightmap
+//	and morphs the vertices into the next coarser grid towards the end of the node's lod range.
+//	the lod ranges follow a screen space error: a level is used as long as its vertex spacing projects to
+//	less than pixelError pixels. this is CPU only, the engine uploads the patches and draws them instanced.
+class TerrainLod
+{
+public:
+	static constexpr int PATCH_RESOLUTION = 16;	//quads per patch side, must match TERRAIN_PATCH_RESOLUTION in terrain.vert
+	static constexpr float MORPH_START = 0.7f;		//fraction of a level's range after which its vertices start morphing
+
+	//builds the min/max height quadtree, the root covers the whole heightmap
+	//	note: leaves read the heightmap's min/max pyramid, not its texels
+	void configure(const TerrainHeightMap& terrain, float leafNodeSize, int levelCount);
+
+	//projectionScale is the viewport height / (2 * tan(fov / 2)), pixelError the allowed vertex spacing in pixels
+	void setScreenSpaceError(float projectionScale, float pixelError);
+
+	//appends the patches of every node that is selected for the camera and intersects the frustum, returns number of patches
+	//	note: selection only depends on the camera, so every view (main and shadow cascades) gets matching geometry
+	int select(glm::vec3 cameraPosition, const Frustum& frustum, std::vector<TerrainPatch>& patches) const;
+
+	int levelCount() const { return _levelCount; }
+	float lodRange(int level) const { return _ranges[level]; }
+
+private:
+	struct NodeBounds
+	{
+		float minHeight;
+		float maxHeight;
+	};
+
+	//returns false if the node is out of range for its level, so the parent has to cover its area
+	bool selectNode(int level, int x, int y, glm::vec3 cameraPosition, const Frustum& frustum, std::vector<TerrainPatch>& patches) const;
+	void addPatch(int level, glm::vec2 origin, float size, std::vector<TerrainPatch>& patches) const;
+	float nodeSize(int level) const { return _leafNodeSize * (float)(1 << level); }
+	void nodeAABB(int level, int x, int y, glm::vec3& min, glm::vec3& max) const;
+
+	float _leafNodeSize = 16.f;
+	int _levelCount = 0;
+	glm::vec2 _origin = glm::vec2(0);		//world xz of the root's corner
+	std::vector<std::vector<NodeBounds>> _bounds;	//per level, (1 << (levelCount - 1 - level))^2 nodes
+	std::vector<float> _ranges;				//per level, distance up to which the level is used
+};
@@ -0,0 +1,105 @@
+#include "terrain_tile_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+void TerrainTileCache::configure(int tileCount, int tileSize, uint32_t layerCount, float radius)
+{
+	_tileCount = tileCount;
+	_tileSize = tileSize;
+	_radius = radius;
+
+	_layerTable.assign((size_t)tileCount * tileCount, -1);
+	_layerTiles.assign(layerCount, glm::ivec2(-1));
+	_freeLayers.clear();
+	for (uint32_t i = layerCount; i > 0; i--)
+	{
+		_freeLayers.push_back(OVERVIEW_LAYER + i);
+	}
+	_queue.clear();
+	_tableChanged = true;
+}
+
+float TerrainTileCache::distanceToTile(glm::ivec2 tile) const
+{
+	//tile 0 starts at the corner of the map, the map is centered on the world origin
+	glm::vec2 tileMin = glm::vec2(tile) * (float)_tileSize - (float)(_tileCount * _tileSize / 2);
+	glm::vec2 tileMax = tileMin + (float)_tileSize;
+	glm::vec2 closest = glm::clamp(_cameraPosition, tileMin, tileMax);
+	return glm::distance(closest, _cameraPosition);
+}
+
+void TerrainTileCache::update(glm::vec3 cameraPosition)
+{
+	_cameraPosition = glm::vec2(cameraPosition.x, cameraPosition.z);
+
+	_queue.clear();
+	glm::vec2 mapOrigin = glm::vec2(-(float)(_tileCount * _tileSize / 2));
+	glm::ivec2 minTile = glm::max(glm::ivec2(glm::floor((_cameraPosition - _radius - mapOrigin) / (float)_tileSize)), glm::ivec2(0));
+	glm::ivec2 maxTile = glm::min(glm::ivec2(glm::floor((_cameraPosition + _radius - mapOrigin) / (float)_tileSize)), glm::ivec2(_tileCount - 1));
+	for (int y = minTile.y; y <= maxTile.y; y++)
+	{
+		for (int x = minTile.x; x <= maxTile.x; x++)
+		{
+			glm::ivec2 tile(x, y);
+			if (_layerTable[x + y * _tileCount] < 0 && distanceToTile(tile) < _radius)
+				_queue.push_back(tile);
+		}
+	}
+
+	//nearest last, so takeUploads can pop them
+	std::sort(_queue.begin(), _queue.end(), [&](glm::ivec2 a, glm::ivec2 b) {
+		return distanceToTile(a) > distanceToTile(b);
+		});
+}
+
+std::vector<TerrainTileCache::Upload> TerrainTileCache::takeUploads(int maxCount)
+{
+	std::vector<Upload> uploads;
+	while (!_queue.empty() && (int)uploads.size() < maxCount)
+	{
+		glm::ivec2 tile = _queue.back();
+
+		if (_freeLayers.empty())
+		{
+			//cache is full, reuse the layer of the furthest tile that is outside the radius
+			int furthest = -1;
+			float furthestDistance = _radius;
+			for (int i = 0; i < (int)_layerTiles.size(); i++)
+			{
+				float distance = distanceToTile(_layerTiles[i]);
+				if (distance >= furthestDistance)
+				{
+					furthestDistance = distance;
+					furthest = i;
+				}
+			}
+			//	note: everything resident is in range, the remaining tiles keep using the overview
+			if (furthest < 0) break;
+
+			glm::ivec2 evicted = _layerTiles[furthest];
+			_layerTable[evicted.x + evicted.y * _tileCount] = -1;
+			_freeLayers.push_back(OVERVIEW_LAYER + 1 + furthest);
+		}
+
+		uint32_t layer = _freeLayers.back();
+		_freeLayers.pop_back();
+		_queue.pop_back();
+
+		_layerTiles[layer - OVERVIEW_LAYER - 1] = tile;
+		_layerTable[tile.x + tile.y * _tileCount] = (int32_t)layer;
+		_tableChanged = true;
+		uploads.push_back(Upload{ tile, layer });
+	}
+	return uploads;
+}
+
+bool TerrainTileCache::takeTableChanged()
+{
+	bool changed = _tableChanged;
+	_tableChanged = false;
+	return changed;
+}
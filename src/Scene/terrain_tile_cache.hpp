@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+//decides which tiles of the terrain file are resident in the GPU tile cache (a texture array).
+//	layer 0 always holds the overview, every other layer holds one tile. the layer table is the indirection
+//	the shaders read through (_terrainTiles.glsl), -1 for tiles that fall back to the overview.
+//	tiles stay resident until their layer is needed for a nearer tile.
+//	this is CPU only, the engine copies the tiles out of the terrain file and uploads the table.
+class TerrainTileCache
+{
+public:
+	static constexpr int OVERVIEW_LAYER = 0;
+
+	//a tile that has to be copied into its layer before the table is uploaded
+	struct Upload
+	{
+		glm::ivec2 tile;
+		uint32_t layer;
+	};
+
+	//clears the cache, layerCount is the number of tile layers after the overview
+	void configure(int tileCount, int tileSize, uint32_t layerCount, float radius);
+
+	//queues the tiles around the camera that are not resident yet, nearest first
+	void update(glm::vec3 cameraPosition);
+
+	//assigns layers to up to maxCount queued tiles, evicting the farthest tiles outside of the radius
+	std::vector<Upload> takeUploads(int maxCount);
+
+	//cache layer per tile, row major
+	const std::vector<int32_t>& layerTable() const { return _layerTable; }
+	//true if the table changed since the last call
+	bool takeTableChanged();
+
+	uint32_t layerCount() const { return (uint32_t)_layerTiles.size(); }
+	uint32_t residentCount() const { return layerCount() - (uint32_t)_freeLayers.size(); }
+	uint32_t queuedCount() const { return (uint32_t)_queue.size(); }
+
+private:
+	float distanceToTile(glm::ivec2 tile) const; //distance from camera to the tile rectangle on xz
+
+	int _tileCount = 0;
+	int _tileSize = 0;
+	float _radius = 0;
+	glm::vec2 _cameraPosition = glm::vec2(0);
+
+	std::vector<int32_t> _layerTable;
+	std::vector<glm::ivec2> _layerTiles;	//tile per layer, index is layer - 1
+	std::vector<uint32_t> _freeLayers;
+	std::vector<glm::ivec2> _queue;
+	bool _tableChanged = false;
+};
@@ -0,0 +1,223 @@
+#include "terrain_tile_file.hpp"
+#include "terrain_heightmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool TerrainTileFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	_file = file;
+	_mapping = mapping;
+	_fileSize = (size_t)fileSize.QuadPart;
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) return false;
+	struct stat fileInfo;
+	fstat(file, &fileInfo);
+	void* data = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_SHARED, file, 0);
+	if (data == MAP_FAILED) data = nullptr;
+	_file = file;
+	_fileSize = (size_t)fileInfo.st_size;
+#endif
+	_data = (const uint8_t*)data;
+
+	//the header has to match and the file has to hold the bounds, every tile and the overview
+	bool valid = _data && _fileSize >= sizeof(Header);
+	if (valid)
+	{
+		_header = *(const Header*)_data;
+		valid = _header.magic == MAGIC && _header.version == VERSION && _header.tileSize > 0 && _header.tileCount > 0 &&
+			_header.boundsBlockSize == BOUNDS_BLOCK_SIZE;
+	}
+	if (valid)
+	{
+		std::vector<int> blocksPerSide = boundsBlocksPerSide(mapSize());
+		valid = _header.boundsLevelCount == blocksPerSide.size();
+		size_t offset = sizeof(Header);
+		for (int blocks : blocksPerSide)
+		{
+			_boundsOffsets.push_back(offset);
+			offset += sizeof(HeightBounds) * blocks * blocks;
+		}
+		_tilesOffset = offset;
+		valid = valid && _fileSize >= _tilesOffset + tileBytes() * ((size_t)_header.tileCount * _header.tileCount + 1);
+	}
+	if (!valid) close();
+	return valid;
+}
+
+std::vector<int> TerrainTileFile::boundsBlocksPerSide(int mapSize)
+{
+	std::vector<int> levels = { (mapSize + BOUNDS_BLOCK_SIZE - 1) / BOUNDS_BLOCK_SIZE };
+	while (levels.back() > 1) levels.push_back((levels.back() + 1) / 2);
+	return levels;
+}
+
+void TerrainTileFile::close()
+{
+#ifdef _WIN32
+	if (_data) UnmapViewOfFile(_data);
+	if (_mapping) CloseHandle(_mapping);
+	if (_file) CloseHandle(_file);
+	_mapping = nullptr;
+	_file = nullptr;
+#else
+	if (_data) munmap((void*)_data, _fileSize);
+	if (_file >= 0) ::close(_file);
+	_file = -1;
+#endif
+	_data = nullptr;
+	_fileSize = 0;
+	_header = Header{};
+	_boundsOffsets.clear();
+	_tilesOffset = 0;
+}
+
+bool TerrainTileFile::write(const std::string& path, const TerrainHeightMap& terrain, int tileSize)
+{
+	int size = terrain.size();
+	if (tileSize <= 0 || size % tileSize != 0) return false;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) return false;
+
+	//the height range of the whole map becomes the unorm scale and bias, the top of the terrain's pyramid covers it
+	int levelCount = terrain.boundsLevelCount();
+	HeightBounds range = terrain.boundsLevel(levelCount - 1)[0];
+
+	Header header{ MAGIC, VERSION, (uint32_t)tileSize, (uint32_t)(size / tileSize), range.low, std::max(range.high - range.low, 1e-3f),
+		(uint32_t)BOUNDS_BLOCK_SIZE, (uint32_t)levelCount };
+	file.write((const char*)&header, sizeof(Header));
+
+	//the bounds of the stored heights, rounding is monotonic so quantizing the bounds gives the bounds of the quantized texels
+	auto quantize = [&](float height) {
+		float unorm = (height - header.heightBias) / header.heightScale;
+		uint16_t stored = (uint16_t)std::lround(std::clamp(unorm, 0.f, 1.f) * 65535.f);
+		return header.heightBias + stored / 65535.f * header.heightScale;
+		};
+	for (int level = 0; level < levelCount; level++)
+	{
+		std::vector<HeightBounds> blocks = terrain.boundsLevel(level);
+		for (HeightBounds& block : blocks)
+		{
+			block.low = quantize(block.low);
+			block.high = quantize(block.high);
+		}
+		file.write((const char*)blocks.data(), blocks.size() * sizeof(HeightBounds));
+	}
+
+	//	note: the shared column and row of the last tiles repeat the map edge, like a clamped sampler
+	int tileTexels = tileSize + 1;
+	size_t texelCount = (size_t)tileTexels * tileTexels;
+	std::vector<uint16_t> heights(texelCount);
+	std::vector<int8_t> normals(texelCount * 2);
+	auto writeTexels = [&](auto texelCoord) {
+		for (int y = 0; y < tileTexels; y++)
+		{
+			for (int x = 0; x < tileTexels; x++)
+			{
+				glm::ivec2 coord = glm::min(texelCoord(x, y), glm::ivec2(size - 1));
+				size_t i = (size_t)y * tileTexels + x;
+				float height = (terrain.texelHeight(coord.x, coord.y) - header.heightBias) / header.heightScale;
+				heights[i] = (uint16_t)std::lround(std::clamp(height, 0.f, 1.f) * 65535.f);
+				//terrain normals always point up, y is rebuilt from xz
+				glm::vec3 normal = terrain.texelNormal(coord.x, coord.y);
+				normals[i * 2 + 0] = (int8_t)std::lround(std::clamp(normal.x, -1.f, 1.f) * 127.f);
+				normals[i * 2 + 1] = (int8_t)std::lround(std::clamp(normal.z, -1.f, 1.f) * 127.f);
+			}
+		}
+		file.write((const char*)heights.data(), heights.size() * sizeof(uint16_t));
+		file.write((const char*)normals.data(), normals.size() * sizeof(int8_t));
+		};
+
+	for (int tileY = 0; tileY < (int)header.tileCount; tileY++)
+	{
+		for (int tileX = 0; tileX < (int)header.tileCount; tileX++)
+		{
+			writeTexels([=](int x, int y) { return glm::ivec2(tileX * tileSize + x, tileY * tileSize + y); });
+		}
+	}
+	writeTexels([=](int x, int y) { return glm::ivec2(x, y) * size / tileSize; });
+
+	return (bool)file;
+}
+
+const uint8_t* TerrainTileFile::tileTexels(int x, int y) const
+{
+	return _data + _tilesOffset + tileBytes() * ((size_t)y * _header.tileCount + x);
+}
+
+void TerrainTileFile::prefetchTile(int x, int y) const
+{
+	const uint8_t* texels = tileTexels(x, y);
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range{ (PVOID)texels, tileBytes() };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	//madvise wants page aligned ranges
+	uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t first = (uintptr_t)texels & ~(pageSize - 1);
+	madvise((void*)first, (uintptr_t)(texels + tileBytes()) - first, MADV_WILLNEED);
+#endif
+}
+
+const uint8_t* TerrainTileFile::overviewTexels() const
+{
+	return tileTexels(0, _header.tileCount);
+}
+
+const uint8_t* TerrainTileFile::texelTile(int x, int y, size_t& index) const
+{
+	int size = mapSize();
+	x = std::clamp(x, 0, size);
+	y = std::clamp(y, 0, size);
+	//texels on a tile edge are also the shared column or row of the previous tile, the last one only exists there
+	int tileX = std::min(x / (int)_header.tileSize, (int)_header.tileCount - 1);
+	int tileY = std::min(y / (int)_header.tileSize, (int)_header.tileCount - 1);
+	int localX = x - tileX * _header.tileSize;
+	int localY = y - tileY * _header.tileSize;
+	index = (size_t)localY * tileTexelSize() + localX;
+	return tileTexels(tileX, tileY);
+}
+
+float TerrainTileFile::texelHeight(int x, int y) const
+{
+	size_t index;
+	const uint16_t* heights = (const uint16_t*)texelTile(x, y, index);
+	return _header.heightBias + heights[index] / 65535.f * _header.heightScale;
+}
+
+glm::vec3 TerrainTileFile::texelNormal(int x, int y) const
+{
+	//same decode as the R8G8_SNORM fetch in _terrainTiles.glsl
+	size_t index;
+	const int8_t* normals = (const int8_t*)(texelTile(x, y, index) + tileHeightBytes());
+	float nx = std::max(normals[index * 2 + 0] / 127.f, -1.f);
+	float nz = std::max(normals[index * 2 + 1] / 127.f, -1.f);
+	return glm::vec3(nx, std::sqrt(std::max(1.f - nx * nx - nz * nz, 0.f)), nz);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+class TerrainHeightMap;
+
+//memory mapped terrain file, the source of every terrain texel on the CPU and the GPU
+//	the map is split into square tiles that are stored contiguously, so streaming a tile is a single copy.
+//	every tile has one extra column and row (the first texels of its neighbours) so it can be filtered on its own.
+//	a tile is its heights (16 bit unorm, scaled by the header height range) followed by its normals (xz as 8 bit snorm,
+//	y is reconstructed), the same formats as the two tile cache textures. 4 bytes per texel instead of 4 half floats.
+//	the header is followed by the height bounds, a min/max pyramid over the map, so nothing has to walk the texels at startup.
+//	after the tiles comes the overview, one tile sized grid over the whole map for everything that is not streamed in.
+//	note: only the touched pages are loaded by the OS, so the map can be larger than memory
+class TerrainTileFile
+{
+public:
+	static constexpr uint32_t MAGIC = 0x4c495454; //"TTIL"
+	static constexpr uint32_t VERSION = 3;
+	//texels per side of the finest block of the height bounds
+	static constexpr int BOUNDS_BLOCK_SIZE = 16;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t tileSize;		//texels per tile side, without the shared column and row
+		uint32_t tileCount;		//tiles per map side, maps are square
+		float heightBias;		//height = heightBias + unorm * heightScale
+		float heightScale;
+		uint32_t boundsBlockSize;	//BOUNDS_BLOCK_SIZE when the file was written
+		uint32_t boundsLevelCount;
+	};
+
+	//decoded heights of the texels in a block
+	//	block i of bounds level l covers texels i * (boundsBlockSize << l) up to and including the first texel of block i + 1
+	struct HeightBounds
+	{
+		float low;
+		float high;
+	};
+
+	//blocks per side of every bounds level of a map, level 0 has one block per BOUNDS_BLOCK_SIZE^2 texels
+	//	and every level halves the blocks per side until one block covers the map
+	static std::vector<int> boundsBlocksPerSide(int mapSize);
+
+	TerrainTileFile() = default;
+	~TerrainTileFile() { close(); }
+	TerrainTileFile(const TerrainTileFile&) = delete;
+	TerrainTileFile& operator=(const TerrainTileFile&) = delete;
+
+	//maps the file, returns false if it does not exist or is not a valid terrain file
+	bool open(const std::string& path);
+	void close();
+	bool isOpen() const { return _data != nullptr; }
+
+	//bakes a terrain file from a heightmap, its size has to be a multiple of tileSize
+	static bool write(const std::string& path, const TerrainHeightMap& terrain, int tileSize);
+
+	int tileSize() const { return _header.tileSize; }
+	int tileCount() const { return _header.tileCount; }
+	int mapSize() const { return _header.tileSize * _header.tileCount; }
+	//texels per tile side in the file and the tile cache
+	int tileTexelSize() const { return _header.tileSize + 1; }
+	size_t tileHeightBytes() const { return (size_t)tileTexelSize() * tileTexelSize() * sizeof(uint16_t); }
+	size_t tileNormalBytes() const { return (size_t)tileTexelSize() * tileTexelSize() * 2 * sizeof(int8_t); }
+	size_t tileBytes() const { return tileHeightBytes() + tileNormalBytes(); }
+	float heightBias() const { return _header.heightBias; }
+	float heightScale() const { return _header.heightScale; }
+
+	//heights then normals of tile (x, y), each row major from the lowest texel coordinate
+	const uint8_t* tileTexels(int x, int y) const;
+	//asks the OS to start reading the pages of tile (x, y), returns right away
+	void prefetchTile(int x, int y) const;
+	//overview sample (x, y) is map texel (x, y) * mapSize / tileSize
+	const uint8_t* overviewTexels() const;
+
+	int boundsLevelCount() const { return (int)_header.boundsLevelCount; }
+	//row major blocks of a bounds level, see boundsBlocksPerSide
+	const HeightBounds* boundsLevel(int level) const { return (const HeightBounds*)(_data + _boundsOffsets[level]); }
+
+	//texel of the whole map, clamped to 0..mapSize
+	float texelHeight(int x, int y) const;
+	glm::vec3 texelNormal(int x, int y) const;
+
+private:
+	//tile that holds the texel and the texel index inside of it
+	const uint8_t* texelTile(int x, int y, size_t& index) const;
+
+	Header _header{};
+	std::vector<size_t> _boundsOffsets;	//per level, from the start of the file
+	size_t _tilesOffset = 0;
+	const uint8_t* _data = nullptr;
+	size_t _fileSize = 0;
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#else
+	int _file = -1;
+#endif
+};
@@ -0,0 +1,78 @@
+#include "terrain_tile_streamer.hpp"
+#include "terrain_tile_file.hpp"
+
+#include <cstring>
+
+void TerrainTileStreamer::start(const TerrainTileFile& file)
+{
+	stop();
+	_file = &file;
+	_stopping = false;
+	_thread = std::thread(&TerrainTileStreamer::run, this);
+}
+
+void TerrainTileStreamer::stop()
+{
+	if (!_thread.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wake.notify_one();
+	_thread.join();
+	_queue.clear();
+	_finished.clear();
+	_prefetched = 0;
+	_busy = false;
+}
+
+void TerrainTileStreamer::request(const Request& request)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(request);
+	}
+	_wake.notify_one();
+}
+
+std::vector<TerrainTileStreamer::Request> TerrainTileStreamer::takeFinished()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::vector<Request> finished;
+	finished.swap(_finished);
+	return finished;
+}
+
+void TerrainTileStreamer::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idle.wait(lock, [this]() { return _queue.empty() && !_busy; });
+}
+
+void TerrainTileStreamer::run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_wake.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+		if (_stopping) return;
+
+		//read ahead everything that was queued since the last copy, the hints return before the pages are loaded
+		std::vector<glm::ivec2> prefetch;
+		for (size_t i = _prefetched; i < _queue.size(); i++) prefetch.push_back(_queue[i].tile);
+		Request request = _queue.front();
+		_queue.pop_front();
+		_prefetched = _queue.size();
+		_busy = true;
+		lock.unlock();
+
+		for (glm::ivec2 tile : prefetch) _file->prefetchTile(tile.x, tile.y);
+		//	note: this is where the thread waits for the disk, not the render thread
+		memcpy(request.destination, _file->tileTexels(request.tile.x, request.tile.y), _file->tileBytes());
+
+		lock.lock();
+		_finished.push_back(request);
+		_busy = false;
+		if (_queue.empty()) _idle.notify_all();
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/vec2.hpp>
+
+class TerrainTileFile;
+
+//copies tiles out of the memory mapped terrain file on a worker thread, so the render thread never waits for the file's pages
+//	the engine hands it a destination in a staging ring per tile and records the GPU copy once the tile is finished.
+//	before every copy the worker asks the OS to read all queued tiles ahead, so their pages load while it copies.
+class TerrainTileStreamer
+{
+public:
+	struct Request
+	{
+		glm::ivec2 tile;
+		uint32_t layer;			//cache layer the tile was assigned to when it was requested
+		uint32_t slot;			//staging ring slot
+		uint8_t* destination;	//tileBytes() of mapped staging memory
+	};
+
+	TerrainTileStreamer() = default;
+	~TerrainTileStreamer() { stop(); }
+	TerrainTileStreamer(const TerrainTileStreamer&) = delete;
+	TerrainTileStreamer& operator=(const TerrainTileStreamer&) = delete;
+
+	//the file has to stay open until stop
+	void start(const TerrainTileFile& file);
+	void stop();
+
+	//queues the copy, requests finish in the order they were made
+	void request(const Request& request);
+	//requests that finished since the last call
+	std::vector<Request> takeFinished();
+	//blocks until every queued request finished
+	void waitIdle();
+
+private:
+	void run();
+
+	const TerrainTileFile* _file = nullptr;
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _wake;		//a request was queued or the worker has to stop
+	std::condition_variable _idle;		//the queue ran empty
+	std::deque<Request> _queue;
+	std::vector<Request> _finished;
+	size_t _prefetched = 0;				//queued requests the OS was already asked to read ahead
+	bool _busy = false;					//the worker is copying a request that left the queue
+	bool _stopping = false;
+};
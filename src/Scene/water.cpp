@@ -23,9 +23,23 @@ void WaterMesh::init(VulkanEngine* engine)
 	initPipelines();
 	initMesh();
 
-	initButterflyTexture();
-	initNoiseTexture();
-	initSpectrumTextures();
+	//butterfly, noise and the initial spectra only depend on the generator shaders and the spectrum settings
+	//	note: the init shaders do not read the time they are pushed, so it is not part of the key
+	//		  only the first spectrum is read by water_initSpectrums.comp
+	AssetCache::Key key;
+	key.addFile("./shaders/scene/water/water_initButterfly.comp.spv")
+		.addFile("./shaders/scene/water/water_initNoise.comp.spv")
+		.addFile("./shaders/scene/water/water_initSpectrums.comp.spv")
+		.add(spectrumParams[0]).add((uint32_t)TEXTURE_SIZE);
+	engine->generateCachedImages("water", key, { &_butterflyImage, &_noiseImage, &_posSpectrumImage, &_negSpectrumImage },
+		[&](VkCommandBuffer cmd) {
+			initButterflyTexture(cmd);
+			initNoiseTexture(cmd);
+			//the spectra are built from the noise
+			vkutil::transitionImage(cmd, _noiseImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+			initSpectrumTextures(cmd);
+		}
+	);
 
 	engine->immediateSubmit(
 		[&](VkCommandBuffer cmd) {
@@ -61,6 +75,7 @@ void WaterMesh::initImages()
 	VkImageUsageFlags imageUsageFlags{};
 	imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;
 	imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageUsageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT; //noise goes through the asset cache
 
 	VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(_displacementImage.imageFormat, imageUsageFlags, imageExtent);
 
@@ -104,7 +119,7 @@ void WaterMesh::initImages()
 
 	_butterflyImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
 	_butterflyImage.imageExtent = imageExtent;
-	imageUsageFlags = VK_IMAGE_USAGE_STORAGE_BIT;
+	imageUsageFlags = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	imgInfo = vkinit::imageCreateInfo(_butterflyImage.imageFormat, imageUsageFlags, imageExtent);
 	vmaCreateImage(_engine->_allocator, &imgInfo, &imgAllocInfo, &_butterflyImage.image, &_butterflyImage.allocation, nullptr);
 	viewInfo = vkinit::imageViewCreateInfo(_butterflyImage.imageFormat, _butterflyImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -245,20 +260,8 @@ void WaterMesh::initDescriptors()
 	}
 }
 
-void WaterMesh::createComputePipeline(const std::string& path, VkDescriptorSetLayout* layouts, int layoutCount, VkPipelineLayout& pipelineLayout, VkPipeline& pipeline)
+void WaterMesh::createComputePipelineLayout(VkDescriptorSetLayout* layouts, int layoutCount, VkPipelineLayout& pipelineLayout)
 {
-	std::cerr << path << '\n';
-	std::cerr << layouts << '\n';
-	VkShaderModule shader;
-	if (!vkutil::loadShaderModule(path.c_str(), _engine->_device, &shader))
-	{
-		fmt::print("error when building water compute shader module\n");
-	}
-	else
-	{
-		fmt::print("water compute shader loaded\n");
-	}
-
 	VkPushConstantRange computeBufferRange{};
 	computeBufferRange.offset = 0;
 	computeBufferRange.size = sizeof(ComputePushConstants);
@@ -267,30 +270,49 @@ void WaterMesh::createComputePipeline(const std::string& path, VkDescriptorSetLa
 	VkPipelineLayoutCreateInfo computePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
 	computePipelineLayoutInfo.pPushConstantRanges = &computeBufferRange;
 	computePipelineLayoutInfo.pushConstantRangeCount = 1;
-
-	VkPipelineShaderStageCreateInfo stageInfo{};
-	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	stageInfo.pNext = nullptr;
-	stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	stageInfo.module = shader;
-	stageInfo.pName = "main"; //name of entrypoint function
-
-	VkComputePipelineCreateInfo computePipelineCreateInfo{};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineCreateInfo.pNext = nullptr;
 	computePipelineLayoutInfo.setLayoutCount = layoutCount;
 	computePipelineLayoutInfo.pSetLayouts = layouts;
 
 	VK_CHECK(vkCreatePipelineLayout(_engine->_device, &computePipelineLayoutInfo, nullptr, &pipelineLayout));
+}
 
-	computePipelineCreateInfo.layout = pipelineLayout;
-	computePipelineCreateInfo.stage = stageInfo;
-
-	VK_CHECK(vkCreateComputePipelines(_engine->_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+VkShaderModule WaterMesh::loadComputeShader(const std::string& path)
+{
+	std::cerr << path << '\n';
+	VkShaderModule shader;
+	if (!vkutil::loadShaderModule(path.c_str(), _engine->_device, &shader))
+	{
+		fmt::print("error when building water compute shader module\n");
+	}
+	else
+	{
+		fmt::print("water compute shader loaded\n");
+	}
+	return shader;
+}
 
+void WaterMesh::createComputePipeline(const std::string& path, VkDescriptorSetLayout* layouts, int layoutCount, VkPipelineLayout& pipelineLayout, VkPipeline& pipeline)
+{
+	VkShaderModule shader = loadComputeShader(path);
+	createComputePipelineLayout(layouts, layoutCount, pipelineLayout);
+	pipeline = vkutil::buildComputePipeline(_engine->_device, pipelineLayout, shader);
 	vkDestroyShaderModule(_engine->_device, shader, nullptr);
 }
 
+void WaterMesh::createTunedComputePipeline(const std::string& path, VkDescriptorSetLayout* layouts, int layoutCount, VkPipelineLayout& pipelineLayout, vkutil::PipelinePermutations<WorkgroupSize>& pipelines)
+{
+	//	note: the module is kept, every workgroup size the tuner tries builds its own pipeline
+	VkShaderModule shader = loadComputeShader(path);
+	_tunedShaders.push_back(shader);
+	createComputePipelineLayout(layouts, layoutCount, pipelineLayout);
+	VkDevice device = _engine->_device;
+	pipelines.init([=](const WorkgroupSize& size) {
+		vkutil::SpecializationConstants constants;
+		size.specialize(constants);
+		return vkutil::buildComputePipeline(device, pipelineLayout, shader, constants.info());
+	});
+}
+
 float JonswapAlpha(float g, float fetch, float windSpeed)
 {
 	return 0.076f * std::pow(g * fetch / windSpeed / windSpeed, -0.22f);
@@ -312,6 +334,8 @@ void WaterMesh::initSettings()
 	settings[0].peakEnhancement = 5;
 	settings[0].spreadBlend = 1;
 	settings[0].swell = 1;
+	//	note: the second spectrum is uploaded but not read by the shaders yet, it mirrors the first
+	settings[1] = settings[0];
 	for (int i = 0; i <= 1; i++)
 	{
 		spectrumParams[i].scale = settings[i].scale;
@@ -359,14 +383,21 @@ void WaterMesh::initPipelines()
 	createComputePipeline("./shaders/scene/water/water_initButterfly.comp.spv", layouts.data(), layouts.size(), _initButterflyPipelineLayout, _initButterflyPipeline);
 	createComputePipeline("./shaders/scene/water/water_initNoise.comp.spv", layouts.data(), layouts.size(), _initNoisePipelineLayout, _initNoisePipeline);
 	createComputePipeline("./shaders/scene/water/water_initSpectrums.comp.spv", layouts.data(), layouts.size(), _initSpectrumPipelineLayout, _initSpectrumPipeline);
+	//the passes of every step share one workgroup size, the tuner times the whole step
+	_stepKernel = _engine->_workgroupTuner.addKernel("water_step", {
+		"./shaders/scene/water/water_fourierPass.comp.spv",
+		"./shaders/scene/water/water_horizontalPass.comp.spv",
+		"./shaders/scene/water/water_verticalPass.comp.spv",
+		"./shaders/scene/water/water_inversionPass.comp.spv",
+		"./shaders/scene/water/water_copyResults.comp.spv" }, { 16, 16 });
 	layouts = { _computeResourceDescriptorLayout, _fourierDescriptorLayout };
-	createComputePipeline("./shaders/scene/water/water_fourierPass.comp.spv", layouts.data(), layouts.size(), _fourierPassPipelineLayout, _fourierPassPipeline);
+	createTunedComputePipeline("./shaders/scene/water/water_fourierPass.comp.spv", layouts.data(), layouts.size(), _fourierPassPipelineLayout, _fourierPassPipelines);
 	layouts = { _computeResourceDescriptorLayout, _ifft2DDescriptorLayout };
-	createComputePipeline("./shaders/scene/water/water_horizontalPass.comp.spv", layouts.data(), layouts.size(), _horizontalPassPipelineLayout, _horizontalPassPipeline);
-	createComputePipeline("./shaders/scene/water/water_verticalPass.comp.spv", layouts.data(), layouts.size(), _verticalPassPipelineLayout, _verticalPassPipeline);
-	createComputePipeline("./shaders/scene/water/water_inversionPass.comp.spv", layouts.data(), layouts.size(), _inversionPassPipelineLayout, _inversionPassPipeline);
+	createTunedComputePipeline("./shaders/scene/water/water_horizontalPass.comp.spv", layouts.data(), layouts.size(), _horizontalPassPipelineLayout, _horizontalPassPipelines);
+	createTunedComputePipeline("./shaders/scene/water/water_verticalPass.comp.spv", layouts.data(), layouts.size(), _verticalPassPipelineLayout, _verticalPassPipelines);
+	createTunedComputePipeline("./shaders/scene/water/water_inversionPass.comp.spv", layouts.data(), layouts.size(), _inversionPassPipelineLayout, _inversionPassPipelines);
 	layouts = { _fourierDescriptorLayout, _waterDataDescriptorLayout };
-	createComputePipeline("./shaders/scene/water/water_copyResults.comp.spv", layouts.data(), layouts.size(), _copyPassPipelineLayout, _copyPassPipeline);
+	createTunedComputePipeline("./shaders/scene/water/water_copyResults.comp.spv", layouts.data(), layouts.size(), _copyPassPipelineLayout, _copyPassPipelines);
 
 	VkShaderModule fragmentShader;
 	if (!vkutil::loadShaderModule("./shaders/scene/water/water.frag.spv", _engine->_device, &fragmentShader))
@@ -678,78 +709,72 @@ void WaterMesh::cleanup()
 	vkDestroyPipelineLayout(_engine->_device, _initSpectrumPipelineLayout, nullptr);
 	vkDestroyPipeline(_engine->_device, _initSpectrumPipeline, nullptr);
 	vkDestroyPipelineLayout(_engine->_device, _fourierPassPipelineLayout, nullptr);
-	vkDestroyPipeline(_engine->_device, _fourierPassPipeline, nullptr);
+	_fourierPassPipelines.destroy(_engine->_device);
 	vkDestroyPipelineLayout(_engine->_device, _horizontalPassPipelineLayout, nullptr);
-	vkDestroyPipeline(_engine->_device, _horizontalPassPipeline, nullptr);
+	_horizontalPassPipelines.destroy(_engine->_device);
 	vkDestroyPipelineLayout(_engine->_device, _verticalPassPipelineLayout, nullptr);
-	vkDestroyPipeline(_engine->_device, _verticalPassPipeline, nullptr);
+	_verticalPassPipelines.destroy(_engine->_device);
 	vkDestroyPipelineLayout(_engine->_device, _inversionPassPipelineLayout, nullptr);
-	vkDestroyPipeline(_engine->_device, _inversionPassPipeline, nullptr);
+	_inversionPassPipelines.destroy(_engine->_device);
 	vkDestroyPipelineLayout(_engine->_device, _copyPassPipelineLayout, nullptr);
-	vkDestroyPipeline(_engine->_device, _copyPassPipeline, nullptr);
+	_copyPassPipelines.destroy(_engine->_device);
+	for (VkShaderModule shader : _tunedShaders)
+		vkDestroyShaderModule(_engine->_device, shader, nullptr);
 
 	_engine->destroyBuffer(_waterMesh->meshBuffers.vertexBuffer);
 	_engine->destroyBuffer(_waterMesh->meshBuffers.indexBuffer);
 	_engine->destroyBuffer(_spectrumParamsBuffer);
 }
 
-void WaterMesh::initButterflyTexture()
+void WaterMesh::initButterflyTexture(VkCommandBuffer cmd)
 {
 	ComputePushConstants pushConstants;
 	pushConstants.data1 = glm::vec4(_engine->_time, 1, 1, 1);
-	_engine->immediateSubmit(
-		[&](VkCommandBuffer cmd) {
-			vkutil::transitionImage(cmd, _butterflyImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initButterflyPipeline);
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initButterflyPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
-			vkCmdPushConstants(cmd, _initButterflyPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-			vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
-		}
-	);
+
+	vkutil::transitionImage(cmd, _butterflyImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initButterflyPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initButterflyPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
+	vkCmdPushConstants(cmd, _initButterflyPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+	vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
 }
 
-void WaterMesh::initNoiseTexture()
+void WaterMesh::initNoiseTexture(VkCommandBuffer cmd)
 {
 	ComputePushConstants pushConstants;
 	pushConstants.data1 = glm::vec4(_engine->_time, 1, 1, 1);
 
-	_engine->immediateSubmit(
-		[&](VkCommandBuffer cmd) {
-			vkutil::transitionImage(cmd, _noiseImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initNoisePipeline);
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initNoisePipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
-			vkCmdPushConstants(cmd, _initNoisePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-			vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
-		}
-	);
+	vkutil::transitionImage(cmd, _noiseImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initNoisePipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initNoisePipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
+	vkCmdPushConstants(cmd, _initNoisePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+	vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
 }
 
-void WaterMesh::initSpectrumTextures()
+void WaterMesh::initSpectrumTextures(VkCommandBuffer cmd)
 {
 	ComputePushConstants pushConstants;
 	pushConstants.data1 = glm::vec4(_engine->_time, 1, 1, 1);
 	pushConstants.data2 = glm::vec4(500, 1, 1, 1);
 
-	_engine->immediateSubmit(
-		[&](VkCommandBuffer cmd) {
-			vkutil::transitionImage(cmd, _posSpectrumImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-			vkutil::transitionImage(cmd, _negSpectrumImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initSpectrumPipeline);
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initSpectrumPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
-			vkCmdPushConstants(cmd, _initSpectrumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-			vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
-		}
-	);
+	vkutil::transitionImage(cmd, _posSpectrumImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	vkutil::transitionImage(cmd, _negSpectrumImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initSpectrumPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _initSpectrumPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
+	vkCmdPushConstants(cmd, _initSpectrumPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+	vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
 }
 
 void WaterMesh::step(VkCommandBuffer cmd)
 {
+	_stepSize = _engine->_workgroupTuner.size(_stepKernel);
+	_engine->_workgroupTuner.beginTiming(cmd, _stepKernel);
 	fourierPass(cmd);
 	ifft2D(cmd, _fourierDx_DzImage);
 	ifft2D(cmd, _fourierDy_DxdzImage);
 	ifft2D(cmd, _fourierDxdx_DzdzImage);
 	ifft2D(cmd, _fourierDydx_DydzImage);
 	copyToResultTextures(cmd);
+	_engine->_workgroupTuner.endTiming(cmd, _stepKernel);
 }
 
 void WaterMesh::fourierPass(VkCommandBuffer cmd)
@@ -763,11 +788,11 @@ void WaterMesh::fourierPass(VkCommandBuffer cmd)
 	vkutil::transitionImage(cmd, _fourierDy_DxdzImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 	vkutil::transitionImage(cmd, _fourierDxdx_DzdzImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 	vkutil::transitionImage(cmd, _fourierDydx_DydzImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _fourierPassPipeline);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _fourierPassPipelines.get(_stepSize));
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _fourierPassPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _fourierPassPipelineLayout, 1, 1, &_fourierDescriptorSet, 0, nullptr);
 	vkCmdPushConstants(cmd, _fourierPassPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-	vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
+	vkCmdDispatch(cmd, _stepSize.groupsX(TEXTURE_SIZE), _stepSize.groupsY(TEXTURE_SIZE), 1);
 }
 
 void WaterMesh::ifft2D(VkCommandBuffer cmd, AllocatedImage& initialTexture)
@@ -787,7 +812,7 @@ void WaterMesh::ifft2D(VkCommandBuffer cmd, AllocatedImage& initialTexture)
 		writer.updateSet(_engine->_device, _ifft2DDescriptorSet);
 	}
 
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _horizontalPassPipeline);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _horizontalPassPipelines.get(_stepSize));
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _horizontalPassPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _horizontalPassPipelineLayout, 1, 1, &_ifft2DDescriptorSet, 0, nullptr);
 
@@ -795,13 +820,13 @@ void WaterMesh::ifft2D(VkCommandBuffer cmd, AllocatedImage& initialTexture)
 	{
 		pushConstants.data2 = glm::vec4(pingpong? 1 : 0, i, 0,0);
 		vkCmdPushConstants(cmd, _horizontalPassPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-		vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
+		vkCmdDispatch(cmd, _stepSize.groupsX(TEXTURE_SIZE), _stepSize.groupsY(TEXTURE_SIZE), 1);
 
 		vkutil::transitionImage(cmd, initialTexture.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
 		vkutil::transitionImage(cmd, _pingpongImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL); 
 		pingpong = !pingpong;
 	}
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _verticalPassPipeline);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _verticalPassPipelines.get(_stepSize));
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _verticalPassPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _verticalPassPipelineLayout, 1, 1, &_ifft2DDescriptorSet, 0, nullptr);
 
@@ -809,20 +834,20 @@ void WaterMesh::ifft2D(VkCommandBuffer cmd, AllocatedImage& initialTexture)
 	{
 		pushConstants.data2 = glm::vec4(pingpong ? 1 : 0, i, 0, 0);
 		vkCmdPushConstants(cmd, _verticalPassPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-		vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
+		vkCmdDispatch(cmd, _stepSize.groupsX(TEXTURE_SIZE), _stepSize.groupsY(TEXTURE_SIZE), 1);
 
 		vkutil::transitionImage(cmd, initialTexture.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
 		vkutil::transitionImage(cmd, _pingpongImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
 		pingpong = !pingpong;
 	}
 
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _inversionPassPipeline);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _inversionPassPipelines.get(_stepSize));
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _inversionPassPipelineLayout, 0, 1, &_computeResourceDescriptorSet, 0, nullptr);
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _inversionPassPipelineLayout, 1, 1, &_ifft2DDescriptorSet, 0, nullptr);
 	pushConstants.data1 = glm::vec4(_engine->_time, 0, 0, 0);
 	pushConstants.data2 = glm::vec4(pingpong ? 1 : 0, 0, 0, 0);
 	vkCmdPushConstants(cmd, _inversionPassPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-	vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
+	vkCmdDispatch(cmd, _stepSize.groupsX(TEXTURE_SIZE), _stepSize.groupsY(TEXTURE_SIZE), 1);
 }
 
 void WaterMesh::copyToResultTextures(VkCommandBuffer cmd)
@@ -839,11 +864,11 @@ void WaterMesh::copyToResultTextures(VkCommandBuffer cmd)
 	pushConstants.data1 = glm::vec4(_engine->_time, 0, 0, 0);
 	pushConstants.data2 = glm::vec4(1, 0, 0, 0);
 
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _copyPassPipeline);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _copyPassPipelines.get(_stepSize));
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _copyPassPipelineLayout, 0, 1, &_fourierDescriptorSet, 0, nullptr);
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _copyPassPipelineLayout, 1, 1, &_waterDataDescriptorSet, 0, nullptr);
 	vkCmdPushConstants(cmd, _copyPassPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-	vkCmdDispatch(cmd, std::ceil(TEXTURE_SIZE / 8), std::ceil(TEXTURE_SIZE / 8), 1);
+	vkCmdDispatch(cmd, _stepSize.groupsX(TEXTURE_SIZE), _stepSize.groupsY(TEXTURE_SIZE), 1);
 
 	vkutil::transitionImage(cmd, _displacementImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	vkutil::transitionImage(cmd, _derivativesImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -3,6 +3,7 @@
 #include "../vk_types.hpp"
 #include "../vk_loader.hpp"
 #include "../vk_descriptors.hpp"
+#include "../workgroup_tuner.hpp"
 
 
 class WaterMesh
@@ -23,7 +24,7 @@ public:
 	static const unsigned int MESH_SIZE = 120;
 	static const unsigned int MESH_QUALITY = 4;
 
-	DisplaySettings settings[2];
+	DisplaySettings settings[2]{};
 
 	void update(VkCommandBuffer cmd);
 	void init(VulkanEngine* engine);
@@ -45,7 +46,11 @@ private:
 	SpectrumSettings spectrumParams[2];
 
 	VulkanEngine* _engine;
+	void createComputePipelineLayout(VkDescriptorSetLayout* layouts, int layoutCount, VkPipelineLayout& pipelineLayout);
+	VkShaderModule loadComputeShader(const std::string& path);
 	void createComputePipeline(const std::string& path, VkDescriptorSetLayout* layouts, int layoutCount, VkPipelineLayout& pipelineLayout, VkPipeline& pipeline);
+	//one pipeline per workgroup size, for the passes of step
+	void createTunedComputePipeline(const std::string& path, VkDescriptorSetLayout* layouts, int layoutCount, VkPipelineLayout& pipelineLayout, vkutil::PipelinePermutations<WorkgroupSize>& pipelines);
 	void initSettings();
 	void initSampler();
 	void initImages();
@@ -85,15 +90,18 @@ private:
 	VkPipelineLayout _initSpectrumPipelineLayout;
 	VkPipeline _initSpectrumPipeline;
 	VkPipelineLayout _fourierPassPipelineLayout;
-	VkPipeline _fourierPassPipeline;
+	vkutil::PipelinePermutations<WorkgroupSize> _fourierPassPipelines;
 	VkPipelineLayout _horizontalPassPipelineLayout;
-	VkPipeline _horizontalPassPipeline;
+	vkutil::PipelinePermutations<WorkgroupSize> _horizontalPassPipelines;
 	VkPipelineLayout _verticalPassPipelineLayout;
-	VkPipeline _verticalPassPipeline;
+	vkutil::PipelinePermutations<WorkgroupSize> _verticalPassPipelines;
 	VkPipelineLayout _inversionPassPipelineLayout;
-	VkPipeline _inversionPassPipeline;
+	vkutil::PipelinePermutations<WorkgroupSize> _inversionPassPipelines;
 	VkPipelineLayout _copyPassPipelineLayout;
-	VkPipeline _copyPassPipeline;
+	vkutil::PipelinePermutations<WorkgroupSize> _copyPassPipelines;
+	std::vector<VkShaderModule> _tunedShaders;
+	int _stepKernel;
+	WorkgroupSize _stepSize; //of the step being recorded
 
 
 	std::shared_ptr<MeshAsset> _waterMesh;
@@ -101,9 +109,10 @@ private:
 	VkPipeline _waterPipeline;
 
 
-	void initButterflyTexture();
-	void initNoiseTexture();
-	void initSpectrumTextures();
+	//generators of the static textures, recorded into one submit that goes through the asset cache
+	void initButterflyTexture(VkCommandBuffer cmd);
+	void initNoiseTexture(VkCommandBuffer cmd);
+	void initSpectrumTextures(VkCommandBuffer cmd);
 
 	void step(VkCommandBuffer cmd);
 	void fourierPass(VkCommandBuffer cmd);
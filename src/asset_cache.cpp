@@ -0,0 +1,61 @@
+#include "asset_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/core.h>
+
+AssetCache::Key& AssetCache::Key::add(const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		_hash ^= bytes[i];
+		_hash *= 1099511628211ull;
+	}
+	return *this;
+}
+
+AssetCache::Key& AssetCache::Key::addFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	//	note: the size goes in as well, so moving bytes between two hashed files changes the key
+	add(contents.size());
+	return add(contents.data(), contents.size());
+}
+
+std::string AssetCache::path(const std::string& name, const Key& key) const
+{
+	return fmt::format("{}/{}-{:016x}.bin", _directory, name, key.value());
+}
+
+void AssetCache::evict(const std::string& name) const
+{
+	std::error_code error;
+	std::filesystem::create_directories(_directory, error);
+	for (const auto& entry : std::filesystem::directory_iterator(_directory, error))
+	{
+		std::string fileName = entry.path().filename().string();
+		if (fileName.size() == name.size() + 21 && fileName.rfind(name + "-", 0) == 0)
+			std::filesystem::remove(entry.path(), error);
+	}
+}
+
+bool AssetCache::load(const std::string& name, const Key& key, std::vector<uint8_t>& data) const
+{
+	std::ifstream file(path(name, key), std::ios::binary | std::ios::ate);
+	if (!file) return false;
+
+	data.resize((size_t)file.tellg());
+	file.seekg(0);
+	return (bool)file.read((char*)data.data(), data.size());
+}
+
+void AssetCache::store(const std::string& name, const Key& key, const void* data, size_t size) const
+{
+	evict(name);
+	std::ofstream file(path(name, key), std::ios::binary | std::ios::trunc);
+	file.write((const char*)data, size);
+	if (!file) fmt::print("error when writing {} to the asset cache\n", name);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//on disk cache for data that is generated at startup (noise volumes, spectra, the default terrain, ...)
+//	every entry is keyed by a content hash of everything it is generated from: the generator parameters and
+//	the SPIR-V of the shaders that generate it. a stale entry is simply a miss and gets overwritten,
+//	so there is only ever one file per asset name.
+class AssetCache
+{
+public:
+	//FNV-1a over everything an asset is generated from
+	class Key
+	{
+	public:
+		Key& add(const void* data, size_t size);
+		template<typename T>
+		Key& add(const T& value) { return add(&value, sizeof(T)); }
+		Key& add(const std::string& text) { return add(text.data(), text.size()); }
+		//hashes the file contents, a missing file hashes as empty
+		Key& addFile(const std::string& path);
+
+		uint64_t value() const { return _hash; }
+
+	private:
+		uint64_t _hash = 14695981039346656037ull;
+	};
+
+	explicit AssetCache(const std::string& directory) : _directory(directory) {}
+
+	//path of the entry, for assets that are written by their own code (memory mapped files)
+	std::string path(const std::string& name, const Key& key) const;
+	//removes the stale entries of an asset, call before writing to path()
+	void evict(const std::string& name) const;
+
+	//returns false on a miss
+	bool load(const std::string& name, const Key& key, std::vector<uint8_t>& data) const;
+	void store(const std::string& name, const Key& key, const void* data, size_t size) const;
+
+private:
+	std::string _directory;
+};
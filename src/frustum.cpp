@@ -0,0 +1,33 @@
+#include "frustum.hpp"
+
+#include <glm/matrix.hpp>
+
+Frustum::Frustum(const glm::mat4& viewProj)
+{
+	//rows of the matrix, glm is column major
+	glm::mat4 m = glm::transpose(viewProj);
+
+	planes[PLANE_LEFT] = m[3] + m[0];
+	planes[PLANE_RIGHT] = m[3] - m[0];
+	planes[PLANE_BOTTOM] = m[3] + m[1];
+	planes[PLANE_TOP] = m[3] - m[1];
+	//	note: depth is 0..1 (GLM_FORCE_DEPTH_ZERO_TO_ONE), so near plane is just z >= 0
+	planes[PLANE_NEAR] = m[2];
+	planes[PLANE_FAR] = m[3] - m[2];
+}
+
+bool Frustum::intersectsAABB(const glm::vec3& min, const glm::vec3& max) const
+{
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		//test the corner furthest along the plane normal
+		glm::vec3 p(
+			planes[i].x >= 0 ? max.x : min.x,
+			planes[i].y >= 0 ? max.y : min.y,
+			planes[i].z >= 0 ? max.z : min.z);
+
+		if (planes[i].x * p.x + planes[i].y * p.y + planes[i].z * p.z + planes[i].w < 0)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+//view frustum as 6 planes, extracted from a viewProj matrix
+//	note: planes are not normalized, which is fine for sign tests against AABBs
+struct Frustum
+{
+	enum Plane { PLANE_LEFT = 0, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, PLANE_COUNT };
+
+	glm::vec4 planes[PLANE_COUNT];
+
+	Frustum() = default;
+	Frustum(const glm::mat4& viewProj);
+
+	//returns false only if the box is fully outside one of the planes
+	bool intersectsAABB(const glm::vec3& min, const glm::vec3& max) const;
+};
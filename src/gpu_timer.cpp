@@ -0,0 +1,83 @@
+#include "gpu_timer.hpp"
+
+#include <cassert>
+
+void GpuTimer::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t frameCount)
+{
+	_device = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	_timestampPeriod = properties.limits.timestampPeriod;
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+	if (queueFamily < familyCount && families[queueFamily].timestampValidBits > 0)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = frameCount * MAX_REGIONS * 2;
+		VK_CHECK(vkCreateQueryPool(_device, &queryPoolInfo, nullptr, &_queryPool));
+	}
+	else
+		fmt::print("no timestamps on the graphics queue, gpu timings are not available\n");
+
+	std::array<bool, MAX_REGIONS> unrecorded;
+	unrecorded.fill(false);
+	_recorded.assign(frameCount, unrecorded);
+}
+
+void GpuTimer::cleanup()
+{
+	if (_queryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(_device, _queryPool, nullptr);
+	_queryPool = VK_NULL_HANDLE;
+}
+
+int GpuTimer::addRegion(const std::string& name)
+{
+	assert(_regions.size() < MAX_REGIONS && "too many gpu timer regions");
+	Region region;
+	region.name = name;
+	_regions.push_back(region);
+	return (int)_regions.size() - 1;
+}
+
+void GpuTimer::beginFrame(VkCommandBuffer cmd, uint32_t frameSlot)
+{
+	_frameSlot = frameSlot;
+	if (_queryPool == VK_NULL_HANDLE) return;
+
+	std::array<bool, MAX_REGIONS>& recorded = _recorded[frameSlot];
+	for (int i = 0; i < (int)_regions.size(); i++)
+	{
+		_regions[i].lastTime = -1;
+		if (!recorded[i]) continue;
+
+		//timestamp and availability of the begin and the end
+		uint64_t results[4];
+		VkResult result = vkGetQueryPoolResults(_device, _queryPool, firstQuery(frameSlot, i), 2, sizeof(results), results, 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (result == VK_SUCCESS && results[1] != 0 && results[3] != 0 && results[2] >= results[0])
+			_regions[i].lastTime = (results[2] - results[0]) * _timestampPeriod / 1000000.f;
+	}
+	recorded.fill(false);
+
+	vkCmdResetQueryPool(cmd, _queryPool, firstQuery(frameSlot, 0), MAX_REGIONS * 2);
+}
+
+void GpuTimer::begin(VkCommandBuffer cmd, int region)
+{
+	if (_queryPool == VK_NULL_HANDLE) return;
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _queryPool, firstQuery(_frameSlot, region));
+	_recorded[_frameSlot][region] = true;
+}
+
+void GpuTimer::end(VkCommandBuffer cmd, int region)
+{
+	if (_queryPool == VK_NULL_HANDLE || !_recorded[_frameSlot][region]) return;
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _queryPool, firstQuery(_frameSlot, region) + 1);
+}
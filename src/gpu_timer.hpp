@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vk_types.hpp"
+
+//measures named regions of the frame's command buffer with timestamp queries
+//	the results of a frame are read back when its frame slot comes around again, so they lag FRAME_OVERLAP frames behind
+class GpuTimer
+{
+public:
+	static constexpr int MAX_REGIONS = 16;
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t frameCount);
+	void cleanup();
+
+	int addRegion(const std::string& name);
+
+	//reads back the timings of the last frame that used this slot, call after its fence was waited on
+	void beginFrame(VkCommandBuffer cmd, uint32_t frameSlot);
+	//brackets a region, at most once per region and frame
+	void begin(VkCommandBuffer cmd, int region);
+	void end(VkCommandBuffer cmd, int region);
+
+	//milliseconds the region took in the frame read back by the last beginFrame, negative if it was not recorded there
+	float lastTime(int region) const { return _regions[region].lastTime; }
+	const std::string& name(int region) const { return _regions[region].name; }
+	bool supported() const { return _queryPool != VK_NULL_HANDLE; }
+
+private:
+	struct Region
+	{
+		std::string name;
+		float lastTime = -1;
+	};
+
+	uint32_t firstQuery(uint32_t frameSlot, int region) const { return (frameSlot * MAX_REGIONS + region) * 2; }
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VkQueryPool _queryPool = VK_NULL_HANDLE; //null if the queue can not write timestamps
+	float _timestampPeriod = 1; //nanoseconds per tick
+	std::vector<Region> _regions;
+	uint32_t _frameSlot = 0;
+	std::vector<std::array<bool, MAX_REGIONS>> _recorded; //per frame slot and region
+};
@@ -1,9 +1,12 @@
 #include "player.hpp"
+#include "Scene/terrain_heightmap.hpp"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <algorithm>
+
 glm::mat4 Player::getViewMatrix()
 {
     glm::mat4 cameraTranslation = glm::translate(glm::mat4(1.f), _position);
@@ -91,6 +94,7 @@ void Player::processSDLEvent(SDL_Event& e, float deltaTime)
 void Player::update(float deltaTime)
 {
     move(deltaTime);
+    handleCollisions();
 }
 
 void Player::move(float deltaTime)
@@ -105,5 +109,13 @@ void Player::move(float deltaTime)
 
 void Player::handleCollisions()
 {
+    if (!_terrain || !_terrain->isBuilt()) return;
 
+    //keep the camera above the ground
+    float groundHeight = _terrain->getHeight(_position.x, _position.z) + _eyeHeight;
+    if (_position.y < groundHeight)
+    {
+        _position.y = groundHeight;
+        _velocity.y = std::max(_velocity.y, 0.f);
+    }
 }
@@ -5,6 +5,7 @@
 
 #include <SDL/SDL_events.h>
 
+class TerrainHeightMap;
 
 class Player
 {
@@ -14,6 +15,9 @@ public:
 
 	float _sensitivity = 1.f;
 	float _movementSpeed = 10.f;
+	float _eyeHeight = 1.7f; //camera never gets closer to the ground than this
+
+	const TerrainHeightMap* _terrain = nullptr;
 
 	glm::mat4 getViewMatrix();
 	glm::mat4 getRotationMatrix();
@@ -0,0 +1,98 @@
+#include "poisson.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <glm/vec2.hpp>
+#include <glm/common.hpp>
+
+
+std::vector<glm::vec4> Poisson::generateProgressivePattern(float size, float minDistance, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> random01(0.f, 1.f);
+
+	//background grid, cell size is chosen so each cell holds at most one point at the final radius
+	int gridSize = std::max(1, (int)std::ceil(size / (minDistance / std::sqrt(2.f))));
+	float cellSize = size / gridSize;
+	std::vector<int> grid(gridSize * gridSize, -1);
+
+	std::vector<glm::vec2> points;
+
+	auto wrappedDistanceSq = [&](glm::vec2 a, glm::vec2 b) {
+		glm::vec2 d = glm::abs(a - b);
+		d = glm::min(d, glm::vec2(size) - d);
+		return d.x * d.x + d.y * d.y;
+		};
+
+	auto isFarEnough = [&](glm::vec2 p, float radius) {
+		int cx = (int)(p.x / cellSize);
+		int cy = (int)(p.y / cellSize);
+		int searchCells = (int)std::ceil(radius / cellSize);
+		for (int y = cy - searchCells; y <= cy + searchCells; y++)
+		{
+			for (int x = cx - searchCells; x <= cx + searchCells; x++)
+			{
+				int index = grid[((y % gridSize + gridSize) % gridSize) * gridSize + (x % gridSize + gridSize) % gridSize];
+				if (index >= 0 && wrappedDistanceSq(p, points[index]) < radius * radius) return false;
+			}
+		}
+		return true;
+		};
+
+	auto addPoint = [&](glm::vec2 p) {
+		int cx = std::min((int)(p.x / cellSize), gridSize - 1);
+		int cy = std::min((int)(p.y / cellSize), gridSize - 1);
+		grid[cy * gridSize + cx] = (int)points.size();
+		points.push_back(p);
+		};
+
+	//	progressive: fill the tile with a large radius first, then keep shrinking it (bridson's algorithm per level)
+	//	earlier points are sparser, so any prefix of the list is still evenly spread
+	const float radiusScales[] = { 4.f, 2.8f, 2.f, 1.4f, 1.f };
+	const int candidatesPerPoint = 30;
+	addPoint(glm::vec2(random01(rng), random01(rng)) * size);
+	for (float radiusScale : radiusScales)
+	{
+		float radius = minDistance * radiusScale;
+		std::vector<int> activeList(points.size());
+		for (int i = 0; i < (int)points.size(); i++) activeList[i] = i;
+
+		while (!activeList.empty())
+		{
+			int activeIndex = std::uniform_int_distribution<int>(0, (int)activeList.size() - 1)(rng);
+			glm::vec2 origin = points[activeList[activeIndex]];
+
+			bool found = false;
+			for (int i = 0; i < candidatesPerPoint; i++)
+			{
+				//random point in the annulus [radius, 2*radius]
+				float angle = random01(rng) * 6.2831853f;
+				float distance = radius * (1.f + random01(rng));
+				glm::vec2 candidate = origin + distance * glm::vec2(std::cos(angle), std::sin(angle));
+				candidate = glm::mod(candidate, glm::vec2(size));
+
+				if (isFarEnough(candidate, radius))
+				{
+					activeList.push_back((int)points.size());
+					addPoint(candidate);
+					found = true;
+					break;
+				}
+			}
+			if (!found)
+			{
+				activeList[activeIndex] = activeList.back();
+				activeList.pop_back();
+			}
+		}
+	}
+
+	std::vector<glm::vec4> pattern(points.size());
+	for (int i = 0; i < (int)points.size(); i++)
+	{
+		pattern[i] = glm::vec4(points[i].x, points[i].y, (float)i / points.size(), 0);
+	}
+	return pattern;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec4.hpp>
+
+
+namespace Poisson
+{
+	//generates a tileable (toroidal) poisson disk pattern over [0,size)^2 with at least minDistance between points.
+	//	points are returned in progressive order: (x, z, rank, 0) where rank is in [0,1),
+	//	every prefix of the pattern is itself well distributed, so thinning by rank < density keeps blue noise properties.
+	std::vector<glm::vec4> generateProgressivePattern(float size, float minDistance, uint32_t seed = 1);
+}
@@ -3,7 +3,9 @@
 
 void vkutil::bufferBarrier(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset,
 	VkPipelineStageFlags2 srcStageMask, 
-	VkPipelineStageFlags2 dstStageMask)
+	VkPipelineStageFlags2 dstStageMask,
+	VkAccessFlags2 srcAccessMask,
+	VkAccessFlags2 dstAccessMask)
 {
 
 	VkBufferMemoryBarrier2 bufferBarrier{};
@@ -11,9 +13,9 @@ void vkutil::bufferBarrier(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize si
 	bufferBarrier.pNext = nullptr;
 
 	bufferBarrier.srcStageMask = srcStageMask;
-	bufferBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT;
+	bufferBarrier.srcAccessMask = srcAccessMask;
 	bufferBarrier.dstStageMask = dstStageMask;
-	bufferBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+	bufferBarrier.dstAccessMask = dstAccessMask;
 
 	bufferBarrier.size = size;
 	bufferBarrier.offset = offset;
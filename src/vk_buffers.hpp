@@ -7,7 +7,9 @@ namespace vkutil
 {
 	void bufferBarrier(VkCommandBuffer cmd, VkBuffer buffer,VkDeviceSize size, VkDeviceSize offset,
 		VkPipelineStageFlags2 srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-		VkPipelineStageFlags2 dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT); //note: ALL_COMMANDS is inefficient
+		VkPipelineStageFlags2 dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, //note: ALL_COMMANDS is inefficient
+		VkAccessFlags2 srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT,
+		VkAccessFlags2 dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT);
 
 	AllocatedBuffer createBuffer(VmaAllocator allocator, size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
 	void destroyBuffer(VmaAllocator allocator, const AllocatedBuffer& buffer);
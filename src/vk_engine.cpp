@@ -23,8 +23,10 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include "noise.hpp"
 #include "vk_buffers.hpp"
+#include "poisson.hpp"
 
 
 VulkanEngine* loadedEngine = nullptr;
@@ -56,6 +58,7 @@ void VulkanEngine::init()
 	initSampler();
 	initDescriptors();
 	initShadowMapResources();
+	initReflectionResources();
 	initPipelines();
 	
 	initDefaultData();
@@ -75,6 +78,16 @@ void VulkanEngine::cleanup()
 		vkDeviceWaitIdle(_device);
 
 		destroyBuffer(_grassDataBuffer);
+		destroyBuffer(_grassPatternBuffer);
+		destroyBuffer(_grassIndirectBuffer);
+		destroyBuffer(_grassAnimatedBuffer);
+		destroyBuffer(_grassShadowInstanceBuffer);
+		destroyBuffer(_grassShadowIndirectBuffer);
+		destroyBuffer(_grassLodInstanceBuffer);
+		destroyBuffer(_grassLodIndirectBuffer);
+		destroyBuffer(_grassBuildDataBuffer);
+		destroyBuffer(_grassBuildIndirectBuffer);
+		destroyBuffer(_grassBuildPatternBuffer);
 
 		for (int i = 0; i < FRAME_OVERLAP; i++)
 		{
@@ -86,6 +99,9 @@ void VulkanEngine::cleanup()
 			vkDestroySemaphore(_device, _frames[i].renderSemaphore, nullptr);
 			vkDestroySemaphore(_device, _frames[i].swapchainSemaphore, nullptr);
 
+			destroyBuffer(_frames[i].grassVisibleSlotBuffer);
+			destroyBuffer(_frames[i].grassShadowCascadeBuffer);
+			destroyBuffer(_frames[i].terrainPatchBuffer);
 			_frames[i].deletionQueue.flush();
 		}
 
@@ -121,6 +137,11 @@ void VulkanEngine::draw()
 	VK_CHECK(vkWaitForFences(_device, 1, &getCurrentFrame().renderFence, true, timeout));
 
 	getCurrentFrame().deletionQueue.flush();
+	if (_qualityPresetChanged)
+	{
+		releaseQualityPipelines();
+		_qualityPresetChanged = false;
+	}
 
 	VK_CHECK(vkResetFences(_device, 1, &getCurrentFrame().renderFence));
 
@@ -144,14 +165,19 @@ void VulkanEngine::draw()
 	//begin recording command buffer
 	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT); //reset after executing once
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+	_workgroupTuner.beginFrame(cmd, _frameNumber % FRAME_OVERLAP);
+	_gpuTimer.beginFrame(cmd, _frameNumber % FRAME_OVERLAP);
 
-	vkutil::transitionImage(cmd, _windMapImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	//	note: the wind field persists between frames, it is only partially rebuilt every frame
+	vkutil::transitionImage(cmd, _windMapImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
 	updateWindMap(cmd);
+	streamTerrainTiles(cmd, TERRAIN_TILE_UPLOADS_PER_FRAME);
 	updateGrassData(cmd);
+	animateGrass(cmd);
+	updateTerrainPatches();
 	_water.update(cmd);
 
 	//calculate shadow map
-	vkutil::transitionImage(cmd, _shadowMapImageArray.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 	drawShadowMap(cmd);
 	vkutil::transitionImage(cmd, _shadowMapImageArray.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
 		
@@ -181,25 +207,34 @@ void VulkanEngine::draw()
 	vkutil::transitionImage(cmd, _normalsImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
 	vkutil::transitionImage(cmd, _specularMapImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
 	vkutil::transitionImage(cmd, _positionsImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
-	vkutil::transitionImage(cmd, _finalDrawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-
-	drawDeferred(cmd);
-
-	//prepare to copy final image to swapchain image for presenting
-	vkutil::transitionImage(cmd, _finalDrawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-	vkutil::transitionImage(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	
-	vkutil::copyImageToImage(cmd, _finalDrawImage.image, _swapchainImages[swapchainImageIndex], _drawExtent, _swapchainExtent);
-
-	//prepare swapchain image to draw GUI
-	//	note: we use COLOR_ATTACHMENT_OPTIMAL when calling rendering commands
-	vkutil::transitionImage(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	vkutil::transitionImage(cmd, _shadowMaskImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	//without render scaling the deferred pass shades straight into the swapchain image,
+	//	otherwise it shades into _finalDrawImage and the ui pass resolves that to the swapchain
+	VkImage swapchainImage = _swapchainImages[swapchainImageIndex];
+	VkImageView swapchainImageView = _swapchainImageViews[swapchainImageIndex];
+	bool swapchainOutput = _swapchainStorage &&
+		_drawExtent.width == _swapchainExtent.width && _drawExtent.height == _swapchainExtent.height;
+	if (swapchainOutput)
+	{
+		vkutil::transitionImage(cmd, swapchainImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		drawDeferred(cmd, swapchainImageView, true);
+		//	note: we use COLOR_ATTACHMENT_OPTIMAL when calling rendering commands
+		vkutil::transitionImage(cmd, swapchainImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
+	else
+	{
+		vkutil::transitionImage(cmd, _finalDrawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		drawDeferred(cmd, _finalDrawImage.imageView, false);
+		vkutil::transitionImage(cmd, _finalDrawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		vkutil::transitionImage(cmd, swapchainImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
 	//vkutil::transitionImage(cmd, _windMapImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
-	drawImGui(cmd, _swapchainImageViews[swapchainImageIndex]);
+	drawImGui(cmd, swapchainImageView, !swapchainOutput);
 
 	//prepare swapchain image for presenting
-	vkutil::transitionImage(cmd, _swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	vkutil::transitionImage(cmd, swapchainImage, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
 
 
@@ -212,7 +247,10 @@ void VulkanEngine::draw()
 
 	VkCommandBufferSubmitInfo cmdInfo = vkinit::commandBufferSubmitInfo(cmd);
 
-	VkSemaphoreSubmitInfo waitInfo = vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, getCurrentFrame().swapchainSemaphore);
+	//	note: the deferred pass writes the swapchain image from a compute shader, so compute has to wait for it too
+	VkPipelineStageFlags2 swapchainWaitStages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+	if (swapchainOutput) swapchainWaitStages |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	VkSemaphoreSubmitInfo waitInfo = vkinit::semaphoreSubmitInfo(swapchainWaitStages, getCurrentFrame().swapchainSemaphore);
 	VkSemaphoreSubmitInfo signalInfo = vkinit::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, getCurrentFrame().renderSemaphore);
 
 	VkSubmitInfo2 submit = vkinit::submitInfo(&cmdInfo, &signalInfo, &waitInfo);
@@ -266,13 +304,35 @@ void VulkanEngine::drawBackground(VkCommandBuffer cmd)
 	vkCmdDispatch(cmd, std::ceil(_drawExtent.width / 16.0), std::ceil(_drawExtent.height / 16.0), 1);
 }
 
-void VulkanEngine::drawImGui(VkCommandBuffer cmd, VkImageView targetImageView)
+void VulkanEngine::drawImGui(VkCommandBuffer cmd, VkImageView targetImageView, bool resolve)
 {
 	VkRenderingAttachmentInfo colorAttachment = vkinit::attachmentInfo(targetImageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	VkRenderingInfo renderingInfo = vkinit::renderingInfo(_swapchainExtent, &colorAttachment, nullptr);
 
 	vkCmdBeginRendering(cmd, &renderingInfo);
 
+	//scale and convert _finalDrawImage in the same pass, instead of blitting it before the ui
+	if (resolve)
+	{
+		VkViewport viewport = {};
+		viewport.width = (float)_swapchainExtent.width;
+		viewport.height = (float)_swapchainExtent.height;
+		viewport.maxDepth = 1.f;
+		vkCmdSetViewport(cmd, 0, 1, &viewport);
+		VkRect2D scissor = {};
+		scissor.extent = _swapchainExtent;
+		vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+		ComputePushConstants pushConstants;
+		pushConstants.data1 = glm::vec4(
+			(float)_drawExtent.width / _finalDrawImage.imageExtent.width,
+			(float)_drawExtent.height / _finalDrawImage.imageExtent.height, 0, 0);
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _resolvePipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _resolvePipelineLayout, 0, 1, &_resolveDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(cmd, _resolvePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+		vkCmdDraw(cmd, 3, 1, 0, 0);
+	}
+
 	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
 
 	vkCmdEndRendering(cmd);
@@ -390,29 +450,65 @@ void VulkanEngine::drawGeometry(VkCommandBuffer cmd)
 	pushConstants.worldMatrix = glm::translate(glm::vec3(0));
 
 	//draw ground
-	pushConstants.vertexBuffer = _groundMesh->meshBuffers.vertexBufferAddress;
-	vkCmdPushConstants(cmd, _meshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
-	vkCmdBindIndexBuffer(cmd, _groundMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-	vkCmdDrawIndexed(cmd, _groundMesh->surfaces[0].count, 1, _groundMesh->surfaces[0].startIndex, 0, 0);
-	UI_triangleCount += _groundMesh->surfaces[0].count / 3 * 1;
+	//	far field grass blends in on the ground where the blades fade out
+	//	every selected CDLOD patch is an instance of the ground mesh
+	{
+		float farFieldBlendStart = (float)std::max(0, _maxGrassDistance - _grassFarFieldBlend);
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _terrainPipeline);
+		VkDescriptorSet terrainSets[] = {
+			sceneDataDescriptorSet,
+			_shadowMapDescriptorSet,
+			_terrainTilesDescriptorSet,
+			_terrainDescriptorSet
+		};
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _terrainPipelineLayout, 0, 4, terrainSets, 0, nullptr);
+		pushConstants.vertexBuffer = _groundMesh->meshBuffers.vertexBufferAddress;
+		pushConstants.data = glm::vec4(1, farFieldBlendStart, _maxGrassDistance, 0);
+		vkCmdPushConstants(cmd, _terrainPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+		vkCmdBindIndexBuffer(cmd, _groundMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(cmd, _groundMesh->surfaces[0].count, _terrainPatchRanges[0].patchCount, _groundMesh->surfaces[0].startIndex, 0, _terrainPatchRanges[0].firstPatch);
+		UI_triangleCount += _groundMesh->surfaces[0].count / 3 * _terrainPatchRanges[0].patchCount;
+	}
 
 	//draw grass
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassPipeline);
-
-	pushConstants.vertexBuffer = _grassMesh->meshBuffers.vertexBufferAddress;
-
 	VkDescriptorSet sets[] = {
 		sceneDataDescriptorSet,
 		_shadowMapDescriptorSet,
 		_grassDataDescriptorSet
 	};
-	//TODO maybe no need to rebind scenedata!!!
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassPipelineLayout, 0, 3, sets, 0, nullptr);
-	vkCmdPushConstants(cmd, _grassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
-	vkCmdBindIndexBuffer(cmd, _grassMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	//	note: grass instance counts live on the gpu, so grass is not part of UI_triangleCount
+	if (_useVisibilityBuffer)
+	{
+		vkCmdEndRendering(cmd);
+		drawGrassVisibility(cmd, sceneDataDescriptorSet, pushConstants);
+
+		//the transparent meshes continue on the G-buffer and depth as the grass left them
+		for (VkRenderingAttachmentInfo& attachment : renderingAttachments)
+			attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		vkCmdBeginRendering(cmd, &renderingInfo);
+	}
+	else if (_meshShaderSupported && _useMeshShaderGrass)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassMeshPipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassMeshPipelineLayout, 0, 3, sets, 0, nullptr);
+		drawGrassMeshTasks(cmd, 0, pushConstants);
+	}
+	else
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassPipeline);
+
+		//	note: grass.vert builds the blades from gl_VertexIndex, only the index buffer is used
+		pushConstants.data = glm::vec4(GRASS_BLADE_SEGMENTS, 0, 0, 0);
 
-	vkCmdDrawIndexed(cmd, _grassMesh->surfaces[0].count, _grassCount, _grassMesh->surfaces[0].startIndex, 0, 0);
-	UI_triangleCount += _grassMesh->surfaces[0].count / 3 * _grassCount;
+		//TODO maybe no need to rebind scenedata!!!
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassPipelineLayout, 0, 3, sets, 0, nullptr);
+		vkCmdPushConstants(cmd, _grassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+		vkCmdBindIndexBuffer(cmd, _grassMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		drawGrassLods(cmd);
+		pushConstants.data = glm::vec4(0);
+	}
 
 	//
 	//	TRANSPARENT MESHES
@@ -422,39 +518,103 @@ void VulkanEngine::drawGeometry(VkCommandBuffer cmd)
 	vkCmdEndRendering(cmd);
 }
 
-void VulkanEngine::drawShadowMap(VkCommandBuffer cmd)
+void VulkanEngine::drawGrassVisibility(VkCommandBuffer cmd, VkDescriptorSet sceneDataDescriptorSet, GPUDrawPushConstants& pushConstants)
 {
-	//for (int i = 0; i < CSM_COUNT; i++)
-	for (int i = CSM_COUNT-1; i >=0; i--)
+	//grass only writes depth and which blade triangle is visible, 4 bytes per pixel instead of the four G-buffer targets
+	//	note: the depth of the opaque pass has to be written before the blades test against it
+	vkutil::transitionImage(cmd, _depthImage.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	vkutil::transitionImage(cmd, _visibilityImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	VkClearValue visibilityClearValue{};
+	visibilityClearValue.color.uint32[0] = 0xffffffff; //VISIBILITY_EMPTY
+	VkRenderingAttachmentInfo visibilityAttachment = vkinit::attachmentInfo(_visibilityImage.imageView, &visibilityClearValue, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	VkRenderingAttachmentInfo depthAttachment = vkinit::depthAttachmentInfo(_depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	VkRenderingInfo renderingInfo = vkinit::renderingInfo(_drawExtent, &visibilityAttachment, &depthAttachment);
+
+	vkCmdBeginRendering(cmd, &renderingInfo);
+	VkDescriptorSet sets[] = {
+		sceneDataDescriptorSet,
+		_shadowMapDescriptorSet,
+		_grassDataDescriptorSet
+	};
+	if (_meshShaderSupported && _useMeshShaderGrass)
 	{
-		//IDK if theres a better way to do this (there probably is) but for now
-		// everything is just copypasted from drawGeometry
-		//PER FRAME DATA
-		//	Scene Data
-		AllocatedBuffer sceneDataBuffer = createBuffer(sizeof(SceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-		getCurrentFrame().deletionQueue.pushFunction(
-			[=, this]() {
-				destroyBuffer(sceneDataBuffer);
-			}
-		);
-		SceneData* sceneUniformData = (SceneData*)sceneDataBuffer.allocation->GetMappedData();
-		*sceneUniformData = _shadowMapSceneData[i]; //write scene data to buffer
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassMeshVisibilityPipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassMeshPipelineLayout, 0, 3, sets, 0, nullptr);
+		drawGrassMeshTasks(cmd, 0, pushConstants);
+	}
+	else
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassVisibilityPipeline);
+		pushConstants.data = glm::vec4(GRASS_BLADE_SEGMENTS, 0, 0, 0);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _grassPipelineLayout, 0, 3, sets, 0, nullptr);
+		vkCmdPushConstants(cmd, _grassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+		vkCmdBindIndexBuffer(cmd, _grassMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		drawGrassLods(cmd);
+		pushConstants.data = glm::vec4(0);
+	}
+	vkCmdEndRendering(cmd);
 
-		VkDescriptorSet sceneDataDescriptorSet = getCurrentFrame().descriptorAllocator.allocate(_device, _sceneDataDescriptorLayout, nullptr);
-		DescriptorWriter writer;
-		writer.writeBuffer(0, sceneDataBuffer.buffer, sizeof(SceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-		writer.updateSet(_device, sceneDataDescriptorSet);
+	//shade every pixel a blade is visible in once, straight into the G-buffer
+	vkutil::transitionImage(cmd, _visibilityImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+	VkImage gBuffer[] = { _drawImage.image, _normalsImage.image, _specularMapImage.image, _positionsImage.image };
+	for (VkImage image : gBuffer)
+		vkutil::transitionImage(cmd, image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+
+	ComputePushConstants materialConstants;
+	materialConstants.data1 = glm::vec4(_player._position.x, _player._position.y, _player._position.z, 0);
+	materialConstants.data2 = glm::vec4(_drawExtent.width, _drawExtent.height, 0, 0);
+	VkDescriptorSet materialSets[] = {
+		sceneDataDescriptorSet,
+		_grassMaterialDescriptorSet,
+		_grassDataDescriptorSet
+	};
+	WorkgroupSize materialSize = _workgroupTuner.size(_grassMaterialKernel);
+	_workgroupTuner.beginTiming(cmd, _grassMaterialKernel);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _grassMaterialPipelines.get(materialSize));
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _grassMaterialPipelineLayout, 0, 3, materialSets, 0, nullptr);
+	vkCmdPushConstants(cmd, _grassMaterialPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &materialConstants);
+	vkCmdDispatch(cmd, materialSize.groupsX(_drawExtent.width), materialSize.groupsY(_drawExtent.height), 1);
+	_workgroupTuner.endTiming(cmd, _grassMaterialKernel);
+
+	for (VkImage image : gBuffer)
+		vkutil::transitionImage(cmd, image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	vkutil::transitionImage(cmd, _depthImage.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+}
+
+void VulkanEngine::drawShadowMap(VkCommandBuffer cmd)
+{
+	//all cascades are drawn in one rendering scope into the layers of the shadow map array
+	//	every primitive is routed to the cascades it overlaps in the vertex shader, see _shadowCascade.glsl
+	//	terrain and meshes only go into the static layers of the cascades that refresh this frame (updateShadowCascades),
+	//	the shadow map is a copy of the static layers with the animated grass drawn on top
+	//PER FRAME DATA
+	//	Scene Data, the cascade matrices are in sunViewProj
+	AllocatedBuffer sceneDataBuffer = createBuffer(sizeof(SceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	getCurrentFrame().deletionQueue.pushFunction(
+		[=, this]() {
+			destroyBuffer(sceneDataBuffer);
+		}
+	);
+	SceneData* sceneUniformData = (SceneData*)sceneDataBuffer.allocation->GetMappedData();
+	*sceneUniformData = _sceneData; //write scene data to buffer
+
+	VkDescriptorSet sceneDataDescriptorSet = getCurrentFrame().descriptorAllocator.allocate(_device, _sceneDataDescriptorLayout, nullptr);
+	DescriptorWriter writer;
+	writer.writeBuffer(0, sceneDataBuffer.buffer, sizeof(SceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+	writer.updateSet(_device, sceneDataDescriptorSet);
 
-		//begin a render pass connected to draw image
-		//TODO if we want to point to no color attachment, make the imageview nullptr!!! and use VK_ATTACHMENT_UNUSED
-		VkRenderingAttachmentInfo depthAttachment = vkinit::depthAttachmentInfo(_shadowMapImageArray.imageViews[i], VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	//begin a render pass connected to every layer
+	auto beginShadowRendering = [&](VkImageView view, VkAttachmentLoadOp loadOp) {
+		VkRenderingAttachmentInfo depthAttachment = vkinit::depthAttachmentInfo(view, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+		depthAttachment.loadOp = loadOp;
 
 		VkRenderingInfo renderingInfo{};
 		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
 		renderingInfo.pNext = nullptr;
 
 		renderingInfo.renderArea = VkRect2D{ VkOffset2D{0,0}, VkExtent2D(_shadowMapImageArray.imageExtent.width,_shadowMapImageArray.imageExtent.height)};
-		renderingInfo.layerCount = 1;
+		renderingInfo.layerCount = CSM_COUNT;
 		renderingInfo.colorAttachmentCount = 0;
 		renderingInfo.pDepthAttachment = &depthAttachment;
 		renderingInfo.pStencilAttachment = nullptr;
@@ -478,15 +638,35 @@ void VulkanEngine::drawShadowMap(VkCommandBuffer cmd)
 		scissor.offset.y = 0;
 
 		vkCmdSetScissor(cmd, 0, 1, &scissor);
+		};
+
+	GPUDrawPushConstants pushConstants{};
+	pushConstants.worldMatrix = glm::translate(glm::vec3(0));
+	pushConstants.playerPosition = glm::vec4(_player._position.x, _player._position.y, _player._position.z, 0);
+	pushConstants.shadow = glm::ivec2(1, 0);
+
+	//STATIC DEPTH
+	std::vector<VkClearRect> refreshedLayers;
+	for (int i = 0; i < CSM_COUNT; i++)
+	{
+		if (_shadowCascadeRefresh[i])
+			refreshedLayers.push_back(VkClearRect{ VkRect2D{ VkOffset2D{0,0}, VkExtent2D(_shadowStaticImageArray.imageExtent.width, _shadowStaticImageArray.imageExtent.height) }, (uint32_t)i, 1 });
+	}
+	if (!refreshedLayers.empty())
+	{
+		_gpuTimer.begin(cmd, _shadowStaticTimer);
+		vkutil::transitionImage(cmd, _shadowStaticImageArray.image, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+		beginShadowRendering(_shadowStaticImageArray.imageView, VK_ATTACHMENT_LOAD_OP_LOAD);
+
+		//only the refreshed layers are cleared, the others keep their cached depth
+		VkClearAttachment clear{};
+		clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		clear.clearValue.depthStencil.depth = 1.f;
+		vkCmdClearAttachments(cmd, 1, &clear, (uint32_t)refreshedLayers.size(), refreshedLayers.data());
 
 		//draw mesh
 		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowMeshPipeline);
 
-		GPUDrawPushConstants pushConstants{};
-		pushConstants.worldMatrix = glm::translate(glm::vec3(0));
-		pushConstants.playerPosition = glm::vec4(_player._position.x, _player._position.y, _player._position.z, 0);
-		//pushConstants.playerPosition = glm::vec4(_sunPosition.x, _sunPosition.y, _sunPosition.z, 0);
-
 		//draw loaded test mesh
 		pushConstants.vertexBuffer = testMeshes[2]->meshBuffers.vertexBufferAddress;
 
@@ -501,38 +681,171 @@ void VulkanEngine::drawShadowMap(VkCommandBuffer cmd)
 		vkCmdPushConstants(cmd, _shadowMeshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
 		vkCmdBindIndexBuffer(cmd, testMeshes[2]->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
-		vkCmdDrawIndexed(cmd, testMeshes[2]->surfaces[0].count, 1, testMeshes[2]->surfaces[0].startIndex, 0, 0);
+		//one instance per refreshed cascade the bounds overlap, the instance index is the cascade
+		const GeoSurface& surface = testMeshes[2]->surfaces[0];
+		for (int i = 0; i < CSM_COUNT; i++)
+		{
+			if (_shadowCascadeRefresh[i] &&
+				Frustum(_shadowMapSceneData[i].viewProj * pushConstants.worldMatrix).intersectsAABB(surface.boundsMin, surface.boundsMax))
+				vkCmdDrawIndexed(cmd, surface.count, 1, surface.startIndex, 0, i);
+		}
 
 
-		//draw ground
-		pushConstants.vertexBuffer = _groundMesh->meshBuffers.vertexBufferAddress;
-		vkCmdPushConstants(cmd, _shadowMeshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
-		vkCmdBindIndexBuffer(cmd, _groundMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(cmd, _groundMesh->surfaces[0].count, 1, _groundMesh->surfaces[0].startIndex, 0, 0);
+		//draw ground, the patches of all cascades are consecutive and every patch knows its cascade
+		//	note: cached cascades selected no patches
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowTerrainPipeline);
+			VkDescriptorSet terrainSets[] = {
+				sceneDataDescriptorSet,
+				_shadowMapDescriptorSet,
+				_terrainTilesDescriptorSet,
+				_terrainDescriptorSet
+			};
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowTerrainPipelineLayout, 0, 4, terrainSets, 0, nullptr);
+			pushConstants.vertexBuffer = _groundMesh->meshBuffers.vertexBufferAddress;
+			vkCmdPushConstants(cmd, _shadowTerrainPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+			vkCmdBindIndexBuffer(cmd, _groundMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			uint32_t patchCount = 0;
+			for (int i = 0; i < CSM_COUNT; i++)
+			{
+				patchCount += _terrainPatchRanges[1 + i].patchCount;
+			}
+			vkCmdDrawIndexed(cmd, _groundMesh->surfaces[0].count, patchCount, _groundMesh->surfaces[0].startIndex, 0, _terrainPatchRanges[1].firstPatch);
+		}
 
-		//draw grass
-		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowGrassPipeline);
+		vkCmdEndRendering(cmd);
+		vkutil::transitionImage(cmd, _shadowStaticImageArray.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+		_gpuTimer.end(cmd, _shadowStaticTimer);
+	}
 
-		pushConstants.vertexBuffer = _grassMesh->meshBuffers.vertexBufferAddress;
+	//ANIMATED GRASS, every cascade every frame
+	//	drawn into its own cleared depth, the shadow lookups take the min of it and the static depth
+	_gpuTimer.begin(cmd, _shadowGrassTimer);
+	vkutil::transitionImage(cmd, _shadowMapImageArray.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	beginShadowRendering(_shadowMapImageArray.fullImageView, VK_ATTACHMENT_LOAD_OP_CLEAR);
 
-		VkDescriptorSet sets[] = {
-			sceneDataDescriptorSet,
-			_shadowMapDescriptorSet,
-			_grassDataDescriptorSet
-		};
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowGrassPipeline);
+
+	//shadows only need a single segment per blade, matching the low quality mesh's 3 indices
+	//	blades come from the cascade's instance list built by grass_animate.comp
+	pushConstants.data = glm::vec4(1, 1, 0, 0);
+
+	VkDescriptorSet sets[] = {
+		sceneDataDescriptorSet,
+		_shadowMapDescriptorSet,
+		_grassDataDescriptorSet
+	};
 
-		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowGrassPipelineLayout, 0, 3, sets, 0, nullptr);
-		vkCmdPushConstants(cmd, _shadowGrassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
-		vkCmdBindIndexBuffer(cmd, _lowQualityGrassMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _shadowGrassPipelineLayout, 0, 3, sets, 0, nullptr);
+	vkCmdPushConstants(cmd, _shadowGrassPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+	vkCmdBindIndexBuffer(cmd, _lowQualityGrassMesh->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
-		vkCmdDrawIndexed(cmd, _lowQualityGrassMesh->surfaces[0].count, _grassCount, _lowQualityGrassMesh->surfaces[0].startIndex, 0, 0);
+	//one command per cascade, gl_DrawID is the cascade
+	vkCmdDrawIndexedIndirect(cmd, _grassShadowIndirectBuffer.buffer, 0, CSM_COUNT, sizeof(VkDrawIndexedIndirectCommand));
 
+	vkCmdEndRendering(cmd);
+	_gpuTimer.end(cmd, _shadowGrassTimer);
+}
 
-		vkCmdEndRendering(cmd);
+//drops the pipeline permutations of earlier quality settings so they do not pile up,
+//	the current settings compile again on first use
+void VulkanEngine::releaseQualityPipelines()
+{
+	std::vector<VkPipeline> pipelines = _clouds.releasePipelines();
+	for (auto& deferredPipelines : _deferredPipelines)
+	{
+		std::vector<VkPipeline> released = deferredPipelines.release();
+		pipelines.insert(pipelines.end(), released.begin(), released.end());
+	}
+	for (vkutil::PipelinePermutations<std::pair<int, WorkgroupSize>>* permutations : { &_shadowMaskPipelines, &_ssrPipelines })
+	{
+		std::vector<VkPipeline> released = permutations->release();
+		pipelines.insert(pipelines.end(), released.begin(), released.end());
 	}
+	//	note: the other frame may still use them, this frame's deletion queue is only flushed once both finished
+	getCurrentFrame().deletionQueue.pushFunction([=, this]() {
+		for (VkPipeline pipeline : pipelines)
+			vkDestroyPipeline(_device, pipeline, nullptr);
+		});
 }
 
-void VulkanEngine::drawDeferred(VkCommandBuffer cmd)
+void VulkanEngine::drawReflections(VkCommandBuffer cmd, VkDescriptorSet sceneDataDescriptorSet)
+{
+	//reflections are traced at half resolution and only where the specular map asks for them,
+	//	the temporal pass then accumulates them so fewer rays per pixel still converge
+	uint32_t halfWidth = (_drawExtent.width + 1) / 2;
+	uint32_t halfHeight = (_drawExtent.height + 1) / 2;
+
+	//HI-Z, every mip reads the one before it
+	vkutil::transitionImage(cmd, _hiZImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	WorkgroupSize hiZSize = _workgroupTuner.size(_hiZKernel);
+	_workgroupTuner.beginTiming(cmd, _hiZKernel);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _hiZPipelines.get(hiZSize));
+	//	note: only the part covering the draw extent is valid, the source reads are clamped to the valid part of the mip before
+	ComputePushConstants hiZPushConstants;
+	uint32_t sourceWidth = _drawExtent.width;
+	uint32_t sourceHeight = _drawExtent.height;
+	for (int i = 0; i < SSR_HIZ_MIPS; i++)
+	{
+		uint32_t mipWidth = (halfWidth + (1u << i) - 1) >> i;
+		uint32_t mipHeight = (halfHeight + (1u << i) - 1) >> i;
+		hiZPushConstants.data1 = glm::vec4(sourceWidth, sourceHeight, mipWidth, mipHeight);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _hiZPipelineLayout, 0, 1, &_hiZDescriptorSets[i], 0, nullptr);
+		vkCmdPushConstants(cmd, _hiZPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &hiZPushConstants);
+		vkCmdDispatch(cmd, hiZSize.groupsX(mipWidth), hiZSize.groupsY(mipHeight), 1);
+		vkutil::transitionImage(cmd, _hiZImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+		sourceWidth = mipWidth;
+		sourceHeight = mipHeight;
+	}
+	_workgroupTuner.endTiming(cmd, _hiZKernel);
+
+	//TRACE
+	ComputePushConstants pushConstants;
+	pushConstants.data1 = glm::vec4(_drawExtent.width, _drawExtent.height, SSR_HIZ_MIPS, 0);
+	pushConstants.data2 = glm::vec4(_shadowMaskHalfResolution ? 2 : 1, 0, 0, 0);
+	VkDescriptorSet ssrDescriptors[] = {
+		sceneDataDescriptorSet,
+		_ssrDescriptorSet
+	};
+	WorkgroupSize ssrSize = _workgroupTuner.size(_ssrKernel);
+	_workgroupTuner.beginTiming(cmd, _ssrKernel);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _ssrPipelines.get({ _quality.reflectionSteps, ssrSize }));
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _ssrPipelineLayout, 0, 2, ssrDescriptors, 0, nullptr);
+	vkCmdPushConstants(cmd, _ssrPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+	vkCmdDispatch(cmd, ssrSize.groupsX(halfWidth), ssrSize.groupsY(halfHeight), 1);
+	_workgroupTuner.endTiming(cmd, _ssrKernel);
+	vkutil::transitionImage(cmd, _ssrTraceImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+	//TEMPORAL ACCUMULATION
+	pushConstants.data1 = glm::vec4(_drawExtent.width, _drawExtent.height, SSR_TEMPORAL_BLEND, 0);
+	VkDescriptorSet temporalDescriptors[] = {
+		sceneDataDescriptorSet,
+		_ssrTemporalDescriptorSet
+	};
+	WorkgroupSize temporalSize = _workgroupTuner.size(_ssrTemporalKernel);
+	_workgroupTuner.beginTiming(cmd, _ssrTemporalKernel);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _ssrTemporalPipelines.get(temporalSize));
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _ssrTemporalPipelineLayout, 0, 2, temporalDescriptors, 0, nullptr);
+	vkCmdPushConstants(cmd, _ssrTemporalPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+	vkCmdDispatch(cmd, temporalSize.groupsX(halfWidth), temporalSize.groupsY(halfHeight), 1);
+	_workgroupTuner.endTiming(cmd, _ssrTemporalKernel);
+	vkutil::transitionImage(cmd, _ssrImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT);
+
+	//	note: the history is only read by the next frame, the deferred pass does not wait on this copy
+	VkImageCopy copy{};
+	copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.srcSubresource.layerCount = 1;
+	copy.dstSubresource = copy.srcSubresource;
+	copy.extent = { halfWidth, halfHeight, 1 };
+	vkCmdCopyImage(cmd, _ssrImage.image, VK_IMAGE_LAYOUT_GENERAL, _ssrHistoryImage.image, VK_IMAGE_LAYOUT_GENERAL, 1, &copy);
+	vkutil::transitionImage(cmd, _ssrHistoryImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_2_COPY_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+}
+
+void VulkanEngine::drawDeferred(VkCommandBuffer cmd, VkImageView targetImageView, bool swapchainOutput)
 {
 	//todo probably shouldnt repeat this but whatever
 	VkDescriptorSet sceneDataDescriptorSet = getCurrentFrame().descriptorAllocator.allocate(_device, _sceneDataDescriptorLayout, nullptr);
@@ -551,72 +864,623 @@ void VulkanEngine::drawDeferred(VkCommandBuffer cmd)
 		writer.writeBuffer(0, sceneDataBuffer.buffer, sizeof(SceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
 		writer.updateSet(_device, sceneDataDescriptorSet);
 	}
+	//resolve the sun shadows once per pixel, instead of for every fragment the G-buffer pass shades
+	//	note: at half resolution deferred.comp upsamples the mask depth aware
+	int shadowMaskScale = _shadowMaskHalfResolution ? 2 : 1;
+	ComputePushConstants shadowMaskConstants;
+	shadowMaskConstants.data1 = glm::vec4(0, shadowMaskScale, _drawExtent.width, _drawExtent.height);
+	WorkgroupSize shadowMaskSize = _workgroupTuner.size(_shadowMaskKernel);
+	_workgroupTuner.beginTiming(cmd, _shadowMaskKernel);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _shadowMaskPipelines.get({ _quality.shadowFilterRadius, shadowMaskSize }));
+	VkDescriptorSet shadowMaskDescriptors[] = {
+		sceneDataDescriptorSet,
+		_shadowMaskDescriptorSet
+	};
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _shadowMaskPipelineLayout, 0, 2, shadowMaskDescriptors, 0, nullptr);
+	vkCmdPushConstants(cmd, _shadowMaskPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &shadowMaskConstants);
+	uint32_t maskWidth = (_drawExtent.width + shadowMaskScale - 1) / shadowMaskScale;
+	uint32_t maskHeight = (_drawExtent.height + shadowMaskScale - 1) / shadowMaskScale;
+	vkCmdDispatch(cmd, shadowMaskSize.groupsX(maskWidth), shadowMaskSize.groupsY(maskHeight), 1);
+	_workgroupTuner.endTiming(cmd, _shadowMaskKernel);
+	vkutil::transitionImage(cmd, _shadowMaskImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+	if (_useHiZReflections) drawReflections(cmd, sceneDataDescriptorSet);
+
 	ComputePushConstants pushConstants;
 	pushConstants.data1 = glm::vec4(_player._position.x, _player._position.y, _player._position.z, 1);
+	pushConstants.data2 = glm::vec4(shadowMaskScale, _useHiZReflections ? 1 : 0, _deferredTileCapacity, 0);
+	pushConstants.data3 = glm::vec4(_drawExtent.width, _drawExtent.height, 0, 0);
 
-	//bind the gradient drawing compute pipeline
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _deferredPipeline);
+	VkDescriptorSet outputDescriptorSet = getCurrentFrame().descriptorAllocator.allocate(_device, _deferredOutputDescriptorLayout, nullptr);
+	{
+		DescriptorWriter writer;
+		writer.writeImage(0, targetImageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.updateSet(_device, outputDescriptorSet);
+	}
 
-	//bind the descriptor set containing the draw image for the compute pipeline
 	VkDescriptorSet descriptors[] = {
 		sceneDataDescriptorSet,
-		_drawImageDescriptors
+		_drawImageDescriptors,
+		_deferredTilesDescriptorSet,
+		outputDescriptorSet
 	};
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _deferredPipelineLayout, 0, 2, descriptors, 0, nullptr);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _deferredPipelineLayout, 0, 4, descriptors, 0, nullptr);
 	vkCmdPushConstants(cmd, _deferredPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
 
-	//execute compute pipeline dispatch
+	//classify the tiles, every class only counts its tiles into the x of its dispatch
+	//	note: the previous frame's dispatches may still read the counts
+	vkutil::bufferBarrier(cmd, _deferredDispatchBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	VkDispatchIndirectCommand emptyDispatches[DEFERRED_TILE_CLASS_COUNT];
+	for (VkDispatchIndirectCommand& dispatch : emptyDispatches)
+		dispatch = { 0, 1, 1 };
+	vkCmdUpdateBuffer(cmd, _deferredDispatchBuffer.buffer, 0, sizeof(emptyDispatches), emptyDispatches);
+	vkutil::bufferBarrier(cmd, _deferredDispatchBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
+	vkutil::bufferBarrier(cmd, _deferredTileBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _deferredClassifyPipeline);
 	vkCmdDispatch(cmd, std::ceil(_drawExtent.width / 16.0), std::ceil(_drawExtent.height / 16.0), 1);
+
+	vkutil::bufferBarrier(cmd, _deferredDispatchBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+		VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	vkutil::bufferBarrier(cmd, _deferredTileBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+
+	//shade every class with its own variant, sky tiles only copy the color and lit tiles skip the reflections
+	for (int tileClass = 0; tileClass < DEFERRED_TILE_CLASS_COUNT; tileClass++)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _deferredPipelines[tileClass].get({ _quality.reflectionSteps, _quality.reflectionRefineSteps, swapchainOutput }));
+		vkCmdDispatchIndirect(cmd, _deferredDispatchBuffer.buffer, tileClass * sizeof(VkDispatchIndirectCommand));
+	}
 }
 
 void VulkanEngine::updateGrassData(VkCommandBuffer cmd)
 {
-	if (_settingsChanged)
+	auto frameStart = std::chrono::system_clock::now();
+	reportGrassRebuild();
+
+	//generating the pattern of a dense setting takes long, so it runs off the render thread and the old grass keeps drawing
+	//	note: a running generation is never replaced, destroying its future would block until it finishes
+	if (_settingsChanged && !_grassPatternFuture.valid())
 	{
-		AllocatedBuffer deletedBuffer = _grassDataBuffer;
-		//deletion
-		getCurrentFrame().deletionQueue.pushFunction(
-			[=, this]() {
-				destroyBuffer(deletedBuffer);
-			}
-		);
 		_settingsChanged = false;
-		_grassDensity = UI_grassDensity;
-		_maxGrassDistance = UI_maxGrassDistance;
-		//TODO only allocate new buffer when grass count changes
-		_grassCount = (_maxGrassDistance * 2 * _grassDensity + 1) * (_maxGrassDistance * 2 * _grassDensity + 1);;
-		_grassDataBuffer = createBuffer(sizeof(GrassData) * _grassCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		int density = UI_grassDensity;
+		int maxDistance = UI_maxGrassDistance;
+		//the inline path is kept to measure against, it generates the pattern on the render thread when it is taken
+		_grassPatternInline = _grassRebuildInline;
+		_grassPatternFuture = std::async(_grassPatternInline ? std::launch::deferred : std::launch::async, [density, maxDistance]() {
+			auto start = std::chrono::system_clock::now();
+			//placement pattern, density is blades per meter so the grid spacing becomes the poisson distance
+			//	note: this gives ~60% of the blades of the old jittered grid at the same coverage
+			GrassPatternResult result;
+			result.pattern = Poisson::generateProgressivePattern(GRASS_TILE_SIZE, 1.f / density);
+			result.density = density;
+			result.maxDistance = maxDistance;
+			auto end = std::chrono::system_clock::now();
+			result.generationTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.f;
+			return result;
+		});
+	}
+
+	//a new configuration is built into the build pool and buffers while the current one keeps drawing
+	//	the very first one has to be waited for, there is nothing to draw meanwhile
+	bool building = _grassBuilding;
+	if (_grassPatternFuture.valid() && (_grassCount == 0 || _grassPatternInline ||
+		_grassPatternFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+	{
+		building = true;
+		GrassPatternResult result = _grassPatternFuture.get();
+
+		//a build that is still running restarts with the newer pattern, frames in flight may read neither
+		AllocatedBuffer oldPatternBuffer = _grassBuildPatternBuffer;
+		if (oldPatternBuffer.buffer != VK_NULL_HANDLE)
+		{
+			getCurrentFrame().deletionQueue.pushFunction(
+				[=, this]() {
+					destroyBuffer(oldPatternBuffer);
+				}
+			);
+		}
+		_grassBuildPatternBuffer = createBuffer(sizeof(glm::vec4) * result.pattern.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		memcpy(_grassBuildPatternBuffer.allocation->GetMappedData(), result.pattern.data(), sizeof(glm::vec4) * result.pattern.size());
+		_grassBuildDensity = result.density;
+		_grassBuildMaxDistance = result.maxDistance;
+
+		//	note: buffer size only depends on the tile pool capacity (view distance), not on the world size
+		_grassBuildTiles.configure(GRASS_TILE_SIZE, result.maxDistance, (uint32_t)result.pattern.size());
+		uint32_t buildCount = _grassBuildTiles.capacity() * _grassBuildTiles.bladesPerTile();
+		reserveBuffer(_grassBuildDataBuffer, sizeof(GrassData) * buildCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		reserveBuffer(_grassBuildIndirectBuffer, sizeof(VkDrawIndexedIndirectCommand) * _grassBuildTiles.capacity(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		_grassBuilding = true;
+
+		_grassRebuildStats = {};
+		_grassRebuildStats.inlinePath = _grassPatternInline;
+		_grassRebuildStats.blades = buildCount;
+		_grassRebuildStats.patternTime = result.generationTime;
+	}
+
+	if (_grassBuilding)
+	{
+		//the build pool streams around the player like the live one, so it is complete wherever the player is when it swaps
+		_grassBuildTiles.update(_player._position);
+		//	note: the inline path and the very first configuration generate every tile in one frame
+		int budget = (_grassCount == 0 || _grassRebuildStats.inlinePath) ? (int)_grassBuildTiles.capacity() : GRASS_REBUILD_TILES_PER_FRAME;
+		std::vector<GrassTilePool::Tile> buildTiles = _grassBuildTiles.takeDirtyTiles(budget);
+		if (!buildTiles.empty())
+		{
+			VkDescriptorSet buildDescriptorSet = getCurrentFrame().descriptorAllocator.allocate(_device, _grassDataDescriptorLayout, nullptr);
+			DescriptorWriter writer;
+			writer.writeBuffer(0, _grassBuildDataBuffer.buffer, sizeof(GrassData) * _grassRebuildStats.blades, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+			writer.writeBuffer(2, _grassBuildPatternBuffer.buffer, sizeof(glm::vec4) * _grassBuildTiles.bladesPerTile(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+			writer.writeBuffer(3, _grassBuildIndirectBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+			writer.updateSet(_device, buildDescriptorSet);
+
+			_gpuTimer.begin(cmd, _grassRebuildTimer);
+			generateGrassTiles(cmd, buildTiles, _grassBuildTiles.bladesPerTile(), _grassBuildDataBuffer, _grassBuildIndirectBuffer, buildDescriptorSet);
+			_gpuTimer.end(cmd, _grassRebuildTimer);
+			_grassRebuildStats.frames++;
+		}
+
+		//swap the finished build in, the old configuration becomes the next build target
+		if (_grassBuildTiles.dirtyCount() == 0)
+		{
+			std::swap(_grassTiles, _grassBuildTiles);
+			std::swap(_grassDataBuffer, _grassBuildDataBuffer);
+			std::swap(_grassIndirectBuffer, _grassBuildIndirectBuffer);
 
+			//the old pattern is only read by frames in flight
+			AllocatedBuffer oldPatternBuffer = _grassPatternBuffer;
+			if (oldPatternBuffer.buffer != VK_NULL_HANDLE)
+			{
+				getCurrentFrame().deletionQueue.pushFunction(
+					[=, this]() {
+						destroyBuffer(oldPatternBuffer);
+					}
+				);
+			}
+			_grassPatternBuffer = _grassBuildPatternBuffer;
+			_grassBuildPatternBuffer = {};
+			_grassDensity = _grassBuildDensity;
+			_maxGrassDistance = _grassBuildMaxDistance;
+			_grassCount = _grassTiles.capacity() * _grassTiles.bladesPerTile();
+			_grassBuilding = false;
+
+			//the rest only reallocates when it is too small or mostly unused
+			reserveBuffer(_grassAnimatedBuffer, sizeof(AnimatedGrassBlade) * _grassCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+			reserveBuffer(_grassShadowInstanceBuffer, sizeof(uint32_t) * CSM_COUNT * _grassCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+			reserveBuffer(_grassShadowIndirectBuffer, sizeof(VkDrawIndexedIndirectCommand) * CSM_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+			reserveBuffer(_grassLodInstanceBuffer, sizeof(uint32_t) * GRASS_LOD_COUNT * _grassCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+			reserveBuffer(_grassLodIndirectBuffer, sizeof(VkDrawIndexedIndirectCommand) * GRASS_LOD_COUNT,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		}
 	}
+	//render thread time of the rebuild, including the pattern when it was generated inline
+	if (building)
+	{
+		auto frameEnd = std::chrono::system_clock::now();
+		float frameTime = std::chrono::duration_cast<std::chrono::microseconds>(frameEnd - frameStart).count() / 1000.f;
+		_grassRebuildStats.cpuTime += frameTime;
+		_grassRebuildStats.maxCpuTime = std::max(_grassRebuildStats.maxCpuTime, frameTime);
+	}
+
+	//stream tiles around the player, only newly assigned tiles need to be generated
+	_grassTiles.update(_player._position);
+	std::vector<GrassTilePool::Tile> dirtyTiles = _grassTiles.takeDirtyTiles(GRASS_TILE_UPDATES_PER_FRAME);
+
+	//cull once for every view that draws grass, the union is what gets animated this frame
+	std::vector<bool> isSlotVisible(_grassTiles.capacity(), false);
+	std::vector<bool> isSlotInMainView(_grassTiles.capacity(), false);
+	_grassVisibleSlotCount = 0;
+	for (int view = 0; view < 1 + CSM_COUNT; view++)
+	{
+		const glm::mat4& viewProj = view == 0 ? _sceneData.viewProj : _shadowMapSceneData[view - 1].viewProj;
+		int visibleTiles = _grassTiles.cull(Frustum(viewProj), _grassDrawRanges[view]);
+		if (view == 0) UI_visibleGrassTiles = visibleTiles;
+
+		for (const GrassTilePool::DrawRange& range : _grassDrawRanges[view])
+		{
+			for (uint32_t slot = range.firstSlot; slot < range.firstSlot + range.slotCount; slot++)
+			{
+				if (!isSlotVisible[slot]) _grassVisibleSlotCount++;
+				isSlotVisible[slot] = true;
+				if (view == 0) isSlotInMainView[slot] = true;
+			}
+		}
+	}
+	//	note: the frame that last wrote this buffer finished before its slot came around again
+	AllocatedBuffer& visibleSlotBuffer = getCurrentFrame().grassVisibleSlotBuffer;
+	reserveBuffer(visibleSlotBuffer, sizeof(uint32_t) * std::max(1, _grassVisibleSlotCount), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	uint32_t* visibleSlots = (uint32_t*)visibleSlotBuffer.allocation->GetMappedData();
+	for (uint32_t slot = 0; slot < _grassTiles.capacity(); slot++)
+	{
+		//the top bit tells grass_animate.comp to put the slot's blades in the lod lists of the main pass
+		if (isSlotVisible[slot]) *visibleSlots++ = slot | (isSlotInMainView[slot] ? 0x80000000u : 0u);
+	}
+
+	//cascade matrices for the per blade shadow culling in grass_animate.comp
+	AllocatedBuffer& shadowCascadeBuffer = getCurrentFrame().grassShadowCascadeBuffer;
+	reserveBuffer(shadowCascadeBuffer, sizeof(GrassShadowCascade) * CSM_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	GrassShadowCascade* shadowCascades = (GrassShadowCascade*)shadowCascadeBuffer.allocation->GetMappedData();
+	for (int i = 0; i < CSM_COUNT; i++)
+	{
+		shadowCascades[i].viewProj = _shadowMapSceneData[i].viewProj;
+		shadowCascades[i].data = glm::vec4(GRASS_SHADOW_CASCADE_DENSITY[i], 0, 0, 0);
+	}
+
 	//TODO mayb we should just create a buffer every frame and fill it instead of storing in FrameData hmmm
 	//		then we dont have to update the framedata buffer AND this buffer when _grassCount changes.
 	_grassDataDescriptorSet = getCurrentFrame().descriptorAllocator.allocate(_device, _grassDataDescriptorLayout, nullptr);
 	DescriptorWriter writer;
 	writer.writeBuffer(0, _grassDataBuffer.buffer, sizeof(GrassData) * _grassCount, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-	writer.writeImage(1, _windMapImage.imageView, nullptr, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.writeImage(1, _windMapImage.imageView, _linearRepeatSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.writeBuffer(2, _grassPatternBuffer.buffer, sizeof(glm::vec4) * _grassTiles.bladesPerTile(), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(3, _grassIndirectBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(4, _grassAnimatedBuffer.buffer, sizeof(AnimatedGrassBlade) * _grassCount, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(5, visibleSlotBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(6, shadowCascadeBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(7, _grassShadowInstanceBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(8, _grassShadowIndirectBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(9, _grassLodInstanceBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(10, _grassLodIndirectBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 	writer.updateSet(_device, _grassDataDescriptorSet);
 
+	if (dirtyTiles.empty()) return;
+	generateGrassTiles(cmd, dirtyTiles, _grassTiles.bladesPerTile(), _grassDataBuffer, _grassIndirectBuffer, _grassDataDescriptorSet);
+}
 
-	ComputePushConstants pushConstants;
-	pushConstants.data1 = glm::vec4(_player._position.x, _player._position.y, _player._position.z, 1);
-	pushConstants.data2 = glm::vec4(_grassCount, _maxGrassDistance, _grassDensity, 0);
+void VulkanEngine::generateGrassTiles(VkCommandBuffer cmd, const std::vector<GrassTilePool::Tile>& tiles, uint32_t bladesPerTile,
+	const AllocatedBuffer& dataBuffer, const AllocatedBuffer& indirectBuffer, VkDescriptorSet descriptorSet)
+{
+	//stages that read the indirect commands
+	VkPipelineStageFlags2 commandStages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	if (_meshShaderSupported)
+		commandStages |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+
+	//reused slots and build buffers that were live before may still be read by the previous frame's grass_animate.comp and grass draws
+	vkutil::bufferBarrier(cmd, dataBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR);
+	vkutil::bufferBarrier(cmd, indirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		commandStages,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+	//reset the command of the dirty slots, the compute shader appends the accepted blades
+	//	note: the commands are not drawn, grass_animate.comp and grass.task only read the blade count of a slot
+	for (const GrassTilePool::Tile& tile : tiles)
+	{
+		VkDrawIndexedIndirectCommand command;
+		command.indexCount = _grassMesh->surfaces[0].count;
+		command.instanceCount = 0;
+		command.firstIndex = _grassMesh->surfaces[0].startIndex;
+		command.vertexOffset = 0;
+		command.firstInstance = tile.slot * bladesPerTile;
+		vkCmdUpdateBuffer(cmd, indirectBuffer.buffer, sizeof(command) * tile.slot, sizeof(command), &command);
+	}
+	vkutil::bufferBarrier(cmd, indirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT);
 
 	VkDescriptorSet descriptorSets[] = {
-		_grassDataDescriptorSet,
-		_heightMapDescriptorSet
+		descriptorSet,
+		_terrainTilesDescriptorSet
 	};
 	//bind the gradient drawing compute pipeline
 	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _grassComputePipeline);
 
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _grassComputePipelineLayout, 0, 2, descriptorSets, 0, nullptr);
-	vkCmdPushConstants(cmd, _grassComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-	//execute compute pipeline dispatch
-	vkCmdDispatch(cmd, std::ceil((float)(_grassCount) / 64.0),
-		1, 1);
 
-	vkutil::bufferBarrier(cmd, _grassDataBuffer.buffer, VK_WHOLE_SIZE, 0,
+	GrassTilePushConstants pushConstants;
+	for (const GrassTilePool::Tile& tile : tiles)
+	{
+		pushConstants.tileData = glm::vec4(tile.coord.x * GRASS_TILE_SIZE, tile.coord.y * GRASS_TILE_SIZE, GRASS_TILE_SIZE, 0);
+		pushConstants.instanceData = glm::uvec4(tile.slot * bladesPerTile, bladesPerTile, tile.slot, 0);
+
+		vkCmdPushConstants(cmd, _grassComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GrassTilePushConstants), &pushConstants);
+		//execute compute pipeline dispatch
+		vkCmdDispatch(cmd, std::ceil((float)(bladesPerTile) / 64.0),
+			1, 1);
+	}
+
+	//positions are read by grass_animate.comp, indirect commands by the draws and grass.task
+	vkutil::bufferBarrier(cmd, dataBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR);
+	vkutil::bufferBarrier(cmd, indirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		commandStages,
+		VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT);
+}
+
+void VulkanEngine::reportGrassRebuild()
+{
+	//gpu times of the rebuild frames come back FRAME_OVERLAP frames late
+	float gpuTime = _gpuTimer.lastTime(_grassRebuildTimer);
+	if (gpuTime >= 0)
+	{
+		_grassRebuildStats.gpuTime += gpuTime;
+		_grassRebuildStats.maxGpuTime = std::max(_grassRebuildStats.maxGpuTime, gpuTime);
+		_grassRebuildStats.gpuFrames++;
+	}
+
+	bool gpuDone = _grassRebuildStats.gpuFrames >= _grassRebuildStats.frames || !_gpuTimer.supported();
+	if (_grassBuilding || _grassRebuildStats.frames == 0 || _grassRebuildStats.reported || !gpuDone) return;
+	_grassRebuildStats.reported = true;
+	fmt::print("grass rebuild ({}): {} blades over {} frames, pattern {:.2f} ms {}, render thread {:.2f} ms total {:.2f} ms worst frame, gpu {:.2f} ms total {:.2f} ms worst frame\n",
+		_grassRebuildStats.inlinePath ? "inline" : "background", _grassRebuildStats.blades, _grassRebuildStats.frames,
+		_grassRebuildStats.patternTime, _grassRebuildStats.inlinePath ? "on the render thread" : "off the render thread",
+		_grassRebuildStats.cpuTime, _grassRebuildStats.maxCpuTime, _grassRebuildStats.gpuTime, _grassRebuildStats.maxGpuTime);
+}
+
+void VulkanEngine::animateGrass(VkCommandBuffer cmd)
+{
+	//animate every visible blade once, the main pass and all shadow cascades draw from _grassAnimatedBuffer
+
+	//reset the per cascade shadow draws and the per lod main pass draws, grass_animate.comp appends the blades of each list
+	vkutil::bufferBarrier(cmd, _grassShadowIndirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	vkutil::bufferBarrier(cmd, _grassLodIndirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	VkDrawIndexedIndirectCommand shadowCommands[CSM_COUNT];
+	for (int i = 0; i < CSM_COUNT; i++)
+	{
+		shadowCommands[i].indexCount = _lowQualityGrassMesh->surfaces[0].count;
+		shadowCommands[i].instanceCount = 0;
+		shadowCommands[i].firstIndex = _lowQualityGrassMesh->surfaces[0].startIndex;
+		shadowCommands[i].vertexOffset = 0;
+		shadowCommands[i].firstInstance = i * _grassCount;
+	}
+	vkCmdUpdateBuffer(cmd, _grassShadowIndirectBuffer.buffer, 0, sizeof(shadowCommands), shadowCommands);
+	vkutil::bufferBarrier(cmd, _grassShadowIndirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	//	note: every lod only draws its own index range, far blades run 3 vertices instead of collapsing 9
+	VkDrawIndexedIndirectCommand lodCommands[GRASS_LOD_COUNT];
+	for (int i = 0; i < GRASS_LOD_COUNT; i++)
+	{
+		lodCommands[i].indexCount = _grassMesh->surfaces[i].count;
+		lodCommands[i].instanceCount = 0;
+		lodCommands[i].firstIndex = _grassMesh->surfaces[i].startIndex;
+		lodCommands[i].vertexOffset = 0;
+		lodCommands[i].firstInstance = i * _grassCount;
+	}
+	vkCmdUpdateBuffer(cmd, _grassLodIndirectBuffer.buffer, 0, sizeof(lodCommands), lodCommands);
+	vkutil::bufferBarrier(cmd, _grassLodIndirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+
+	if (_grassVisibleSlotCount == 0) return;
+
+	//the mesh shader path reads the animated blades in the task and mesh stages
+	VkPipelineStageFlags2 drawStages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR;
+	if (_meshShaderSupported)
+		drawStages |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+
+	//previous frame's grass draws may still be reading the animated blades
+	vkutil::bufferBarrier(cmd, _grassAnimatedBuffer.buffer, VK_WHOLE_SIZE, 0,
+		drawStages,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_SHADER_WRITE_BIT);
+	vkutil::bufferBarrier(cmd, _grassShadowInstanceBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_SHADER_WRITE_BIT);
+	vkutil::bufferBarrier(cmd, _grassLodInstanceBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_ACCESS_2_NONE, VK_ACCESS_2_SHADER_WRITE_BIT);
+	//wind map is written by updateWindMap
+	vkutil::transitionImage(cmd, _windMapImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR);
+
+	ComputePushConstants pushConstants;
+	pushConstants.data1 = glm::vec4(_player._position.x, _player._position.y, _player._position.z, _time);
+	pushConstants.data2 = glm::vec4(std::max(0, _maxGrassDistance - _grassFarFieldBlend), _maxGrassDistance, _grassTiles.bladesPerTile(), 0);
+	pushConstants.data3 = glm::vec4(GRASS_SEGMENT_LOD_DISTANCES[0], GRASS_SEGMENT_LOD_DISTANCES[1], _windVelocity.x, _windVelocity.y);
+	//blend the two complete wind keys by how far the next one is built
+	float windBlend = (float)_windBuildRow / _windMapImage.imageExtent.height;
+	pushConstants.data4 = glm::vec4(0);
+	pushConstants.data4[(_windBuildKey - 2) % 3] = 1 - windBlend;
+	pushConstants.data4[(_windBuildKey - 1) % 3] = windBlend;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _grassAnimatePipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _grassAnimatePipelineLayout, 0, 1, &_grassDataDescriptorSet, 0, nullptr);
+	vkCmdPushConstants(cmd, _grassAnimatePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+	vkCmdDispatch(cmd, std::ceil((float)(_grassTiles.bladesPerTile()) / 64.0), _grassVisibleSlotCount, 1);
+
+	vkutil::bufferBarrier(cmd, _grassAnimatedBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		drawStages);
+	vkutil::bufferBarrier(cmd, _grassShadowInstanceBuffer.buffer, VK_WHOLE_SIZE, 0,
 		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
 		VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR);
+	vkutil::bufferBarrier(cmd, _grassShadowIndirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+		VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	vkutil::bufferBarrier(cmd, _grassLodInstanceBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR);
+	vkutil::bufferBarrier(cmd, _grassLodIndirectBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+		VK_ACCESS_2_SHADER_WRITE_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+}
+
+void VulkanEngine::updateTerrainPatches()
+{
+	//lod ranges follow the screen space error, so they change with the resolution and the slider
+	float projectionScale = 0.5f * _drawExtent.height * std::abs(_sceneData.proj[1][1]);
+	_terrainLod.setScreenSpaceError(projectionScale, _terrainPixelError);
+
+	//select once per view, every view gets its own range of the patch buffer
+	std::vector<TerrainPatch> patches;
+	for (int view = 0; view < 1 + CSM_COUNT; view++)
+	{
+		const glm::mat4& viewProj = view == 0 ? _sceneData.viewProj : _shadowMapSceneData[view - 1].viewProj;
+		_terrainPatchRanges[view].firstPatch = (uint32_t)patches.size();
+		//cached cascades keep the terrain depth they already have
+		bool isCached = view > 0 && !_shadowCascadeRefresh[view - 1];
+		_terrainPatchRanges[view].patchCount = isCached ? 0 : _terrainLod.select(_player._position, Frustum(viewProj), patches);
+		for (size_t i = _terrainPatchRanges[view].firstPatch; i < patches.size(); i++)
+		{
+			patches[i].morph.z = (float)std::max(view - 1, 0);
+		}
+	}
+
+	//	note: the selection is bounded by the view distance, so the buffer settles at the largest selection seen
+	AllocatedBuffer& patchBuffer = getCurrentFrame().terrainPatchBuffer;
+	reserveBuffer(patchBuffer, sizeof(TerrainPatch) * std::max((size_t)1, patches.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	memcpy(patchBuffer.allocation->GetMappedData(), patches.data(), sizeof(TerrainPatch) * patches.size());
+
+	_terrainDescriptorSet = getCurrentFrame().descriptorAllocator.allocate(_device, _terrainDescriptorLayout, nullptr);
+	DescriptorWriter writer;
+	writer.writeBuffer(0, patchBuffer.buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.updateSet(_device, _terrainDescriptorSet);
+}
+
+void VulkanEngine::streamTerrainTiles(VkCommandBuffer cmd, int maxUploads, bool wait)
+{
+	//assigns layers to the nearest missing tiles, the worker copies them out of the mapped file into the staging ring
+	//	and the GPU copies are recorded once a tile is finished, so the render thread never waits for the file's pages
+	int tileCount = _terrainTileFile.tileCount();
+	_terrainTileCache.update(_player._position);
+	for (const TerrainTileCache::Upload& upload : _terrainTileCache.takeUploads(maxUploads))
+	{
+		_terrainWaitingUploads.push_back(upload);
+		_terrainPendingCopies[upload.tile.x + upload.tile.y * tileCount]++;
+	}
+
+	size_t tileBytes = _terrainTileFile.tileBytes();
+	uint8_t* stagingData = (uint8_t*)_terrainStagingBuffer.allocation->GetMappedData();
+	while (!_terrainWaitingUploads.empty() && !_terrainFreeStagingSlots.empty())
+	{
+		TerrainTileCache::Upload upload = _terrainWaitingUploads.front();
+		_terrainWaitingUploads.pop_front();
+		uint32_t slot = _terrainFreeStagingSlots.back();
+		_terrainFreeStagingSlots.pop_back();
+		_terrainTileStreamer.request({ upload.tile, upload.layer, slot, stagingData + tileBytes * slot });
+	}
+	if (wait) _terrainTileStreamer.waitIdle();
+
+	//a file tile is its heights followed by its normals, one copy into each cache
+	//	tiles that lost their layer while the worker copied them are dropped
+	const std::vector<int32_t>& layerTable = _terrainTileCache.layerTable();
+	std::vector<TerrainTileStreamer::Request> finished = _terrainTileStreamer.takeFinished();
+	std::vector<VkBufferImageCopy> heightCopies;
+	std::vector<VkBufferImageCopy> normalCopies;
+	std::vector<uint32_t> copiedSlots;
+	for (const TerrainTileStreamer::Request& request : finished)
+	{
+		int tile = request.tile.x + request.tile.y * tileCount;
+		_terrainPendingCopies[tile]--;
+		if (layerTable[tile] != (int32_t)request.layer)
+		{
+			_terrainFreeStagingSlots.push_back(request.slot);
+			continue;
+		}
+
+		VkBufferImageCopy copy{};
+		copy.bufferOffset = tileBytes * request.slot;
+		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.imageSubresource.baseArrayLayer = request.layer;
+		copy.imageSubresource.layerCount = 1;
+		copy.imageExtent = _terrainHeightCacheImage.imageExtent;
+		heightCopies.push_back(copy);
+		copy.bufferOffset += _terrainTileFile.tileHeightBytes();
+		normalCopies.push_back(copy);
+		copiedSlots.push_back(request.slot);
+	}
+	bool tableChanged = _terrainTileCache.takeTableChanged();
+	if (!tableChanged && finished.empty()) return;
+
+	//the slots are free again once this frame is done with them
+	getCurrentFrame().deletionQueue.pushFunction(
+		[=, this]() {
+			_terrainFreeStagingSlots.insert(_terrainFreeStagingSlots.end(), copiedSlots.begin(), copiedSlots.end());
+		}
+	);
+
+	//tiles stay on the overview until their copy is recorded
+	std::vector<int32_t> table = layerTable;
+	for (size_t i = 0; i < table.size(); i++)
+	{
+		if (_terrainPendingCopies[i] > 0) table[i] = -1;
+	}
+	//	note: the frame that last used this frame's table region finished before its slot came around again
+	size_t tableBytes = sizeof(int32_t) * table.size();
+	size_t tableStagingOffset = tileBytes * TERRAIN_STAGING_SLOTS + tableBytes * (_frameNumber % FRAME_OVERLAP);
+	memcpy(stagingData + tableStagingOffset, table.data(), tableBytes);
+
+	//	note: the previous frame may still sample the layers that get replaced, the barriers wait for it
+	const VkPipelineStageFlags2 readerStages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	if (!copiedSlots.empty())
+	{
+		for (auto [image, copies] : { std::pair{ &_terrainHeightCacheImage, &heightCopies }, std::pair{ &_terrainNormalCacheImage, &normalCopies } })
+		{
+			vkutil::transitionImage(cmd, image->image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				readerStages, VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR);
+			vkCmdCopyBufferToImage(cmd, _terrainStagingBuffer.buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)copies->size(), copies->data());
+			vkutil::transitionImage(cmd, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, readerStages);
+		}
+	}
+
+	vkutil::bufferBarrier(cmd, _terrainTileTableBuffer.buffer, VK_WHOLE_SIZE, 0,
+		readerStages, VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+		VK_ACCESS_2_SHADER_READ_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	VkBufferCopy tableCopy{};
+	tableCopy.srcOffset = tableStagingOffset;
+	tableCopy.dstOffset = sizeof(glm::ivec4) + sizeof(glm::vec4);
+	tableCopy.size = tableBytes;
+	vkCmdCopyBuffer(cmd, _terrainStagingBuffer.buffer, _terrainTileTableBuffer.buffer, 1, &tableCopy);
+	vkutil::bufferBarrier(cmd, _terrainTileTableBuffer.buffer, VK_WHOLE_SIZE, 0,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, readerStages,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_SHADER_READ_BIT);
+}
+
+void VulkanEngine::drawGrassLods(VkCommandBuffer cmd)
+{
+	//	note: pipeline, descriptor sets, push constants and index buffer have to be bound already
+	//the lod lists only hold blades of slots visible in the main view, see animateGrass
+	vkCmdDrawIndexedIndirect(cmd, _grassLodIndirectBuffer.buffer, 0, GRASS_LOD_COUNT, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void VulkanEngine::drawGrassMeshTasks(VkCommandBuffer cmd, int view, GPUDrawPushConstants& pushConstants)
+{
+	//	note: _grassMeshPipeline and descriptor sets have to be bound already
+	//one task workgroup per 32 blades of a slot, must match GRASS_CLUSTER_SIZE in _grassMeshlet.glsl
+	uint32_t clustersPerTile = (_grassTiles.bladesPerTile() + 31) / 32;
+	for (const GrassTilePool::DrawRange& range : _grassDrawRanges[view])
+	{
+		pushConstants.data = glm::vec4(range.firstSlot, _grassMeshLodDistance, 0, 0);
+		vkCmdPushConstants(cmd, _grassMeshPipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+		_vkCmdDrawMeshTasksEXT(cmd, clustersPerTile, range.slotCount, 1);
+	}
+	pushConstants.data = glm::vec4(0);
 }
 
 void VulkanEngine::run()
@@ -673,26 +1537,116 @@ void VulkanEngine::run()
 		{
 			ImGui::SliderInt("density", &UI_grassDensity, 1, 40);
 			ImGui::SliderInt("distance", &UI_maxGrassDistance, 1, 300);
-			ImGui::Text("grassCount: %d", _grassCount);
+			//	note: at least 1, smoothstep is undefined when both edges meet
+			ImGui::SliderInt("far field blend", &_grassFarFieldBlend, 1, 100);
+			if (_meshShaderSupported)
+			{
+				ImGui::Checkbox("mesh shader grass", &_useMeshShaderGrass);
+				ImGui::SliderInt("mesh shader lod distance", &_grassMeshLodDistance, 0, 300);
+			}
+			else
+				ImGui::Text("mesh shaders not supported, using instanced grass");
+			ImGui::Checkbox("visibility buffer", &_useVisibilityBuffer);
+			ImGui::Text("grassCount (max): %d", _grassCount);
+			ImGui::Text("grass tiles: %d visible / %d resident / %d capacity", UI_visibleGrassTiles, _grassTiles.residentCount(), _grassTiles.capacity());
 			ImGui::Text("tris: %d", UI_triangleCount);
 
 			if (ImGui::Button("Apply Changes"))
 				_settingsChanged = true;
+			ImGui::Checkbox("rebuild inline (comparison)", &_grassRebuildInline);
+			if (_grassPatternFuture.valid() || _grassBuilding)
+				ImGui::Text("rebuilding grass...");
+			if (_grassRebuildStats.reported)
+			{
+				ImGui::Text("last rebuild (%s): %d frames", _grassRebuildStats.inlinePath ? "inline" : "background", _grassRebuildStats.frames);
+				ImGui::Text("  pattern %.2f ms, cpu %.2f ms (worst frame %.2f ms)", _grassRebuildStats.patternTime, _grassRebuildStats.cpuTime, _grassRebuildStats.maxCpuTime);
+				ImGui::Text("  gpu %.2f ms (worst frame %.2f ms)", _grassRebuildStats.gpuTime, _grassRebuildStats.maxGpuTime);
+			}
 
 			ImGui::Checkbox("Day/Night Cycle", &_isSunMoving);
 			ImGui::End();
 		}
 
+		if (ImGui::Begin("terrain"))
+		{
+			ImGui::SliderFloat("pixel error", &_terrainPixelError, 0.25f, 16.f);
+			ImGui::Text("patches: %d (%d tris)", _terrainPatchRanges[0].patchCount, _terrainPatchRanges[0].patchCount * TerrainLod::PATCH_RESOLUTION * TerrainLod::PATCH_RESOLUTION * 2);
+			ImGui::Text("lod 0 range: %.1f m", _terrainLod.levelCount() > 0 ? _terrainLod.lodRange(0) : 0.f);
+			ImGui::Text("tiles: %d/%d resident, %d queued", _terrainTileCache.residentCount(), _terrainTileCache.layerCount(), _terrainTileCache.queuedCount());
+			ImGui::Text("heights: %.1f m .. %.1f m", _terrainTileFile.heightBias(), _terrainTileFile.heightBias() + _terrainTileFile.heightScale());
+			ImGui::Image((ImTextureID)_terrainOverviewSamplerDescriptorSet, ImVec2(300, 300));
+			ImGui::End();
+		}
+
+		if (ImGui::Begin("shadows"))
+		{
+			ImGui::SliderFloat("split lambda", &_shadowSplitLambda, 0.f, 1.f);
+			ImGui::Checkbox("half resolution mask", &_shadowMaskHalfResolution);
+			//	note: the static depth is only timed in frames that refresh a cascade
+			float staticTime = _gpuTimer.lastTime(_shadowStaticTimer);
+			if (staticTime >= 0) ImGui::Text("gpu static depth: %.3f ms", staticTime);
+			else ImGui::Text("gpu static depth: cached");
+			ImGui::Text("gpu grass depth: %.3f ms", _gpuTimer.lastTime(_shadowGrassTimer));
+			ImGui::End();
+		}
+
+		if (ImGui::Begin("quality"))
+		{
+			//	note: every new combination of settings compiles its pipelines once, the first frame that uses it
+			if (ImGui::BeginCombo("preset", _qualityPreset >= 0 ? QUALITY_PRESETS[_qualityPreset].name : "custom"))
+			{
+				for (int i = 0; i < (int)std::size(QUALITY_PRESETS); i++)
+				{
+					if (ImGui::Selectable(QUALITY_PRESETS[i].name, i == _qualityPreset) && i != _qualityPreset)
+					{
+						_qualityPreset = i;
+						_quality = QUALITY_PRESETS[i].settings;
+						_qualityEdit = _quality;
+						_qualityPresetChanged = true;
+					}
+				}
+				ImGui::EndCombo();
+			}
+			//	note: a slider only applies its value when it is released, dragging would compile a pipeline per step
+			bool changed = false;
+			ImGui::SliderInt("reflection steps", &_qualityEdit.reflectionSteps, 8, 128);
+			changed |= ImGui::IsItemDeactivatedAfterEdit();
+			ImGui::SliderInt("reflection refine steps", &_qualityEdit.reflectionRefineSteps, 0, 32);
+			changed |= ImGui::IsItemDeactivatedAfterEdit();
+			ImGui::SliderInt("cloud steps", &_qualityEdit.cloudSteps, 10, 150);
+			changed |= ImGui::IsItemDeactivatedAfterEdit();
+			ImGui::SliderInt("cloud light steps", &_qualityEdit.cloudLightSteps, 1, 16);
+			changed |= ImGui::IsItemDeactivatedAfterEdit();
+			ImGui::SliderInt("pcf radius", &_qualityEdit.shadowFilterRadius, 0, 3);
+			changed |= ImGui::IsItemDeactivatedAfterEdit();
+			if (changed)
+			{
+				_quality = _qualityEdit;
+				_qualityPreset = -1;
+			}
+			ImGui::End();
+		}
+
+		if (ImGui::Begin("reflections"))
+		{
+			ImGui::Checkbox("half resolution hi-z", &_useHiZReflections);
+			ImGui::End();
+		}
+
 		if (ImGui::Begin("stats"))
 		{
 			ImGui::Text("frame time: %f ms", _engineStats.frameTime);
 			ImGui::Text("fps: %f", _engineStats.fps);
+			std::string refreshedCascades;
+			for (bool refreshed : _shadowCascadeRefresh) refreshedCascades += refreshed ? '1' : '0';
+			ImGui::Text("shadow cascades refreshed: %s", refreshedCascades.c_str());
 
 			ImGui::End();
 		}
 
 		if (ImGui::Begin("wind map"))
 		{
+			ImGui::SliderInt("frames per key", &_windKeyFrames, 1, 120);
 			ImGui::Image((ImTextureID)_windMapSamplerDescriptorSet, ImVec2(600,600));
 			ImGui::End();
 		}
@@ -734,6 +1688,76 @@ void VulkanEngine::immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& fu
 	VK_CHECK(vkWaitForFences(_device, 1, &_immFence, true, 9999999999));
 }
 
+void VulkanEngine::generateCachedImages(const std::string& name, const AssetCache::Key& key, const std::vector<AllocatedImage*>& images,
+	std::function<void(VkCommandBuffer cmd)>&& generate)
+{
+	auto texelSize = [](VkFormat format) -> size_t {
+		switch (format)
+		{
+		case VK_FORMAT_R8_UNORM: return 1;
+		case VK_FORMAT_R16_SFLOAT: return 2;
+		case VK_FORMAT_R8G8B8A8_UNORM: return 4;
+		case VK_FORMAT_R32_SFLOAT: return 4;
+		case VK_FORMAT_R16G16B16A16_SFLOAT: return 8;
+		case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+		default: assert(false && "unsupported cached image format"); return 0;
+		}
+		};
+
+	//all images back to back in one blob
+	std::vector<size_t> offsets;
+	size_t totalSize = 0;
+	for (AllocatedImage* image : images)
+	{
+		offsets.push_back(totalSize);
+		totalSize += texelSize(image->imageFormat) * image->imageExtent.width * image->imageExtent.height * image->imageExtent.depth;
+	}
+
+	auto start = std::chrono::system_clock::now();
+	std::vector<uint8_t> cached;
+	bool hit = _assetCache.load(name, key, cached) && cached.size() == totalSize;
+
+	AllocatedBuffer staging = hit ?
+		createBuffer(totalSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU) :
+		createBuffer(totalSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+	if (hit) memcpy(staging.allocation->GetMappedData(), cached.data(), totalSize);
+
+	immediateSubmit([&](VkCommandBuffer cmd) {
+		if (!hit) generate(cmd);
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			VkBufferImageCopy copy{};
+			copy.bufferOffset = offsets[i];
+			copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.imageSubresource.layerCount = 1;
+			copy.imageExtent = images[i]->imageExtent;
+			if (hit)
+			{
+				vkutil::transitionImage(cmd, images[i]->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+				vkCmdCopyBufferToImage(cmd, staging.buffer, images[i]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+				vkutil::transitionImage(cmd, images[i]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+			}
+			else
+			{
+				//wait for the generator to finish writing
+				vkutil::transitionImage(cmd, images[i]->image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+				vkCmdCopyImageToBuffer(cmd, images[i]->image, VK_IMAGE_LAYOUT_GENERAL, staging.buffer, 1, &copy);
+			}
+		}
+		});
+
+	if (!hit)
+	{
+		vmaInvalidateAllocation(_allocator, staging.allocation, 0, VK_WHOLE_SIZE);
+		_assetCache.store(name, key, staging.allocation->GetMappedData(), totalSize);
+	}
+	destroyBuffer(staging);
+
+	auto end = std::chrono::system_clock::now();
+	fmt::print("{}: {} {} KB in {:.2f} ms\n", name, hit ? "loaded" : "generated and cached", totalSize / 1024,
+		std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.f);
+}
+
 AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
 {
 	//allocate buffer
@@ -750,9 +1774,31 @@ AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags
 	
 	AllocatedBuffer newBuffer;
 	VK_CHECK(vmaCreateBuffer(_allocator, &bufferInfo, &vmaAllocInfo, &newBuffer.buffer, &newBuffer.allocation, &newBuffer.allocationInfo));
+	newBuffer.size = allocSize;
 	return newBuffer;
 }
 
+bool VulkanEngine::reserveBuffer(AllocatedBuffer& buffer, size_t requiredSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
+{
+	//grows geometrically and only shrinks once less than a quarter is used, so small changes keep the buffer
+	if (buffer.buffer != VK_NULL_HANDLE && requiredSize <= buffer.size && requiredSize * 4 >= buffer.size)
+		return false;
+
+	//	note: frames in flight may still use the old buffer
+	if (buffer.buffer != VK_NULL_HANDLE)
+	{
+		AllocatedBuffer oldBuffer = buffer;
+		getCurrentFrame().deletionQueue.pushFunction(
+			[=, this]() {
+				destroyBuffer(oldBuffer);
+			}
+		);
+	}
+	size_t newSize = requiredSize > buffer.size ? std::max(requiredSize, buffer.size * 3 / 2) : requiredSize * 3 / 2;
+	buffer = createBuffer(std::max<size_t>(newSize, 1), usage, memoryUsage);
+	return true;
+}
+
 void VulkanEngine::destroyBuffer(const AllocatedBuffer& buffer)
 {
 	vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
@@ -824,46 +1870,136 @@ void VulkanEngine::updateScene(float deltaTime)
 	_time += deltaTime;
 	_player.update(deltaTime);
 	_sceneData.view = _player.getViewMatrix();
+	_sceneData.previousViewProj = _sceneData.viewProj;
 	_sceneData.viewProj = _sceneData.proj * _sceneData.view;
+	_sceneData.inverseViewProj = glm::inverse(_sceneData.viewProj);
 	if (_isSunMoving)
 	{
 		_sceneData.sunlightDirection = glm::rotate(_time * 0.3f, glm::vec3(1, 0, 0)) * glm::vec4(1, 1, 0, 1);
 		_sceneData.sunlightDirection.w = -_sceneData.sunlightDirection.y;
 	}
 
+	updateShadowCascades();
+	_sceneData.time = glm::vec4(_time, _time / 2, 0, 0);
+}
 
+void VulkanEngine::updateShadowCascades()
+{
+	//every cascade is fitted to a bounding sphere around its slice of the view frustum, the splits blend
+	//	between uniform and logarithmic distances (_shadowSplitLambda). the sphere does not change size when the
+	//	camera rotates, and the projection is snapped to whole shadow texels, so the shadows do not shimmer
+	glm::mat4 cameraToWorld = glm::inverse(_sceneData.view);
+	glm::vec2 tanHalfFov = glm::vec2(1.f / std::abs(_sceneData.proj[0][0]), 1.f / std::abs(_sceneData.proj[1][1]));
+	glm::vec3 sliceCenter[CSM_COUNT];
+	float sliceRadius[CSM_COUNT];
+	float sliceNear = CAMERA_NEAR_PLANE;
+	for (int i = 0; i < CSM_COUNT; i++)
+	{
+		float t = (i + 1) / (float)CSM_COUNT;
+		float uniformSplit = CAMERA_NEAR_PLANE + (SHADOW_DISTANCE - CAMERA_NEAR_PLANE) * t;
+		float logSplit = CAMERA_NEAR_PLANE * std::pow(SHADOW_DISTANCE / CAMERA_NEAR_PLANE, t);
+		float sliceFar = glm::mix(uniformSplit, logSplit, _shadowSplitLambda);
+
+		glm::vec3 corners[8];
+		glm::vec3 center = glm::vec3(0);
+		for (int c = 0; c < 8; c++)
+		{
+			float depth = c < 4 ? sliceNear : sliceFar;
+			glm::vec2 xy = glm::vec2(c & 1 ? 1 : -1, c & 2 ? 1 : -1) * tanHalfFov * depth;
+			corners[c] = glm::vec3(cameraToWorld * glm::vec4(xy, -depth, 1));
+			center += corners[c] / 8.f;
+		}
+		float radius = 0;
+		for (glm::vec3 corner : corners) radius = std::max(radius, glm::distance(corner, center));
+		//	note: rounded up so float noise in the corners does not change the cascade size between frames
+		sliceRadius[i] = std::ceil(radius * 16.f) / 16.f;
+		sliceCenter[i] = center;
+		sliceNear = sliceFar;
+	}
 
-	_sunPosition = glm::vec3(-50 * _sceneData.sunlightDirection.x + _player._position.x,
-		-50 * _sceneData.sunlightDirection.y,
-		-50 * _sceneData.sunlightDirection.z + _player._position.z);
+	//cascades keep the matrix they were last refreshed with until they get too old, or the sun or the slice moved too far
+	//	the near cascade refreshes every frame, of the others at most one per frame so the cost is spread out
+	//	note: cascades that were never drawn always refresh, so the first frame has all of them
+	glm::vec3 sunDirection = glm::normalize(glm::vec3(_sceneData.sunlightDirection));
+	float maxSunCos = std::cos(glm::radians(SHADOW_CASCADE_MAX_SUN_ANGLE));
+	int stalestCascade = -1;
+	for (int i = 0; i < CSM_COUNT; i++)
+	{
+		const ShadowCascadeCache& cache = _shadowCascadeCache[i];
+		bool stale = cache.refreshFrame < 0
+			|| _frameNumber - cache.refreshFrame >= SHADOW_CASCADE_UPDATE_INTERVAL[i]
+			|| glm::distance(sliceCenter[i], cache.center) > SHADOW_CASCADE_MAX_DRIFT * sliceRadius[i]
+			|| sliceRadius[i] != cache.radius
+			|| glm::dot(cache.sunDirection, sunDirection) < maxSunCos;
+
+		_shadowCascadeRefresh[i] = stale && (i == 0 || cache.refreshFrame < 0);
+		if (stale && !_shadowCascadeRefresh[i] && (stalestCascade < 0 || cache.refreshFrame < _shadowCascadeCache[stalestCascade].refreshFrame))
+			stalestCascade = i;
+	}
+	if (stalestCascade >= 0) _shadowCascadeRefresh[stalestCascade] = true;
 
 	for (int i = 0; i < CSM_COUNT; i++)
 	{
-		_shadowMapSceneData[i].view = glm::lookAt(_sunPosition,
-			glm::vec3(_player._position.x, 2, _player._position.z), glm::vec3(0, 1, 0));
-		_shadowMapSceneData[i].viewProj = _shadowMapSceneData[i].proj * _shadowMapSceneData[i].view;
+		if (_shadowCascadeRefresh[i])
+		{
+			//cached cascades get a margin, so the slice stays covered while it drifts up to the refresh threshold
+			float radius = sliceRadius[i] * (SHADOW_CASCADE_UPDATE_INTERVAL[i] > 1 ? 1 + SHADOW_CASCADE_MAX_DRIFT : 1);
+			glm::vec3 up = std::abs(sunDirection.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+			glm::mat4 view = glm::lookAt(sliceCenter[i] - sunDirection, sliceCenter[i], up);
+			glm::mat4 proj = glm::ortho(-radius, radius, radius, -radius, -1050.f, 1050.f);
+
+			//move the projection so the world origin lands on a texel corner, every texel then covers the same
+			//	world area each frame and the edges do not crawl when the camera moves
+			float texelsPerUnit = SHADOWMAP_RESOLUTION / 2.f;
+			glm::vec2 origin = glm::vec2(proj * view * glm::vec4(0, 0, 0, 1)) * texelsPerUnit;
+			glm::vec2 offset = (glm::round(origin) - origin) / texelsPerUnit;
+			proj[3][0] += offset.x;
+			proj[3][1] += offset.y;
+
+			_shadowMapSceneData[i].proj = proj;
+			_shadowMapSceneData[i].view = view;
+			_shadowMapSceneData[i].viewProj = proj * view;
+			_shadowCascadeCache[i] = ShadowCascadeCache{ sliceCenter[i], sliceRadius[i], sunDirection, _frameNumber };
+		}
 		_sceneData.sunViewProj[i] = _shadowMapSceneData[i].viewProj;
 	}
-	_sceneData.time = glm::vec4(_time, _time / 2, 0, 0);
 }
 
 void VulkanEngine::updateWindMap(VkCommandBuffer cmd)
 {
-	int numCells = _windMapImage.imageExtent.width * _windMapImage.imageExtent.height;
-
+	//wind changes slowly, so instead of the whole field only a slice of the next key is evaluated every frame
+	//	the blend between the two complete keys follows the build progress, see animateGrass
+	int mapHeight = _windMapImage.imageExtent.height;
+	int rowsPerFrame = (mapHeight + _windKeyFrames - 1) / _windKeyFrames;
+	int rowCount = std::min(rowsPerFrame, mapHeight - _windBuildRow);
+
+	_workgroupTuner.beginTiming(cmd, _windMapKernel);
+	dispatchWindRows(cmd, _windBuildKey % 3, _windKeyTimes[_windBuildKey % 3], _windBuildRow, rowCount);
+	_workgroupTuner.endTiming(cmd, _windMapKernel);
+	_windBuildRow += rowCount;
+	vkutil::transitionImage(cmd, _windMapImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+	if (_windBuildRow >= mapHeight)
+	{
+		//the oldest key is dropped and its channel is rebuilt one key interval after the newest one
+		_windBuildRow = 0;
+		_windBuildKey++;
+		float keyInterval = _windKeyFrames * _engineStats.frameTime / 1000.f;
+		_windKeyTimes[_windBuildKey % 3] = _windKeyTimes[(_windBuildKey - 1) % 3] + keyInterval;
+	}
+}
 
+void VulkanEngine::dispatchWindRows(VkCommandBuffer cmd, int channel, float keyTime, int firstRow, int rowCount)
+{
 	ComputePushConstants pushConstants;
-	pushConstants.data1 = glm::vec4(_time, 1, 1, 1);
+	pushConstants.data1 = glm::vec4(keyTime, channel, firstRow, rowCount);
 
-	//bind the gradient drawing compute pipeline
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _windMapComputePipeline);
+	WorkgroupSize size = _workgroupTuner.size(_windMapKernel);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _windMapComputePipelines.get(size));
 
 	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _windMapComputePipelineLayout, 0, 1, &_windMapDescriptorSet, 0, nullptr);
 	vkCmdPushConstants(cmd, _windMapComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
-	//execute compute pipeline dispatch
-	vkCmdDispatch(cmd, std::ceil((float)(numCells) / 64.0),
-		1, 1);
-
+	vkCmdDispatch(cmd, size.groupsX(_windMapImage.imageExtent.width), size.groupsY(rowCount), 1);
 }
 
 void VulkanEngine::initVulkan()
@@ -893,6 +2029,17 @@ void VulkanEngine::initVulkan()
 	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 	features12.bufferDeviceAddress = true;
 	features12.descriptorIndexing = true;
+	features12.shaderOutputLayer = true; //shadow cascades are routed to their layer in the vertex shader
+	features12.shaderOutputViewportIndex = true; //	note: required together with shaderOutputLayer by the SPIR-V capability glslang emits
+
+	VkPhysicalDeviceVulkan11Features features11{}; //vulkan 1.1 features
+	features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	features11.shaderDrawParameters = true; //gl_DrawID picks the cascade of the grass shadow draws
+
+	VkPhysicalDeviceFeatures features{}; //vulkan 1.0 features
+	features.multiDrawIndirect = true; //grass tiles are drawn with one indirect draw per run of slots
+	features.drawIndirectFirstInstance = true; //indirect grass draws start at the slot's instance range
+	features.shaderStorageImageExtendedFormats = true; //r16f shadow mask written by shadow_mask.comp
 
 	//use vkbootstrap to select GPU
 	//gpu must be able to write to SDL surface and support vk 1.3
@@ -901,17 +2048,51 @@ void VulkanEngine::initVulkan()
 		.set_minimum_version(1, 3)
 		.set_required_features_13(features13)
 		.set_required_features_12(features12)
+		.set_required_features_11(features11)
+		.set_required_features(features)
 		.set_surface(_surface)
 		.select()
 		.value();
 
+	//lets deferred.comp write the swapchain image, _finalDrawImage is resolved to it otherwise
+	VkPhysicalDeviceFeatures storageWriteFeatures{};
+	storageWriteFeatures.shaderStorageImageWriteWithoutFormat = true;
+	_storageWriteWithoutFormat = physicalDevice.enable_features_if_present(storageWriteFeatures);
+
+	//mesh shaders are optional, grass falls back to the instanced pipeline without them
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+	meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+	if (physicalDevice.is_extension_present(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2 supportedFeatures{};
+		supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures.pNext = &meshShaderFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &supportedFeatures);
+		_meshShaderSupported = meshShaderFeatures.taskShader && meshShaderFeatures.meshShader;
+	}
+	if (_meshShaderSupported)
+	{
+		physicalDevice.enable_extension_if_present(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+		//only enable what grass.task and grass.mesh use
+		meshShaderFeatures = {};
+		meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+		meshShaderFeatures.taskShader = true;
+		meshShaderFeatures.meshShader = true;
+	}
+	fmt::print("mesh shaders {}\n", _meshShaderSupported ? "supported" : "not supported, using instanced grass");
+
 	//create final vulkan logical device
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
+	if (_meshShaderSupported)
+		deviceBuilder.add_pNext(&meshShaderFeatures);
 	vkb::Device vkbDevice = deviceBuilder.build().value();
 
 	_device = vkbDevice.device;
 	_physicalDevice = physicalDevice.physical_device;
 
+	if (_meshShaderSupported)
+		_vkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(_device, "vkCmdDrawMeshTasksEXT");
+
 	//graphics queue
 	_graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	_graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
@@ -926,6 +2107,16 @@ void VulkanEngine::initVulkan()
 	_mainDeletionQueue.pushFunction([&]() {
 		vmaDestroyAllocator(_allocator);
 	});
+
+	//workgroup sizes, the kernels register themselves when their pipelines are built
+	_workgroupTuner.init(_device, _physicalDevice, _graphicsQueueFamily, &_assetCache, FRAME_OVERLAP);
+	_mainDeletionQueue.pushFunction([&]() {
+		_workgroupTuner.cleanup();
+	});
+	_gpuTimer.init(_device, _physicalDevice, _graphicsQueueFamily, FRAME_OVERLAP);
+	_mainDeletionQueue.pushFunction([&]() {
+		_gpuTimer.cleanup();
+	});
 }
 
 void VulkanEngine::initSwapchain()
@@ -977,6 +2168,24 @@ void VulkanEngine::initSwapchain()
 	VkImageCreateInfo finalDrawImageInfo = vkinit::imageCreateInfo(_finalDrawImage.imageFormat, drawImageUsageFlags, drawImageExtent);
 	vmaCreateImage(_allocator, &finalDrawImageInfo, &rimgAllocInfo, &_finalDrawImage.image, &_finalDrawImage.allocation, nullptr);
 
+	_shadowMaskImage.imageFormat = VK_FORMAT_R16_SFLOAT;
+	_shadowMaskImage.imageExtent = drawImageExtent;
+	VkImageCreateInfo shadowMaskImageInfo = vkinit::imageCreateInfo(_shadowMaskImage.imageFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, drawImageExtent);
+	vmaCreateImage(_allocator, &shadowMaskImageInfo, &rimgAllocInfo, &_shadowMaskImage.image, &_shadowMaskImage.allocation, nullptr);
+
+	{
+		_visibilityImage.imageFormat = VK_FORMAT_R32_UINT;
+		_visibilityImage.imageExtent = drawImageExtent;
+		VkImageCreateInfo visibilityImageInfo = vkinit::imageCreateInfo(_visibilityImage.imageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT, drawImageExtent);
+		vmaCreateImage(_allocator, &visibilityImageInfo, &rimgAllocInfo, &_visibilityImage.image, &_visibilityImage.allocation, nullptr);
+		VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(_visibilityImage.imageFormat, _visibilityImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &_visibilityImage.imageView));
+		_mainDeletionQueue.pushFunction([=, this]() {
+			vkDestroyImageView(_device, _visibilityImage.imageView, nullptr);
+			vmaDestroyImage(_allocator, _visibilityImage.image, _visibilityImage.allocation);
+			});
+	}
+
 	//build image view for the draw image to use for rendering
 	
 	{
@@ -999,6 +2208,10 @@ void VulkanEngine::initSwapchain()
 		VkImageViewCreateInfo rviewInfo = vkinit::imageViewCreateInfo(_finalDrawImage.imageFormat, _finalDrawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
 		VK_CHECK(vkCreateImageView(_device, &rviewInfo, nullptr, &_finalDrawImage.imageView));
 	}
+	{
+		VkImageViewCreateInfo rviewInfo = vkinit::imageViewCreateInfo(_shadowMaskImage.imageFormat, _shadowMaskImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		VK_CHECK(vkCreateImageView(_device, &rviewInfo, nullptr, &_shadowMaskImage.imageView));
+	}
 
 	//add to deletion queues
 	_mainDeletionQueue.pushFunction(
@@ -1013,6 +2226,8 @@ void VulkanEngine::initSwapchain()
 			vmaDestroyImage(_allocator, _specularMapImage.image, _specularMapImage.allocation); 
 			vkDestroyImageView(_device, _finalDrawImage.imageView, nullptr);
 			vmaDestroyImage(_allocator, _finalDrawImage.image, _finalDrawImage.allocation);
+			vkDestroyImageView(_device, _shadowMaskImage.imageView, nullptr);
+			vmaDestroyImage(_allocator, _shadowMaskImage.image, _shadowMaskImage.allocation);
 		});
 
 	//DEPTH IMAGE
@@ -1100,11 +2315,20 @@ void VulkanEngine::createSwapchain(uint32_t width, uint32_t height, VkPresentMod
 	surfaceFormat.format = _swapchainImageFormat;
 	surfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
 
+	//the deferred pass can shade straight into the swapchain if its images can be storage images
+	VkSurfaceCapabilitiesKHR surfaceCapabilities;
+	VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_physicalDevice, _surface, &surfaceCapabilities));
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(_physicalDevice, _swapchainImageFormat, &formatProperties);
+	_swapchainStorage = _storageWriteWithoutFormat &&
+		(surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) &&
+		(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+
 	vkb::Swapchain vkbSwapchain = swapchainBuilder
 		.set_desired_format(surfaceFormat)
 		.set_desired_present_mode(presentMode)
 		.set_desired_extent(width, height)
-		.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		.add_image_usage_flags(_swapchainStorage ? VK_IMAGE_USAGE_STORAGE_BIT : 0)
 		.build()
 		.value();
 
@@ -1153,32 +2377,78 @@ void VulkanEngine::initDescriptors()
 	_globalDescriptorAllocator.init(_device, 10, sizes);
 
 	//DESCRIPTOR LAYOUTS
+	//	note: mesh shader stages may only be used when the extension is enabled
+	VkShaderStageFlags meshShaderStages = _meshShaderSupported ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : 0;
 	//make the descriptor set layout for our compute draw
 	{
 		DescriptorLayoutBuilder builder;
-		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER); //reflections, written in initReflectionResources
+		_drawImageDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+		_sceneDataDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | meshShaderStages);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		builder.addBinding(10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		_grassDataDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT | meshShaderStages);
+	}
+	{
+		//height and normal tile caches and the indirection table, see _terrainTiles.glsl
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		builder.addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		builder.addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		builder.addBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		builder.addBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		_drawImageDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+		builder.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		_terrainTilesDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
 	}
 	{
 		DescriptorLayoutBuilder builder;
-		builder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-		_sceneDataDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		_terrainDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT);
 	}
 	{
+		//indirect dispatches and tile lists of the deferred pass, see _deferredTiles.glsl
 		DescriptorLayoutBuilder builder;
 		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-		builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-		_grassDataDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		_deferredTilesDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
 	}
 	{
+		//output of the deferred pass, allocated every frame since it may be the swapchain image
 		DescriptorLayoutBuilder builder;
 		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-		_heightMapDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+		_deferredOutputDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		_resolveDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_FRAGMENT_BIT);
+	}
+	{
+		//visibility buffer and the G-buffer targets, see grass_material.comp
+		DescriptorLayoutBuilder builder;
+		for (uint32_t binding = 0; binding < 5; binding++)
+			builder.addBinding(binding, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		_grassMaterialDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
 	}
 
 	//allocate a descriptor set for draw image
@@ -1191,8 +2461,35 @@ void VulkanEngine::initDescriptors()
 	writer.writeImage(3, _normalsImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 	writer.writeImage(4, _specularMapImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 	writer.writeImage(5, _positionsImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.writeImage(6, _shadowMaskImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 	writer.updateSet(_device, _drawImageDescriptors);
 
+	//every class can hold all tiles of the draw image
+	_deferredTileCapacity = ((_drawImage.imageExtent.width + 15) / 16) * ((_drawImage.imageExtent.height + 15) / 16);
+	_deferredDispatchBuffer = createBuffer(sizeof(VkDispatchIndirectCommand) * DEFERRED_TILE_CLASS_COUNT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	_deferredTileBuffer = createBuffer(sizeof(uint32_t) * _deferredTileCapacity * DEFERRED_TILE_CLASS_COUNT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	_deferredTilesDescriptorSet = _globalDescriptorAllocator.allocate(_device, _deferredTilesDescriptorLayout);
+	writer.clear();
+	writer.writeBuffer(0, _deferredDispatchBuffer.buffer, sizeof(VkDispatchIndirectCommand) * DEFERRED_TILE_CLASS_COUNT, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(1, _deferredTileBuffer.buffer, sizeof(uint32_t) * _deferredTileCapacity * DEFERRED_TILE_CLASS_COUNT, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.updateSet(_device, _deferredTilesDescriptorSet);
+
+	_resolveDescriptorSet = _globalDescriptorAllocator.allocate(_device, _resolveDescriptorLayout);
+	writer.clear();
+	writer.writeImage(0, _finalDrawImage.imageView, _linearSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.updateSet(_device, _resolveDescriptorSet);
+
+	_grassMaterialDescriptorSet = _globalDescriptorAllocator.allocate(_device, _grassMaterialDescriptorLayout);
+	writer.clear();
+	writer.writeImage(0, _visibilityImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.writeImage(1, _drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.writeImage(2, _normalsImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.writeImage(3, _specularMapImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.writeImage(4, _positionsImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.updateSet(_device, _grassMaterialDescriptorSet);
+
 	//frame descriptors
 	for (int i = 0; i < FRAME_OVERLAP; i++)
 	{
@@ -1221,7 +2518,14 @@ void VulkanEngine::initDescriptors()
 		vkDestroyDescriptorSetLayout(_device, _drawImageDescriptorLayout, nullptr);
 		vkDestroyDescriptorSetLayout(_device, _sceneDataDescriptorLayout, nullptr);
 		vkDestroyDescriptorSetLayout(_device, _grassDataDescriptorLayout, nullptr);
-		vkDestroyDescriptorSetLayout(_device, _heightMapDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _terrainTilesDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _terrainDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _deferredTilesDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _deferredOutputDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _resolveDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _grassMaterialDescriptorLayout, nullptr);
+		destroyBuffer(_deferredDispatchBuffer);
+		destroyBuffer(_deferredTileBuffer);
 	});
 }
 
@@ -1229,8 +2533,10 @@ void VulkanEngine::initPipelines()
 {
 	initBackgroundPipelines();
 	initDeferredPipelines();
+	initResolvePipeline();
 	initMeshPipeline();
 	initGrassPipeline();
+	initTerrainPipelines();
 }
 
 void VulkanEngine::initBackgroundPipelines()
@@ -1295,9 +2601,11 @@ void VulkanEngine::initDeferredPipelines()
 	VkDescriptorSetLayout layouts[] = {
 		_sceneDataDescriptorLayout,
 		_drawImageDescriptorLayout,
+		_deferredTilesDescriptorLayout,
+		_deferredOutputDescriptorLayout,
 	};
 	computeLayout.pSetLayouts = layouts;
-	computeLayout.setLayoutCount = 2;
+	computeLayout.setLayoutCount = 4;
 
 	VkPushConstantRange pushConstant{};
 	pushConstant.offset = 0;
@@ -1310,36 +2618,126 @@ void VulkanEngine::initDeferredPipelines()
 	VK_CHECK(vkCreatePipelineLayout(_device, &computeLayout, nullptr, &_deferredPipelineLayout));
 
 	//load shaders
-
+	//	note: the modules stay loaded, the permutations are built on first use of a quality setting
 	VkShaderModule deferredReflectionShader;
 	if (!vkutil::loadShaderModule("./shaders/deferred.comp.spv", _device, &deferredReflectionShader))
 	{
 		fmt::print("Error when building deferred reflections compute shader \n");
 	}
+	//	note: only loaded with shaderStorageImageWriteWithoutFormat, the module needs the capability
+	VkShaderModule deferredSwapchainShader = VK_NULL_HANDLE;
+	if (_storageWriteWithoutFormat && !vkutil::loadShaderModule("./shaders/deferred_swapchain.comp.spv", _device, &deferredSwapchainShader))
+	{
+		fmt::print("Error when building deferred swapchain compute shader \n");
+	}
+	VkShaderModule deferredClassifyShader;
+	if (!vkutil::loadShaderModule("./shaders/deferred_classify.comp.spv", _device, &deferredClassifyShader))
+	{
+		fmt::print("Error when building deferred classify compute shader \n");
+	}
 
-	VkPipelineShaderStageCreateInfo stageInfo{};
-	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	stageInfo.pNext = nullptr;
-	stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	stageInfo.pName = "main"; //name of entrypoint function
-	stageInfo.module = deferredReflectionShader;
+	//one variant per tile class, the class is constant_id 0 so the compiler drops what the class never needs
+	for (int tileClass = 0; tileClass < DEFERRED_TILE_CLASS_COUNT; tileClass++)
+	{
+		_deferredPipelines[tileClass].init([=, this](const std::tuple<int, int, bool>& key) {
+			auto [reflectionSteps, reflectionRefineSteps, swapchainOutput] = key;
+			vkutil::SpecializationConstants constants;
+			constants.add(0, tileClass)
+				.add(1, reflectionSteps)
+				.add(2, reflectionRefineSteps);
+			VkShaderModule shader = swapchainOutput ? deferredSwapchainShader : deferredReflectionShader;
+			return vkutil::buildComputePipeline(_device, _deferredPipelineLayout, shader, constants.info());
+		});
+	}
 
-	//create pipelines
-	VkComputePipelineCreateInfo computePipelineCreateInfo{};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineCreateInfo.pNext = nullptr;
-	computePipelineCreateInfo.layout = _deferredPipelineLayout;
-	computePipelineCreateInfo.stage = stageInfo;
+	//sorts the tiles into the classes, shares the layout with the variants
+	_deferredClassifyPipeline = vkutil::buildComputePipeline(_device, _deferredPipelineLayout, deferredClassifyShader);
+	vkDestroyShaderModule(_device, deferredClassifyShader, nullptr);
 
-	VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &_deferredPipeline));
+	_mainDeletionQueue.pushFunction([=, this]() {
+		vkDestroyPipelineLayout(_device, _deferredPipelineLayout, nullptr);
+		for (auto& pipelines : _deferredPipelines)
+			pipelines.destroy(_device);
+		vkDestroyPipeline(_device, _deferredClassifyPipeline, nullptr);
+		vkDestroyShaderModule(_device, deferredReflectionShader, nullptr);
+		if (deferredSwapchainShader != VK_NULL_HANDLE)
+			vkDestroyShaderModule(_device, deferredSwapchainShader, nullptr);
+		});
 
+	//shadow mask resolve, runs right before the deferred pass
+	VkDescriptorSetLayout shadowMaskLayouts[] = {
+		_sceneDataDescriptorLayout,
+		_shadowMaskDescriptorLayout,
+	};
+	computeLayout.pSetLayouts = shadowMaskLayouts;
+	computeLayout.setLayoutCount = 2;
+	VK_CHECK(vkCreatePipelineLayout(_device, &computeLayout, nullptr, &_shadowMaskPipelineLayout));
 
-	//deletion
-	vkDestroyShaderModule(_device, deferredReflectionShader, nullptr);
+	VkShaderModule shadowMaskShader;
+	if (!vkutil::loadShaderModule("./shaders/shadow_mask.comp.spv", _device, &shadowMaskShader))
+	{
+		fmt::print("Error when building shadow mask compute shader \n");
+	}
+	_shadowMaskKernel = _workgroupTuner.addKernel("shadow_mask", { "./shaders/shadow_mask.comp.spv" }, { 16, 16 });
+	_shadowMaskPipelines.init([=, this](const std::pair<int, WorkgroupSize>& key) {
+		vkutil::SpecializationConstants constants;
+		constants.add(0, key.first)
+			.add(1, CSM_COUNT);
+		key.second.specialize(constants);
+		return vkutil::buildComputePipeline(_device, _shadowMaskPipelineLayout, shadowMaskShader, constants.info());
+	});
 
-	_mainDeletionQueue.pushFunction([&]() {
-		vkDestroyPipelineLayout(_device, _deferredPipelineLayout, nullptr);
-		vkDestroyPipeline(_device, _deferredPipeline, nullptr);
+	_mainDeletionQueue.pushFunction([=, this]() {
+		vkDestroyPipelineLayout(_device, _shadowMaskPipelineLayout, nullptr);
+		_shadowMaskPipelines.destroy(_device);
+		vkDestroyShaderModule(_device, shadowMaskShader, nullptr);
+		});
+}
+
+void VulkanEngine::initResolvePipeline()
+{
+	VkShaderModule vertexShader;
+	if (!vkutil::loadShaderModule("./shaders/fullscreen.vert.spv", _device, &vertexShader))
+	{
+		fmt::print("Error when building fullscreen vertex shader \n");
+	}
+	VkShaderModule fragmentShader;
+	if (!vkutil::loadShaderModule("./shaders/resolve.frag.spv", _device, &fragmentShader))
+	{
+		fmt::print("Error when building resolve fragment shader \n");
+	}
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(ComputePushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &_resolveDescriptorLayout;
+	VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_resolvePipelineLayout));
+
+	//drawn into the swapchain image right before the ui, in the same rendering
+	vkutil::PipelineBuilder pipelineBuilder;
+	pipelineBuilder._pipelineLayout = _resolvePipelineLayout;
+	pipelineBuilder.setShaders(vertexShader, fragmentShader);
+	pipelineBuilder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.setPolygonMode(VK_POLYGON_MODE_FILL);
+	pipelineBuilder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	pipelineBuilder.setMultisamplingNone();
+	pipelineBuilder.setBlendingModes({ vkutil::DISABLED });
+	pipelineBuilder.disableDepthTest();
+	pipelineBuilder.setColorAttachmentFormat(_swapchainImageFormat);
+	_resolvePipeline = pipelineBuilder.buildPipeline(_device);
+
+	vkDestroyShaderModule(_device, vertexShader, nullptr);
+	vkDestroyShaderModule(_device, fragmentShader, nullptr);
+
+	_mainDeletionQueue.pushFunction([=, this]() {
+		vkDestroyPipelineLayout(_device, _resolvePipelineLayout, nullptr);
+		vkDestroyPipeline(_device, _resolvePipeline, nullptr);
 		});
 }
 
@@ -1354,9 +2752,24 @@ void VulkanEngine::initSampler()
 
 	vkCreateSampler(_device, &samplerCreateInfo, nullptr, &_defaultSampler);
 
+	//filtered lookups into the heightmap and the wind map
+	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	vkCreateSampler(_device, &samplerCreateInfo, nullptr, &_linearSampler);
+
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	vkCreateSampler(_device, &samplerCreateInfo, nullptr, &_linearRepeatSampler);
+
 	_mainDeletionQueue.pushFunction(
 		[&] {
 			vkDestroySampler(_device, _defaultSampler, nullptr);
+			vkDestroySampler(_device, _linearSampler, nullptr);
+			vkDestroySampler(_device, _linearRepeatSampler, nullptr);
 		}
 	);
 }
@@ -1599,15 +3012,125 @@ void VulkanEngine::initGrassPipeline()
 	//build pipeline
 	_grassPipeline = pipelineBuilder.buildPipeline(_device);
 
-	//clean structures
-	vkDestroyShaderModule(_device, meshFragShader, nullptr);
-	vkDestroyShaderModule(_device, meshVertShader, nullptr);
-
 	_mainDeletionQueue.pushFunction([&]() {
 		vkDestroyPipelineLayout(_device, _grassPipelineLayout, nullptr);
 		vkDestroyPipeline(_device, _grassPipeline, nullptr);
 		});
 
+	//VISIBILITY BUFFER
+	//	same geometry, only the visible blade triangle is written and grass_material.comp shades it
+	VkShaderModule visibilityFragShader = VK_NULL_HANDLE;
+	vkutil::PipelineBuilder visibilityBuilder;
+	if (!vkutil::loadShaderModule("./shaders/grass_visibility.frag.spv", _device, &visibilityFragShader))
+	{
+		fmt::print("error when building grass visibility fragment shader module\n");
+	}
+	visibilityBuilder._pipelineLayout = _grassPipelineLayout;
+	visibilityBuilder.setShaders(meshVertShader, visibilityFragShader);
+	visibilityBuilder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	visibilityBuilder.setPolygonMode(VK_POLYGON_MODE_FILL);
+	visibilityBuilder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	visibilityBuilder.setMultisamplingNone();
+	visibilityBuilder.setBlendingModes({ vkutil::DISABLED });
+	visibilityBuilder.enableDepthTest(true, VK_COMPARE_OP_LESS_OR_EQUAL);
+	visibilityBuilder.setColorAttachmentFormat(_visibilityImage.imageFormat);
+	visibilityBuilder.setDepthFormat(_depthImage.imageFormat);
+	_grassVisibilityPipeline = visibilityBuilder.buildPipeline(_device);
+
+	VkShaderModule materialShader;
+	if (!vkutil::loadShaderModule("./shaders/grass_material.comp.spv", _device, &materialShader))
+	{
+		fmt::print("error when building grass material shader module\n");
+	}
+	VkPushConstantRange materialBufferRange{};
+	materialBufferRange.offset = 0;
+	materialBufferRange.size = sizeof(ComputePushConstants);
+	materialBufferRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	VkDescriptorSetLayout materialLayouts[] = {
+		_sceneDataDescriptorLayout,
+		_grassMaterialDescriptorLayout,
+		_grassDataDescriptorLayout
+	};
+	VkPipelineLayoutCreateInfo materialPipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	materialPipelineLayoutInfo.pPushConstantRanges = &materialBufferRange;
+	materialPipelineLayoutInfo.pushConstantRangeCount = 1;
+	materialPipelineLayoutInfo.setLayoutCount = 3;
+	materialPipelineLayoutInfo.pSetLayouts = materialLayouts;
+	VK_CHECK(vkCreatePipelineLayout(_device, &materialPipelineLayoutInfo, nullptr, &_grassMaterialPipelineLayout));
+
+	_grassMaterialKernel = _workgroupTuner.addKernel("grass_material", { "./shaders/grass_material.comp.spv" }, { 16, 16 });
+	_grassMaterialPipelines.init([=, this](const WorkgroupSize& size) {
+		vkutil::SpecializationConstants constants;
+		size.specialize(constants);
+		return vkutil::buildComputePipeline(_device, _grassMaterialPipelineLayout, materialShader, constants.info());
+	});
+
+	_mainDeletionQueue.pushFunction([=, this]() {
+		vkDestroyPipeline(_device, _grassVisibilityPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _grassMaterialPipelineLayout, nullptr);
+		_grassMaterialPipelines.destroy(_device);
+		vkDestroyShaderModule(_device, materialShader, nullptr);
+		});
+
+	//MESH SHADER
+	//	same attachments and fragment shader as the instanced pipeline
+	if (_meshShaderSupported)
+	{
+		VkShaderModule grassTaskShader;
+		if (!vkutil::loadShaderModule("./shaders/grass.task.spv", _device, &grassTaskShader))
+		{
+			fmt::print("error when building grass task shader module\n");
+		}
+		else
+		{
+			fmt::print("grass task shader loaded\n");
+		}
+		VkShaderModule grassMeshShader;
+		if (!vkutil::loadShaderModule("./shaders/grass.mesh.spv", _device, &grassMeshShader))
+		{
+			fmt::print("error when building grass mesh shader module\n");
+		}
+		else
+		{
+			fmt::print("grass mesh shader loaded\n");
+		}
+
+		VkPushConstantRange meshBufferRange{};
+		meshBufferRange.offset = 0;
+		meshBufferRange.size = sizeof(GPUDrawPushConstants);
+		meshBufferRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+
+		VkPipelineLayoutCreateInfo meshPipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+		meshPipelineLayoutInfo.pPushConstantRanges = &meshBufferRange;
+		meshPipelineLayoutInfo.pushConstantRangeCount = 1;
+		meshPipelineLayoutInfo.setLayoutCount = 3;
+		meshPipelineLayoutInfo.pSetLayouts = layouts;
+
+		VK_CHECK(vkCreatePipelineLayout(_device, &meshPipelineLayoutInfo, nullptr, &_grassMeshPipelineLayout));
+
+		pipelineBuilder._pipelineLayout = _grassMeshPipelineLayout;
+		pipelineBuilder.setMeshShaders(grassTaskShader, grassMeshShader, meshFragShader);
+		_grassMeshPipeline = pipelineBuilder.buildPipeline(_device);
+
+		visibilityBuilder._pipelineLayout = _grassMeshPipelineLayout;
+		visibilityBuilder.setMeshShaders(grassTaskShader, grassMeshShader, visibilityFragShader);
+		_grassMeshVisibilityPipeline = visibilityBuilder.buildPipeline(_device);
+
+		vkDestroyShaderModule(_device, grassTaskShader, nullptr);
+		vkDestroyShaderModule(_device, grassMeshShader, nullptr);
+
+		_mainDeletionQueue.pushFunction([&]() {
+			vkDestroyPipelineLayout(_device, _grassMeshPipelineLayout, nullptr);
+			vkDestroyPipeline(_device, _grassMeshPipeline, nullptr);
+			vkDestroyPipeline(_device, _grassMeshVisibilityPipeline, nullptr);
+			});
+	}
+
+	//clean structures
+	vkDestroyShaderModule(_device, meshFragShader, nullptr);
+	vkDestroyShaderModule(_device, meshVertShader, nullptr);
+	vkDestroyShaderModule(_device, visibilityFragShader, nullptr);
+
 	//COMPUTE
 
 	VkShaderModule computeShader;
@@ -1623,13 +3146,13 @@ void VulkanEngine::initGrassPipeline()
 	//push constant range
 	VkPushConstantRange computeBufferRange{};
 	computeBufferRange.offset = 0;
-	computeBufferRange.size = sizeof(ComputePushConstants);
+	computeBufferRange.size = sizeof(GrassTilePushConstants);
 	computeBufferRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
 	//sets
 	VkDescriptorSetLayout computeLayout[] = {
 		_grassDataDescriptorLayout,
-		_heightMapDescriptorLayout
+		_terrainTilesDescriptorLayout
 	};
 
 	//build pipeline layout that controls the input/outputs of shader
@@ -1665,6 +3188,147 @@ void VulkanEngine::initGrassPipeline()
 		vkDestroyPipelineLayout(_device, _grassComputePipelineLayout, nullptr);
 		vkDestroyPipeline(_device, _grassComputePipeline, nullptr);
 		});
+
+	//ANIMATION
+
+	VkShaderModule animateShader;
+	if (!vkutil::loadShaderModule("./shaders/grass_animate.comp.spv", _device, &animateShader))
+	{
+		fmt::print("error when building grass animate shader module\n");
+	}
+	else
+	{
+		fmt::print("grass animate shader loaded\n");
+	}
+
+	VkPushConstantRange animateBufferRange{};
+	animateBufferRange.offset = 0;
+	animateBufferRange.size = sizeof(ComputePushConstants);
+	animateBufferRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo animatePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	animatePipelineLayoutInfo.pPushConstantRanges = &animateBufferRange;
+	animatePipelineLayoutInfo.pushConstantRangeCount = 1;
+	animatePipelineLayoutInfo.setLayoutCount = 1;
+	animatePipelineLayoutInfo.pSetLayouts = &_grassDataDescriptorLayout;
+
+	VK_CHECK(vkCreatePipelineLayout(_device, &animatePipelineLayoutInfo, nullptr, &_grassAnimatePipelineLayout));
+
+	stageInfo.module = animateShader;
+	computePipelineCreateInfo.layout = _grassAnimatePipelineLayout;
+	computePipelineCreateInfo.stage = stageInfo;
+
+	VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &_grassAnimatePipeline));
+
+	vkDestroyShaderModule(_device, animateShader, nullptr);
+
+	_mainDeletionQueue.pushFunction([&]() {
+		vkDestroyPipelineLayout(_device, _grassAnimatePipelineLayout, nullptr);
+		vkDestroyPipeline(_device, _grassAnimatePipeline, nullptr);
+		});
+}
+
+void VulkanEngine::initTerrainPipelines()
+{
+	VkShaderModule terrainFragShader;
+	if (!vkutil::loadShaderModule("./shaders/mesh.frag.spv", _device, &terrainFragShader))
+	{
+		fmt::print("error when building terrain fragment shader module\n");
+	}
+	VkShaderModule terrainVertShader;
+	if (!vkutil::loadShaderModule("./shaders/terrain.vert.spv", _device, &terrainVertShader))
+	{
+		fmt::print("error when building terrain vertex shader module\n");
+	}
+	else
+	{
+		fmt::print("terrain vertex shader loaded\n");
+	}
+
+	//push constant range
+	VkPushConstantRange bufferRange{};
+	bufferRange.offset = 0;
+	bufferRange.size = sizeof(GPUDrawPushConstants);
+	bufferRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	//sets, the shadow pipeline uses the same layout
+	VkDescriptorSetLayout layouts[] = {
+		_sceneDataDescriptorLayout,
+		_shadowMapDescriptorLayout,
+		_terrainTilesDescriptorLayout,
+		_terrainDescriptorLayout
+	};
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	pipelineLayoutInfo.pPushConstantRanges = &bufferRange;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.setLayoutCount = 4;
+	pipelineLayoutInfo.pSetLayouts = layouts;
+
+	VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_terrainPipelineLayout));
+	VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_shadowTerrainPipelineLayout));
+
+	//MAIN PASS
+	{
+		//color attachment formats
+		std::vector<VkFormat> colorAttachmentFormats = {
+			_drawImage.imageFormat,
+			_normalsImage.imageFormat,
+			_specularMapImage.imageFormat,
+			_positionsImage.imageFormat
+		};
+
+		vkutil::PipelineBuilder pipelineBuilder;
+		pipelineBuilder._pipelineLayout = _terrainPipelineLayout;
+		pipelineBuilder.setShaders(terrainVertShader, terrainFragShader);
+		pipelineBuilder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+		pipelineBuilder.setPolygonMode(VK_POLYGON_MODE_FILL);
+		pipelineBuilder.setCullMode(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE);
+		pipelineBuilder.setMultisamplingNone();
+		std::vector<vkutil::ColorBlendingMode> modes = {
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+		};
+		pipelineBuilder.setBlendingModes(modes);
+		pipelineBuilder.enableDepthTest(true, VK_COMPARE_OP_LESS_OR_EQUAL);
+		pipelineBuilder.setColorAttachmentFormats(colorAttachmentFormats);
+		pipelineBuilder.setDepthFormat(_depthImage.imageFormat);
+
+		_terrainPipeline = pipelineBuilder.buildPipeline(_device);
+	}
+
+	//SHADOW PASS, depth only
+	{
+		vkutil::PipelineBuilder pipelineBuilder;
+		pipelineBuilder._pipelineLayout = _shadowTerrainPipelineLayout;
+		pipelineBuilder.setVertexShader(terrainVertShader);
+		pipelineBuilder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+		pipelineBuilder.setPolygonMode(VK_POLYGON_MODE_FILL);
+		pipelineBuilder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+		pipelineBuilder.setMultisamplingNone();
+		std::vector<vkutil::ColorBlendingMode> modes = {
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+			vkutil::ALPHABLEND,
+		};
+		pipelineBuilder.setBlendingModes(modes);
+		pipelineBuilder.enableDepthTest(true, VK_COMPARE_OP_LESS_OR_EQUAL);
+		pipelineBuilder.setDepthFormat(_shadowMapImageArray.imageFormat);
+
+		_shadowTerrainPipeline = pipelineBuilder.buildPipeline(_device);
+	}
+
+	//clean structures
+	vkDestroyShaderModule(_device, terrainFragShader, nullptr);
+	vkDestroyShaderModule(_device, terrainVertShader, nullptr);
+
+	_mainDeletionQueue.pushFunction([&]() {
+		vkDestroyPipelineLayout(_device, _terrainPipelineLayout, nullptr);
+		vkDestroyPipeline(_device, _terrainPipeline, nullptr);
+		vkDestroyPipelineLayout(_device, _shadowTerrainPipelineLayout, nullptr);
+		vkDestroyPipeline(_device, _shadowTerrainPipeline, nullptr);
+		});
 }
 
 void VulkanEngine::initDefaultData()
@@ -1674,7 +3338,7 @@ void VulkanEngine::initDefaultData()
 
 	initScene();
 
-	initHeightMap();
+	initTerrainTiles();
 	initGround();
 	initGrass();
 	initWindMap();
@@ -1683,7 +3347,8 @@ void VulkanEngine::initDefaultData()
 
 void VulkanEngine::initSceneData()
 {
-	_player._position = glm::vec3(20, 25, 0);
+	//spawn a bit above the ground
+	_player._position = glm::vec3(20, _terrainHeightMap.getHeight(20, 0) + 5 * _player._eyeHeight, 0);
 
 	_sceneData = SceneData{};
 	_sceneData.view = _player.getViewMatrix();
@@ -1691,13 +3356,15 @@ void VulkanEngine::initSceneData()
 			glm::radians(70.f),
 			(float)_windowExtent.width / (float)_windowExtent.height,
 			//10000.f,0.1f); //reverse depth for better precision near 0? (TODO: not working?)
-			0.1f, RENDER_DISTANCE*2.f);
+			CAMERA_NEAR_PLANE, RENDER_DISTANCE*2.f);
 	_sceneData.proj[1][1] *= -1;
 
 	_sceneData.ambientColor = glm::vec4(0.1f, 0.1f, 0.1f, 0.1f);
 	_sceneData.sunlightDirection = glm::vec4(2, -2, 0, 1);
 	_sceneData.sunlightColor = glm::vec4(1, 1, 1, 1);
 	_sceneData.viewProj = _sceneData.proj*_sceneData.view;
+	_sceneData.inverseViewProj = glm::inverse(_sceneData.viewProj);
+	_sceneData.previousViewProj = _sceneData.viewProj;
 
 	for (int i = 0; i < CSM_COUNT; i++)
 	{
@@ -1705,10 +3372,6 @@ void VulkanEngine::initSceneData()
 	}
 
 
-	_sunPosition = glm::vec3(-30 * _sceneData.sunlightDirection.x + std::floor(_player._position.x),
-		-30 * _sceneData.sunlightDirection.y,
-		-30 * _sceneData.sunlightDirection.z + std::floor(_player._position.z));
-
 	_sceneData.time = glm::vec4(_time, _time / 2, 0, 0);
 }
 
@@ -1726,219 +3389,184 @@ void VulkanEngine::cleanupScene()
 
 void VulkanEngine::initGround()
 {
-	const int GROUND_QUALITY = 2;
-	GPUMeshBuffers meshBuffers{};
-	MeshAsset meshAsset{};
-
-	uint32_t numVerticesPerSide = (RENDER_DISTANCE * GROUND_QUALITY + 2);
-	const size_t vertexBufferSize = numVerticesPerSide * numVerticesPerSide;
-	const size_t indexBufferSize = (numVerticesPerSide - 1) * (numVerticesPerSide - 1) * 6;
-	meshBuffers.vertexBuffer = createBuffer(vertexBufferSize * sizeof(Vertex),
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
-	meshBuffers.indexBuffer = createBuffer(indexBufferSize * sizeof(uint32_t),
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
-
-	std::vector<GeoSurface> surfaces;
-	surfaces.resize(1);
-	surfaces[0].startIndex = static_cast<uint32_t>(0);
-	surfaces[0].count = static_cast<uint32_t>(indexBufferSize);
-
-	VkBufferDeviceAddressInfo vertexBufferAddressInfo{};
-	vertexBufferAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-	vertexBufferAddressInfo.pNext = nullptr;
-	vertexBufferAddressInfo.buffer = meshBuffers.vertexBuffer.buffer;
-	meshBuffers.vertexBufferAddress = vkGetBufferDeviceAddress(_device, &vertexBufferAddressInfo);
-
-	VkBufferDeviceAddressInfo indexBufferAddressInfo{};
-	indexBufferAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-	indexBufferAddressInfo.pNext = nullptr;
-	indexBufferAddressInfo.buffer = meshBuffers.indexBuffer.buffer;
-	VkDeviceAddress indexBufferAddress = vkGetBufferDeviceAddress(_device, &indexBufferAddressInfo);
-	
-	//VERTEX
+	//the ground is drawn as CDLOD patches, this is the grid every patch instance shares
+	//	only x and z are used, in grid units, terrain.vert places and morphs it on the heightmap
+	const int resolution = TerrainLod::PATCH_RESOLUTION;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	vertices.reserve((resolution + 1) * (resolution + 1));
+	indices.reserve(resolution * resolution * 6);
+	for (int z = 0; z <= resolution; z++)
 	{
-		//	PIPELINE
-		VkShaderModule computeVertexShader;
-		if (!vkutil::loadShaderModule("./shaders/ground_mesh_vertices.comp.spv", _device, &computeVertexShader))
+		for (int x = 0; x <= resolution; x++)
 		{
-			fmt::print("error when building ground mesh vertex compute shader module\n");
+			vertices.push_back({ glm::vec3(x, 0, z), 0, glm::vec3(0, 1, 0), 0, glm::vec4(1) });
 		}
-		else
-		{
-			fmt::print("ground mesh vertex compute shader loaded\n");
-		}
-
-		struct ComputeVertexPushConstants {
-			glm::vec4 data;
-			VkDeviceAddress vertexBuffer;
-		};
-
-		//push constant range
-		VkPushConstantRange computeVertexBufferRange{};
-		computeVertexBufferRange.offset = 0;
-		computeVertexBufferRange.size = sizeof(ComputeVertexPushConstants);
-		computeVertexBufferRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-		//sets
-
-		//build pipeline layout that controls the input/outputs of shader
-		//	note: no descriptor sets or other yet.
-		VkPipelineLayoutCreateInfo computePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
-		computePipelineLayoutInfo.pPushConstantRanges = &computeVertexBufferRange;
-		computePipelineLayoutInfo.pushConstantRangeCount = 1;
-		computePipelineLayoutInfo.pSetLayouts = &_heightMapDescriptorLayout;
-		computePipelineLayoutInfo.setLayoutCount = 1;
-		
-		VkPipelineLayout computeVertexPipelineLayout;
-		VK_CHECK(vkCreatePipelineLayout(_device, &computePipelineLayoutInfo, nullptr, &computeVertexPipelineLayout));
-
-		VkPipelineShaderStageCreateInfo stageInfo{};
-		stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stageInfo.pNext = nullptr;
-		stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-		stageInfo.pName = "main"; //name of entrypoint function
-		stageInfo.module = computeVertexShader;
-
-		////create pipelines
-		VkComputePipelineCreateInfo computePipelineCreateInfo{};
-		computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-		computePipelineCreateInfo.pNext = nullptr;
-		computePipelineCreateInfo.layout = computeVertexPipelineLayout;
-		computePipelineCreateInfo.stage = stageInfo;
-
-		VkPipeline computeVertexPipeline;
-		VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &computeVertexPipeline));
-
-		ComputeVertexPushConstants pushConstants{};
-		pushConstants.data = glm::vec4(numVerticesPerSide, GROUND_QUALITY,0,0);
-		pushConstants.vertexBuffer = meshBuffers.vertexBufferAddress;
-
-		////clean structures
-		vkDestroyShaderModule(_device, computeVertexShader, nullptr);
-
-		//_mainDeletionQueue.pushFunction([&]() {
-		//	});
-
-		immediateSubmit(
-			[&](VkCommandBuffer cmd) {
-				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computeVertexPipeline);
-				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computeVertexPipelineLayout, 0, 1, &_heightMapDescriptorSet,
-					0, nullptr);
-				vkCmdPushConstants(cmd, computeVertexPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
-					sizeof(ComputeVertexPushConstants), &pushConstants);
-				vkCmdDispatch(cmd, std::ceil(numVerticesPerSide / 16.0f), std::ceil(numVerticesPerSide / 16.0f), 1);
-			}
-		);
-		vkDestroyPipelineLayout(_device, computeVertexPipelineLayout, nullptr);
-		vkDestroyPipeline(_device, computeVertexPipeline, nullptr);
 	}
-
-
-	//INDICES
+	//	note: clockwise front faces, like the rest of the scene
+	for (int z = 0; z < resolution; z++)
 	{
-		//	PIPELINE
-		VkShaderModule computeIndexShader;
-		if (!vkutil::loadShaderModule("./shaders/ground_mesh_indices.comp.spv", _device, &computeIndexShader))
-		{
-			fmt::print("error when building ground mesh indices compute shader module\n");
-		}
-		else
+		for (int x = 0; x < resolution; x++)
 		{
-			fmt::print("ground mesh index compute shader loaded\n");
+			uint32_t bl = x + z * (resolution + 1);
+			indices.insert(indices.end(), { bl, bl + 1, bl + resolution + 1, bl + 1, bl + resolution + 2, bl + resolution + 1 });
 		}
+	}
 
-		struct ComputeIndexPushConstants {
-			glm::vec4 data;
-			VkDeviceAddress indexBuffer;
-		};
-
-		//push constant range
-		VkPushConstantRange computeIndexBufferRange{};
-		computeIndexBufferRange.offset = 0;
-		computeIndexBufferRange.size = sizeof(ComputeIndexPushConstants);
-		computeIndexBufferRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-		//sets
+	std::vector<GeoSurface> surfaces;
+	surfaces.resize(1);
+	surfaces[0].startIndex = static_cast<uint32_t>(0);
+	surfaces[0].count = static_cast<uint32_t>(indices.size());
 
-		//build pipeline layout that controls the input/outputs of shader
-		//	note: no descriptor sets or other yet.
-		VkPipelineLayoutCreateInfo computePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
-		computePipelineLayoutInfo.pPushConstantRanges = &computeIndexBufferRange;
-		computePipelineLayoutInfo.pushConstantRangeCount = 1;
-		//computePipelineLayoutInfo.pSetLayouts = &_heightMapDescriptorLayout;
-		computePipelineLayoutInfo.setLayoutCount = 0;
-
-		VkPipelineLayout computeIndexPipelineLayout;
-		VK_CHECK(vkCreatePipelineLayout(_device, &computePipelineLayoutInfo, nullptr, &computeIndexPipelineLayout));
-
-		VkPipelineShaderStageCreateInfo stageInfo{};
-		stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		stageInfo.pNext = nullptr;
-		stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-		stageInfo.pName = "main"; //name of entrypoint function
-		stageInfo.module = computeIndexShader;
-
-		////create pipelines
-		VkComputePipelineCreateInfo computePipelineCreateInfo{};
-		computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-		computePipelineCreateInfo.pNext = nullptr;
-		computePipelineCreateInfo.layout = computeIndexPipelineLayout;
-		computePipelineCreateInfo.stage = stageInfo;
-
-		VkPipeline computeIndexPipeline;
-		VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &computeIndexPipeline));
-
-		ComputeIndexPushConstants pushConstants{};
-		pushConstants.data = glm::vec4(numVerticesPerSide-1, 0, 0, 0);
-		pushConstants.indexBuffer = indexBufferAddress;
-
-		////clean structures
-		vkDestroyShaderModule(_device, computeIndexShader, nullptr);
-
-		//_mainDeletionQueue.pushFunction([&]() {
-		//	});
-
-		immediateSubmit(
-			[&](VkCommandBuffer cmd) {
-				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computeIndexPipeline);
-				vkCmdPushConstants(cmd, computeIndexPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
-					sizeof(ComputeIndexPushConstants), &pushConstants);
-				vkCmdDispatch(cmd, std::ceil((float)indexBufferSize/(6*64)), 1, 1);
-			}
-		);
-		vkDestroyPipelineLayout(_device, computeIndexPipelineLayout, nullptr);
-		vkDestroyPipeline(_device, computeIndexPipeline, nullptr);
-	}
-	//TODO OPTIMIZATION make the vertices and indices in same buffer with offset to improve performance
+	MeshAsset meshAsset{};
 	meshAsset.name = "ground";
 	meshAsset.surfaces = surfaces;
-	//meshAsset.meshBuffers = uploadMesh(indices,vertices);
-	meshAsset.meshBuffers = meshBuffers;
-
-	_groundMesh = std::make_shared<MeshAsset>(std::move(meshAsset));
-
+	meshAsset.meshBuffers = uploadMesh(indices, vertices);
 
+	_groundMesh = std::make_shared<MeshAsset>(std::move(meshAsset));
 
-	//vkDestroyShaderModule(_device, vertexComputeShader, nullptr);
 	_mainDeletionQueue.pushFunction(
 		[&]() {
 			destroyBuffer(_groundMesh->meshBuffers.vertexBuffer);
 			destroyBuffer(_groundMesh->meshBuffers.indexBuffer);
-
 		}
 	);
-	//_mainDeletionQueue.pushFunction(
-	//	[&]() {
-	//		destroyBuffer(meshBuffers.vertexBuffer);
-	//		destroyBuffer(meshBuffers.indexBuffer);
-	//	}
-	//);
+
+	//node bounds come from the height bounds baked into the terrain file, the root node covers the whole map
+	int levelCount = 1;
+	while (TERRAIN_LEAF_NODE_SIZE * (1 << (levelCount - 1)) < _terrainHeightMap.size()) levelCount++;
+	_terrainLod.configure(_terrainHeightMap, TERRAIN_LEAF_NODE_SIZE, levelCount);
+}
+
+void VulkanEngine::validateTerrainHeightMap()
+{
+	//samples the terrain on the GPU at probe points and compares it with the CPU queries
+	//	note: filtered heights only agree up to the 8 bit subtexel precision of the sampler
+	static constexpr float TILE_HEIGHT_TOLERANCE = 0.02f;
+	static constexpr float PROCEDURAL_HEIGHT_TOLERANCE = 0.01f;
+	static constexpr int PROBES_PER_TILE_SIDE = 8;
+
+	//probes at fractional texel positions on every tile and one tile beyond the map edge, where both sides clamp
+	//	only probes on resident tiles are compared with the file texels, the overview has a lower resolution than the CPU reads
+	int mapSize = _terrainTileFile.mapSize();
+	int tileSize = _terrainTileFile.tileSize();
+	int tileCount = _terrainTileFile.tileCount();
+	const std::vector<int32_t>& layerTable = _terrainTileCache.layerTable();
+	std::vector<glm::vec4> probes;
+	std::vector<bool> isResidentProbe;
+	for (int tileY = -1; tileY <= tileCount; tileY++)
+	{
+		for (int tileX = -1; tileX <= tileCount; tileX++)
+		{
+			for (int y = 0; y < PROBES_PER_TILE_SIDE; y++)
+			{
+				for (int x = 0; x < PROBES_PER_TILE_SIDE; x++)
+				{
+					glm::vec2 p = (glm::vec2(tileX, tileY) + (glm::vec2(x, y) + glm::vec2(0.37f, 0.71f)) / (float)PROBES_PER_TILE_SIDE) * (float)tileSize;
+					glm::ivec2 tile = glm::min(glm::ivec2(glm::clamp(p, glm::vec2(0), glm::vec2((float)(mapSize - 1)))) / tileSize, glm::ivec2(tileCount - 1));
+					probes.push_back(glm::vec4(p, 0, 0));
+					isResidentProbe.push_back(layerTable[tile.x + tile.y * tileCount] >= 0);
+				}
+			}
+		}
+	}
+
+	size_t probeBytes = sizeof(glm::vec4) * probes.size();
+	AllocatedBuffer probeBuffer = createBuffer(probeBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	memcpy(probeBuffer.allocation->GetMappedData(), probes.data(), probeBytes);
+	AllocatedBuffer resultBuffer = createBuffer(probeBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+	DescriptorLayoutBuilder builder;
+	builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	VkDescriptorSetLayout probeLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+	VkDescriptorSet probeSet = _globalDescriptorAllocator.allocate(_device, probeLayout);
+	DescriptorWriter writer;
+	writer.writeBuffer(0, probeBuffer.buffer, probeBytes, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.writeBuffer(1, resultBuffer.buffer, probeBytes, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	writer.updateSet(_device, probeSet);
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(ComputePushConstants);
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	VkDescriptorSetLayout setLayouts[] = { probeLayout, _terrainTilesDescriptorLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.setLayoutCount = 2;
+	pipelineLayoutInfo.pSetLayouts = setLayouts;
+	VkPipelineLayout pipelineLayout;
+	VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &pipelineLayout));
+
+	VkShaderModule computeShader = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	if (!vkutil::loadShaderModule("./shaders/terrain_validate.comp.spv", _device, &computeShader))
+	{
+		fmt::print("error when building the terrain validation compute shader module, the terrain is not validated\n");
+	}
+	else
+	{
+		pipeline = vkutil::buildComputePipeline(_device, pipelineLayout, computeShader);
+
+		ComputePushConstants pushConstants{};
+		pushConstants.data1 = glm::vec4((float)probes.size(), (float)(mapSize / 2), (float)(mapSize / 2), 0);
+		immediateSubmit([&](VkCommandBuffer cmd) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			VkDescriptorSet descriptorSets[] = { probeSet, _terrainTilesDescriptorSet };
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 2, descriptorSets, 0, nullptr);
+			vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+			vkCmdDispatch(cmd, (uint32_t)(probes.size() + 63) / 64, 1, 1);
+			});
+
+		vmaInvalidateAllocation(_allocator, resultBuffer.allocation, 0, VK_WHOLE_SIZE);
+		const glm::vec4* results = (const glm::vec4*)resultBuffer.allocation->GetMappedData();
+
+		glm::vec2 mapCenter = glm::vec2((float)(mapSize / 2));
+		float maxTileError = 0;
+		float maxProceduralError = 0;
+		int failedProbes = 0;
+		int residentProbes = 0;
+		for (size_t i = 0; i < probes.size(); i++)
+		{
+			glm::vec2 p = glm::vec2(probes[i]);
+			float proceduralError = std::abs(results[i].y - TerrainHeightMap::evaluateHeight(p, mapCenter));
+			float tileError = 0;
+			if (isResidentProbe[i])
+			{
+				residentProbes++;
+				tileError = std::abs(results[i].x - _terrainHeightMap.getHeight(p.x - mapCenter.x, p.y - mapCenter.y));
+			}
+			maxTileError = std::max(maxTileError, tileError);
+			maxProceduralError = std::max(maxProceduralError, proceduralError);
+			if (tileError > TILE_HEIGHT_TOLERANCE || proceduralError > PROCEDURAL_HEIGHT_TOLERANCE)
+			{
+				if (failedProbes == 0)
+					fmt::print("terrain probe at texel ({:.2f}, {:.2f}): gpu {:.4f} m / cpu {:.4f} m filtered, gpu {:.4f} m / cpu {:.4f} m procedural\n",
+						p.x, p.y, results[i].x, _terrainHeightMap.getHeight(p.x - mapCenter.x, p.y - mapCenter.y),
+						results[i].y, TerrainHeightMap::evaluateHeight(p, mapCenter));
+				failedProbes++;
+			}
+		}
+
+		//	note: reported in every build with validation layers, the assert only stops debug builds
+		fmt::print("cpu terrain {} the GPU: {} probes ({} on resident tiles), {} failed, max filtered error {:.4f} m, max procedural error {:.4f} m\n",
+			failedProbes == 0 ? "matches" : "DOES NOT MATCH", probes.size(), residentProbes, failedProbes, maxTileError, maxProceduralError);
+		assert(failedProbes == 0 && "CPU terrain queries are out of sync with the terrain shaders");
+	}
+
+	if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(_device, pipeline, nullptr);
+	if (computeShader != VK_NULL_HANDLE) vkDestroyShaderModule(_device, computeShader, nullptr);
+	vkDestroyPipelineLayout(_device, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(_device, probeLayout, nullptr);
+	destroyBuffer(probeBuffer);
+	destroyBuffer(resultBuffer);
 }
 
 void VulkanEngine::initGrass()
 {
+	_grassRebuildTimer = _gpuTimer.addRegion("grass rebuild");
+
 	{
 		MeshAsset meshAsset{};
 
@@ -1960,15 +3588,24 @@ void VulkanEngine::initGrass()
 		vertices[7] = { glm::vec3(-grassWidth,0.9f, 0), 0, normal, 1, glm::mix(bottomColor,topColor,0.9f) };
 		vertices[8] = { glm::vec3(0, 1.1f, 0), 0, normal, 1, glm::mix(bottomColor,topColor,1.f) };
 
-		std::vector<uint32_t> indices{
-			0,3,1,
-			0,2,3,
-			2,5,3,
-			2,4,5,
-			4,7,5,
-			4,6,7,
-			6,8,7
-		};
+		//	note: grass.vert generates the vertices from gl_VertexIndex, so only the indices are read
+		//		  surface i covers the GRASS_BLADE_SEGMENTS >> i segments of lod i, see getBladeVertex in _animatedBlade.glsl
+		std::vector<uint32_t> indices;
+		std::vector<GeoSurface> surfaces(GRASS_LOD_COUNT);
+		for (int lod = 0; lod < GRASS_LOD_COUNT; lod++)
+		{
+			uint32_t segments = GRASS_BLADE_SEGMENTS >> lod;
+			surfaces[lod].startIndex = static_cast<uint32_t>(indices.size());
+			for (uint32_t i = 0; i < segments - 1; i++)
+			{
+				uint32_t right = i * 2;
+				uint32_t left = i * 2 + 1;
+				indices.insert(indices.end(), { left, right, left + 2, right, right + 2, left + 2 });
+			}
+			uint32_t tip = segments * 2;
+			indices.insert(indices.end(), { tip - 1, tip - 2, tip });
+			surfaces[lod].count = static_cast<uint32_t>(indices.size()) - surfaces[lod].startIndex;
+		}
 
 		//std::array<Vertex, 3> vertices{};
 		//vertices[0] = { glm::vec3(grassWidth, 0,0), 1, normal, 1, glm::mix(bottomColor,topColor,0.f) };
@@ -1978,11 +3615,6 @@ void VulkanEngine::initGrass()
 		//	0,1,2
 		//};
 
-		std::vector<GeoSurface> surfaces;
-		surfaces.resize(1);
-		surfaces[0].count = static_cast<uint32_t>(indices.size());
-		surfaces[0].startIndex = static_cast<uint32_t>(0);
-
 
 		meshAsset.name = "grass";
 		meshAsset.surfaces = surfaces;
@@ -2049,154 +3681,167 @@ void VulkanEngine::initGrass()
 	//}
 }
 
-void VulkanEngine::initHeightMap()
+void VulkanEngine::initTerrainTiles()
 {
-	//create image
+	//every terrain texel comes from the terrain file, without one the procedural terrain is baked into the asset cache
+	if (!_terrainTileFile.open(TERRAIN_FILE_PATH))
+	{
+		//	note: the procedural terrain is evaluated on the CPU, so the key only has the parameters
+		AssetCache::Key key;
+		key.add(HEIGHT_MAP_SIZE).add(TERRAIN_TILE_SIZE).add(TerrainTileFile::VERSION).add(TerrainHeightMap::GENERATOR_VERSION);
+		std::string path = _assetCache.path("terrain", key);
+		if (!_terrainTileFile.open(path))
+		{
+			auto start = std::chrono::system_clock::now();
+			TerrainHeightMap proceduralTerrain;
+			proceduralTerrain.build(HEIGHT_MAP_SIZE);
+			_assetCache.evict("terrain");
+			if (!TerrainTileFile::write(path, proceduralTerrain, TERRAIN_TILE_SIZE) || !_terrainTileFile.open(path))
+			{
+				fmt::print("error when writing terrain file {}\n", path);
+			}
+			auto end = std::chrono::system_clock::now();
+			fmt::print("baked {}x{} procedural terrain into {} in {:.2f} ms\n", HEIGHT_MAP_SIZE, HEIGHT_MAP_SIZE, path,
+				std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.f);
+		}
+	}
+	assert(_terrainTileFile.isOpen() && "no terrain file");
+	fmt::print("terrain file: {}x{} texels, {}x{} tiles\n", _terrainTileFile.mapSize(), _terrainTileFile.mapSize(),
+		_terrainTileFile.tileCount(), _terrainTileFile.tileCount());
+
+	_terrainHeightMap.map(_terrainTileFile);
+	_player._terrain = &_terrainHeightMap;
+	_grassTiles.setTerrain(&_terrainHeightMap);
+	_grassBuildTiles.setTerrain(&_terrainHeightMap);
+	_terrainTileCache.configure(_terrainTileFile.tileCount(), _terrainTileFile.tileSize(), TERRAIN_TILE_CACHE_LAYERS, TERRAIN_STREAM_RADIUS);
+
+	//create tile caches, same texel formats as the file: 16 bit heights and two channel normals
 	VkExtent3D imageExtent = {
-		HEIGHT_MAP_SIZE,
-		HEIGHT_MAP_SIZE,
+		(uint32_t)_terrainTileFile.tileTexelSize(),
+		(uint32_t)_terrainTileFile.tileTexelSize(),
 		1
 	};
+	_terrainHeightCacheImage.imageFormat = VK_FORMAT_R16_UNORM;
+	_terrainHeightCacheImage.imageExtent = imageExtent;
+	_terrainNormalCacheImage.imageFormat = VK_FORMAT_R8G8_SNORM;
+	_terrainNormalCacheImage.imageExtent = imageExtent;
 
-	//hardcoding draw format to 32 bit float
-	_heightMapImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-	_heightMapImage.imageExtent = imageExtent;
-
-	VkImageUsageFlags imageUsageFlags{};
-	imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;			//compute shader can write to image
-	if (bUseValidationLayers) imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
-
-	VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(_heightMapImage.imageFormat, imageUsageFlags, imageExtent);
-
-	//allocate draw image from gpu memory
 	VmaAllocationCreateInfo imgAllocInfo{};
 	imgAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY; //never accessed from cpu
 	imgAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT); //only gpu-side VRAM, fastest access
 
-	//allocate and create image
-	vmaCreateImage(_allocator, &imgInfo, &imgAllocInfo, &_heightMapImage.image, &_heightMapImage.allocation, nullptr);
+	for (AllocatedImage* image : { &_terrainHeightCacheImage, &_terrainNormalCacheImage })
+	{
+		VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(image->imageFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent);
+		imgInfo.arrayLayers = 1 + TERRAIN_TILE_CACHE_LAYERS;
+		vmaCreateImage(_allocator, &imgInfo, &imgAllocInfo, &image->image, &image->allocation, nullptr);
 
-	//build image view for the draw image to use for rendering
-	VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(_heightMapImage.imageFormat, _heightMapImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(image->imageFormat, image->image, VK_IMAGE_ASPECT_COLOR_BIT);
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		viewInfo.subresourceRange.layerCount = 1 + TERRAIN_TILE_CACHE_LAYERS;
+		VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &image->imageView));
+	}
 
-	VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &_heightMapImage.imageView));
+	//indirection table, (tile size, tiles per side, map size, 0), (height scale, height bias, 0, 0) followed by the layer of every tile
+	size_t tableSize = sizeof(glm::ivec4) + sizeof(glm::vec4) + sizeof(int32_t) * _terrainTileCache.layerTable().size();
+	_terrainTileTableBuffer = createBuffer(tableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	_terrainPendingCopies.assign(_terrainTileCache.layerTable().size(), 0);
+
+	//the worker copies tiles out of the file into the staging ring, the GPU copies out of it
+	//	the layer table of every frame in flight is staged behind the ring
+	size_t stagingSize = _terrainTileFile.tileBytes() * TERRAIN_STAGING_SLOTS + sizeof(int32_t) * _terrainTileCache.layerTable().size() * FRAME_OVERLAP;
+	_terrainStagingBuffer = createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	for (uint32_t slot = 0; slot < TERRAIN_STAGING_SLOTS; slot++) _terrainFreeStagingSlots.push_back(slot);
+	_terrainTileStreamer.start(_terrainTileFile);
 
-	//add to deletion queues
 	_mainDeletionQueue.pushFunction(
-		[=]() {
-			vkDestroyImageView(_device, _heightMapImage.imageView, nullptr);
-			vmaDestroyImage(_allocator, _heightMapImage.image, _heightMapImage.allocation); //note that VMA allocated objects are deleted with VMA
+		[=, this]() {
+			//the worker may still write into the staging ring
+			_terrainTileStreamer.stop();
+			destroyBuffer(_terrainStagingBuffer);
+			destroyBuffer(_terrainTileTableBuffer);
+			for (const AllocatedImage& image : { _terrainHeightCacheImage, _terrainNormalCacheImage })
+			{
+				vkDestroyImageView(_device, image.imageView, nullptr);
+				vmaDestroyImage(_allocator, image.image, image.allocation); //note that VMA allocated objects are deleted with VMA
+			}
 		});
 
 	// DESCRIPTORS
-	//	descriptor layout
 	{
-		//	writing to descriptor set
-		_heightMapDescriptorSet = _globalDescriptorAllocator.allocate(_device, _heightMapDescriptorLayout);
+		_terrainTilesDescriptorSet = _globalDescriptorAllocator.allocate(_device, _terrainTilesDescriptorLayout);
 		DescriptorWriter writer;
-		writer.writeImage(0, _heightMapImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-		writer.updateSet(_device, _heightMapDescriptorSet);
-	}
-
-
-	//	PIPELINE
-	VkShaderModule computeShader;
-	if (!vkutil::loadShaderModule("./shaders/heightmap.comp.spv", _device, &computeShader))
-	{
-		fmt::print("error when building heightmap compute shader module\n");
+		writer.writeImage(0, _terrainHeightCacheImage.imageView, _linearSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(1, _terrainNormalCacheImage.imageView, _linearSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeBuffer(2, _terrainTileTableBuffer.buffer, tableSize, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		writer.updateSet(_device, _terrainTilesDescriptorSet);
 	}
-	else
-	{
-		fmt::print("heightmap compute shader loaded\n");
-	}
-
-	//push constant range
-	//VkPushConstantRange computeBufferRange{};
-	//computeBufferRange.offset = 0;
-	//computeBufferRange.size = sizeof(ComputePushConstants);
-	//computeBufferRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-	//sets
-
-	//build pipeline layout that controls the input/outputs of shader
-	//	note: no descriptor sets or other yet.
-	VkPipelineLayoutCreateInfo computePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
-	//computePipelineLayoutInfo.pPushConstantRanges = &computeBufferRange;
-	//computePipelineLayoutInfo.pushConstantRangeCount = 1;
-	computePipelineLayoutInfo.setLayoutCount = 1;
-	computePipelineLayoutInfo.pSetLayouts = &_heightMapDescriptorLayout;
-
-	VK_CHECK(vkCreatePipelineLayout(_device, &computePipelineLayoutInfo, nullptr, &_heightMapComputePipelineLayout));
-
-	VkPipelineShaderStageCreateInfo stageInfo{};
-	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	stageInfo.pNext = nullptr;
-	stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	stageInfo.pName = "main"; //name of entrypoint function
-	stageInfo.module = computeShader;
-
-	//create pipelines
-	VkComputePipelineCreateInfo computePipelineCreateInfo{};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineCreateInfo.pNext = nullptr;
-	computePipelineCreateInfo.layout = _heightMapComputePipelineLayout;
-	computePipelineCreateInfo.stage = stageInfo;
-
-	VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &_heightMapComputePipeline));
-
-	//clean structures
-	vkDestroyShaderModule(_device, computeShader, nullptr);
-
-	_mainDeletionQueue.pushFunction([&]() {
-		vkDestroyPipelineLayout(_device, _heightMapComputePipelineLayout, nullptr);
-		vkDestroyPipeline(_device, _heightMapComputePipeline, nullptr);
-		});
 
+	//the overview never leaves layer 0, the tiles around the spawn point are there before the first frame
+	AllocatedBuffer staging = createBuffer(_terrainTileFile.tileBytes(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	memcpy(staging.allocation->GetMappedData(), _terrainTileFile.overviewTexels(), _terrainTileFile.tileBytes());
+	struct {
+		glm::ivec4 info;
+		glm::vec4 heightRange;
+	} tableHeader = {
+		glm::ivec4(_terrainTileFile.tileSize(), _terrainTileFile.tileCount(), _terrainTileFile.mapSize(), 0),
+		glm::vec4(_terrainTileFile.heightScale(), _terrainTileFile.heightBias(), 0, 0)
+	};
 	immediateSubmit(
 		[&](VkCommandBuffer cmd) {
-			vkutil::transitionImage(cmd, _heightMapImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _heightMapComputePipeline);
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _heightMapComputePipelineLayout, 0, 1, &_heightMapDescriptorSet, 0, nullptr);
-			vkCmdDispatch(cmd, std::ceil(HEIGHT_MAP_SIZE / 16.0f), std::ceil(HEIGHT_MAP_SIZE / 16.0f), 1);
+			VkBufferImageCopy copy{};
+			copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.imageSubresource.baseArrayLayer = TerrainTileCache::OVERVIEW_LAYER;
+			copy.imageSubresource.layerCount = 1;
+			copy.imageExtent = imageExtent;
+			for (AllocatedImage* image : { &_terrainHeightCacheImage, &_terrainNormalCacheImage })
+			{
+				vkutil::transitionImage(cmd, image->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+				vkCmdCopyBufferToImage(cmd, staging.buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+				vkutil::transitionImage(cmd, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				copy.bufferOffset += _terrainTileFile.tileHeightBytes();
+			}
+			vkCmdUpdateBuffer(cmd, _terrainTileTableBuffer.buffer, 0, sizeof(tableHeader), &tableHeader);
 		}
 	);
+	destroyBuffer(staging);
 
-	if(false) 
+	//the tiles around the spawn point are there before the first frame, a staging ring at a time
+	//	note: every submit is waited for, so flushing the frame's deletion queue releases the staging slots right away
+	do
 	{
-		//create debug image view 
-		VkImageViewCreateInfo info{};
+		immediateSubmit([&](VkCommandBuffer cmd) {
+			streamTerrainTiles(cmd, TERRAIN_TILE_CACHE_LAYERS, true);
+			});
+		getCurrentFrame().deletionQueue.flush();
+	} while (!_terrainWaitingUploads.empty());
 
-		info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		info.pNext = nullptr;
+	if (bUseValidationLayers) validateTerrainHeightMap();
 
-		info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		info.image = _heightMapImage.image;
-		info.format = _heightMapImage.imageFormat;
-		info.subresourceRange.baseMipLevel = 0;
-		info.subresourceRange.levelCount = 1;
-		info.subresourceRange.baseArrayLayer = 0;
-		info.subresourceRange.layerCount = 1;
-		info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	{
+		//create debug image view, the unorm heights of the overview as grayscale
+		VkImageViewCreateInfo info = vkinit::imageViewCreateInfo(_terrainHeightCacheImage.imageFormat, _terrainHeightCacheImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		info.subresourceRange.baseArrayLayer = TerrainTileCache::OVERVIEW_LAYER;
 		info.components = {
-			VK_COMPONENT_SWIZZLE_A,
-			VK_COMPONENT_SWIZZLE_A,
-			VK_COMPONENT_SWIZZLE_A,
-			VK_COMPONENT_SWIZZLE_A
+			VK_COMPONENT_SWIZZLE_R,
+			VK_COMPONENT_SWIZZLE_R,
+			VK_COMPONENT_SWIZZLE_R,
+			VK_COMPONENT_SWIZZLE_ONE
 		};
-		vkCreateImageView(_device, &info, nullptr, &_heightMapDebugImageView);
+		vkCreateImageView(_device, &info, nullptr, &_terrainOverviewDebugImageView);
 		_mainDeletionQueue.pushFunction(
 			[=]() {
-				vkDestroyImageView(_device, _heightMapDebugImageView, nullptr);
+				vkDestroyImageView(_device, _terrainOverviewDebugImageView, nullptr);
 			});
 		//create debug descriptor set
 		DescriptorLayoutBuilder builder;
 		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 		VkDescriptorSetLayout layout = builder.build(_device, VK_SHADER_STAGE_FRAGMENT_BIT);
 
-		_heightMapSamplerDescriptorSet = _globalDescriptorAllocator.allocate(_device, layout, nullptr);
+		_terrainOverviewSamplerDescriptorSet = _globalDescriptorAllocator.allocate(_device, layout, nullptr);
 		DescriptorWriter writer;
-		writer.writeImage(0, _heightMapDebugImageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		writer.updateSet(_device, _heightMapSamplerDescriptorSet);
+		writer.writeImage(0, _terrainOverviewDebugImageView, _linearSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.updateSet(_device, _terrainOverviewSamplerDescriptorSet);
 
 		vkDestroyDescriptorSetLayout(_device, layout, nullptr);
 	}
@@ -2268,19 +3913,28 @@ void VulkanEngine::initShadowMapResources()
 			vkDestroyImageView(_device, _shadowMapImageArray.fullImageView, nullptr);
 		});
 
-	float scale = 1;
+	//static depth, same layers as the shadow map
+	_shadowStaticImageArray.imageFormat = _shadowMapImageArray.imageFormat;
+	_shadowStaticImageArray.imageExtent = imageExtent;
+	imgInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	VK_CHECK(vmaCreateImage(_allocator, &imgInfo, &imgAllocInfo, &_shadowStaticImageArray.image, &_shadowStaticImageArray.allocation, nullptr));
+	viewInfo.image = _shadowStaticImageArray.image;
+	VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &_shadowStaticImageArray.imageView));
+	_mainDeletionQueue.pushFunction(
+		[=]() {
+			vkDestroyImageView(_device, _shadowStaticImageArray.imageView, nullptr);
+			vmaDestroyImage(_allocator, _shadowStaticImageArray.image, _shadowStaticImageArray.allocation);
+		});
+	//	note: kept in DEPTH_READ_ONLY between frames, every cascade refreshes on the first frame
+	immediateSubmit([&](VkCommandBuffer cmd) {
+		vkutil::transitionImage(cmd, _shadowStaticImageArray.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+		});
+	_shadowStaticTimer = _gpuTimer.addRegion("shadow static depth");
+	_shadowGrassTimer = _gpuTimer.addRegion("shadow grass");
+
 	_shadowMapImageArray.imageViews.resize(CSM_COUNT);
 	for (int i = 0; i < CSM_COUNT; i++)
 	{
-		glm::mat4 projection =
-			glm::ortho(-(10.0) * scale, 10.0 * scale,
-				(10.0) * scale, -10.0 * scale,
-				-1050.0, 1050.0);
-		//200.0, 0.0);
-		_shadowMapSceneData[i].proj = projection;
-
-		scale *= CSM_SCALE;
-
 		//build image views for the drawing to individual cascades
 		VkImageViewCreateInfo viewInfo{};
 		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -2308,6 +3962,7 @@ void VulkanEngine::initShadowMapResources()
 	{
 		DescriptorLayoutBuilder builder;
 		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 		_shadowMapDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_FRAGMENT_BIT);
 	}
 	//	deletion
@@ -2320,8 +3975,29 @@ void VulkanEngine::initShadowMapResources()
 		_shadowMapDescriptorSet = _globalDescriptorAllocator.allocate(_device, _shadowMapDescriptorLayout);
 		DescriptorWriter writer;
 		writer.writeImage(0, _shadowMapImageArray.fullImageView, _defaultSampler, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(1, _shadowStaticImageArray.imageView, _defaultSampler, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 		writer.updateSet(_device, _shadowMapDescriptorSet);
 	}
+	//	shadow mask resolve, see drawDeferred
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		_shadowMaskDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+		_shadowMaskDescriptorSet = _globalDescriptorAllocator.allocate(_device, _shadowMaskDescriptorLayout);
+		DescriptorWriter writer;
+		writer.writeImage(0, _shadowMaskImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.writeImage(1, _depthImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(2, _shadowMapImageArray.fullImageView, _defaultSampler, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(3, _shadowStaticImageArray.imageView, _defaultSampler, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.updateSet(_device, _shadowMaskDescriptorSet);
+	}
+	_mainDeletionQueue.pushFunction([&]() {
+		vkDestroyDescriptorSetLayout(_device, _shadowMaskDescriptorLayout, nullptr);
+		});
 	
 
 	//PIPELINES
@@ -2519,6 +4195,205 @@ void VulkanEngine::initShadowMapResources()
 	}
 }
 
+void VulkanEngine::initReflectionResources()
+{
+	//IMAGES
+	VmaAllocationCreateInfo imgAllocInfo{};
+	imgAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY; //never accessed from cpu
+	imgAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT); //only gpu-side VRAM, fastest access
+
+	//	half resolution, texel n holds pixel 2n
+	VkExtent3D halfExtent = {
+		(_drawImage.imageExtent.width + 1) / 2,
+		(_drawImage.imageExtent.height + 1) / 2,
+		1
+	};
+	AllocatedImage* ssrImages[] = { &_ssrTraceImage, &_ssrImage, &_ssrHistoryImage };
+	for (AllocatedImage* image : ssrImages)
+	{
+		image->imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		image->imageExtent = halfExtent;
+		VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(image->imageFormat,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, halfExtent);
+		vmaCreateImage(_allocator, &imgInfo, &imgAllocInfo, &image->image, &image->allocation, nullptr);
+		VkImageViewCreateInfo viewInfo = vkinit::imageViewCreateInfo(image->imageFormat, image->image, VK_IMAGE_ASPECT_COLOR_BIT);
+		VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr, &image->imageView));
+	}
+
+	//	hi-z, padded so every mip is exactly half of the one before it
+	uint32_t padding = 1u << (SSR_HIZ_MIPS - 1);
+	_hiZImage.imageFormat = VK_FORMAT_R32_SFLOAT;
+	_hiZImage.imageExtent = {
+		(halfExtent.width + padding - 1) / padding * padding,
+		(halfExtent.height + padding - 1) / padding * padding,
+		1
+	};
+	VkImageCreateInfo hiZInfo = vkinit::imageCreateInfo(_hiZImage.imageFormat, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, _hiZImage.imageExtent);
+	hiZInfo.mipLevels = SSR_HIZ_MIPS;
+	vmaCreateImage(_allocator, &hiZInfo, &imgAllocInfo, &_hiZImage.image, &_hiZImage.allocation, nullptr);
+	VkImageViewCreateInfo hiZViewInfo = vkinit::imageViewCreateInfo(_hiZImage.imageFormat, _hiZImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	hiZViewInfo.subresourceRange.levelCount = SSR_HIZ_MIPS;
+	VK_CHECK(vkCreateImageView(_device, &hiZViewInfo, nullptr, &_hiZImage.imageView));
+	_hiZMipViews.resize(SSR_HIZ_MIPS);
+	for (int i = 0; i < SSR_HIZ_MIPS; i++)
+	{
+		hiZViewInfo.subresourceRange.baseMipLevel = i;
+		hiZViewInfo.subresourceRange.levelCount = 1;
+		VK_CHECK(vkCreateImageView(_device, &hiZViewInfo, nullptr, &_hiZMipViews[i]));
+	}
+
+	_mainDeletionQueue.pushFunction(
+		[=]() {
+			for (AllocatedImage* image : ssrImages)
+			{
+				vkDestroyImageView(_device, image->imageView, nullptr);
+				vmaDestroyImage(_allocator, image->image, image->allocation);
+			}
+			for (VkImageView view : _hiZMipViews) vkDestroyImageView(_device, view, nullptr);
+			vkDestroyImageView(_device, _hiZImage.imageView, nullptr);
+			vmaDestroyImage(_allocator, _hiZImage.image, _hiZImage.allocation);
+		});
+
+	//	the reflection images stay in GENERAL, the history starts out empty
+	immediateSubmit([&](VkCommandBuffer cmd) {
+		for (AllocatedImage* image : ssrImages)
+		{
+			vkutil::transitionImage(cmd, image->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		}
+		VkClearColorValue clearValue{ .float32 = { 0.f,0.f,0.f,0.f } };
+		VkImageSubresourceRange range = vkinit::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+		vkCmdClearColorImage(cmd, _ssrHistoryImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &range);
+		});
+
+	//DESCRIPTOR SET LAYOUTS
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		builder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		_hiZDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		for (uint32_t i = 1; i <= 6; i++) builder.addBinding(i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		_ssrDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	{
+		DescriptorLayoutBuilder builder;
+		builder.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		for (uint32_t i = 1; i <= 3; i++) builder.addBinding(i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		_ssrTemporalDescriptorLayout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+	_mainDeletionQueue.pushFunction([&]() {
+		vkDestroyDescriptorSetLayout(_device, _hiZDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _ssrDescriptorLayout, nullptr);
+		vkDestroyDescriptorSetLayout(_device, _ssrTemporalDescriptorLayout, nullptr);
+		});
+
+	//DESCRIPTOR SETS
+	_hiZDescriptorSets.resize(SSR_HIZ_MIPS);
+	for (int i = 0; i < SSR_HIZ_MIPS; i++)
+	{
+		_hiZDescriptorSets[i] = _globalDescriptorAllocator.allocate(_device, _hiZDescriptorLayout);
+		DescriptorWriter writer;
+		if (i == 0)
+			writer.writeImage(0, _depthImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		else
+			writer.writeImage(0, _hiZMipViews[i - 1], _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(1, _hiZMipViews[i], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.updateSet(_device, _hiZDescriptorSets[i]);
+	}
+	{
+		_ssrDescriptorSet = _globalDescriptorAllocator.allocate(_device, _ssrDescriptorLayout);
+		DescriptorWriter writer;
+		writer.writeImage(0, _ssrTraceImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.writeImage(1, _depthImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(2, _hiZImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(3, _drawImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(4, _normalsImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(5, _specularMapImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(6, _shadowMaskImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.updateSet(_device, _ssrDescriptorSet);
+	}
+	{
+		_ssrTemporalDescriptorSet = _globalDescriptorAllocator.allocate(_device, _ssrTemporalDescriptorLayout);
+		DescriptorWriter writer;
+		writer.writeImage(0, _ssrImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.writeImage(1, _ssrTraceImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(2, _ssrHistoryImage.imageView, _linearSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.writeImage(3, _depthImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.updateSet(_device, _ssrTemporalDescriptorSet);
+	}
+	{
+		//	the deferred pass reads the accumulated reflections
+		DescriptorWriter writer;
+		writer.writeImage(7, _ssrImage.imageView, _defaultSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.updateSet(_device, _drawImageDescriptors);
+	}
+
+	//PIPELINES
+	auto createPipelineLayout = [&](VkDescriptorSetLayout* layouts, uint32_t layoutCount, VkPipelineLayout& pipelineLayout) {
+		VkPushConstantRange computeBufferRange{};
+		computeBufferRange.offset = 0;
+		computeBufferRange.size = sizeof(ComputePushConstants);
+		computeBufferRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkPipelineLayoutCreateInfo computePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+		computePipelineLayoutInfo.pPushConstantRanges = &computeBufferRange;
+		computePipelineLayoutInfo.pushConstantRangeCount = 1;
+		computePipelineLayoutInfo.setLayoutCount = layoutCount;
+		computePipelineLayoutInfo.pSetLayouts = layouts;
+		VK_CHECK(vkCreatePipelineLayout(_device, &computePipelineLayoutInfo, nullptr, &pipelineLayout));
+	};
+	auto loadShader = [&](const char* path) {
+		VkShaderModule shader;
+		if (!vkutil::loadShaderModule(path, _device, &shader))
+		{
+			fmt::print("error when building {}\n", path);
+		}
+		return shader;
+	};
+	VkDescriptorSetLayout ssrLayouts[] = { _sceneDataDescriptorLayout, _ssrDescriptorLayout };
+	VkDescriptorSetLayout ssrTemporalLayouts[] = { _sceneDataDescriptorLayout, _ssrTemporalDescriptorLayout };
+	createPipelineLayout(&_hiZDescriptorLayout, 1, _hiZPipelineLayout);
+	createPipelineLayout(ssrLayouts, 2, _ssrPipelineLayout);
+	createPipelineLayout(ssrTemporalLayouts, 2, _ssrTemporalPipelineLayout);
+
+	VkShaderModule hiZShader = loadShader("./shaders/hiz.comp.spv");
+	VkShaderModule ssrShader = loadShader("./shaders/ssr.comp.spv");
+	VkShaderModule ssrTemporalShader = loadShader("./shaders/ssr_temporal.comp.spv");
+	_hiZKernel = _workgroupTuner.addKernel("hiz", { "./shaders/hiz.comp.spv" }, { 16, 16 });
+	_ssrKernel = _workgroupTuner.addKernel("ssr", { "./shaders/ssr.comp.spv" }, { 16, 16 });
+	_ssrTemporalKernel = _workgroupTuner.addKernel("ssr_temporal", { "./shaders/ssr_temporal.comp.spv" }, { 16, 16 });
+	auto initTunedPipelines = [&](vkutil::PipelinePermutations<WorkgroupSize>& pipelines, VkPipelineLayout layout, VkShaderModule shader) {
+		pipelines.init([=, this](const WorkgroupSize& size) {
+			vkutil::SpecializationConstants constants;
+			size.specialize(constants);
+			return vkutil::buildComputePipeline(_device, layout, shader, constants.info());
+		});
+	};
+	initTunedPipelines(_hiZPipelines, _hiZPipelineLayout, hiZShader);
+	initTunedPipelines(_ssrTemporalPipelines, _ssrTemporalPipelineLayout, ssrTemporalShader);
+	_ssrPipelines.init([=, this](const std::pair<int, WorkgroupSize>& key) {
+		vkutil::SpecializationConstants constants;
+		constants.add(0, key.first);
+		key.second.specialize(constants);
+		return vkutil::buildComputePipeline(_device, _ssrPipelineLayout, ssrShader, constants.info());
+	});
+
+	_mainDeletionQueue.pushFunction([=, this]() {
+		vkDestroyPipelineLayout(_device, _hiZPipelineLayout, nullptr);
+		_hiZPipelines.destroy(_device);
+		vkDestroyShaderModule(_device, hiZShader, nullptr);
+		vkDestroyPipelineLayout(_device, _ssrPipelineLayout, nullptr);
+		_ssrPipelines.destroy(_device);
+		vkDestroyShaderModule(_device, ssrShader, nullptr);
+		vkDestroyPipelineLayout(_device, _ssrTemporalPipelineLayout, nullptr);
+		_ssrTemporalPipelines.destroy(_device);
+		vkDestroyShaderModule(_device, ssrTemporalShader, nullptr);
+		});
+}
+
 void VulkanEngine::initWindMap()
 {
 	//IMAGE
@@ -2534,7 +4409,7 @@ void VulkanEngine::initWindMap()
 
 	VkImageUsageFlags imageUsageFlags{};
 	imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;			//compute shader can write to image
-	if (bUseValidationLayers) imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageUsageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;			//grass reads it with filtered fetches
 
 	VkImageCreateInfo imgInfo = vkinit::imageCreateInfo(_windMapImage.imageFormat, imageUsageFlags, imageExtent);
 
@@ -2612,28 +4487,30 @@ void VulkanEngine::initWindMap()
 
 	VK_CHECK(vkCreatePipelineLayout(_device, &computePipelineLayoutInfo, nullptr, &_windMapComputePipelineLayout));
 
-	VkPipelineShaderStageCreateInfo stageInfo{};
-	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	stageInfo.pNext = nullptr;
-	stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	stageInfo.pName = "main"; //name of entrypoint function
-	stageInfo.module = computeShader;
-
-	//create pipelines
-	VkComputePipelineCreateInfo computePipelineCreateInfo{};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineCreateInfo.pNext = nullptr;
-	computePipelineCreateInfo.layout = _windMapComputePipelineLayout;
-	computePipelineCreateInfo.stage = stageInfo;
-
-	VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &_windMapComputePipeline));
-
-	//clean structures
-	vkDestroyShaderModule(_device, computeShader, nullptr);
+	//create pipelines, one per workgroup size
+	_windMapKernel = _workgroupTuner.addKernel("windmap", { "./shaders/windmap.comp.spv" }, { 8, 8 });
+	_windMapComputePipelines.init([=, this](const WorkgroupSize& size) {
+		vkutil::SpecializationConstants constants;
+		size.specialize(constants);
+		return vkutil::buildComputePipeline(_device, _windMapComputePipelineLayout, computeShader, constants.info());
+	});
 
-	_mainDeletionQueue.pushFunction([&]() {
+	_mainDeletionQueue.pushFunction([=, this]() {
 		vkDestroyPipelineLayout(_device, _windMapComputePipelineLayout, nullptr);
-		vkDestroyPipeline(_device, _windMapComputePipeline, nullptr);
+		_windMapComputePipelines.destroy(_device);
+		vkDestroyShaderModule(_device, computeShader, nullptr);
+		});
+
+	//the first two keys are built completely, the third one is built over the first frames
+	float keyInterval = _windKeyFrames / 60.f;
+	_windKeyTimes[0] = _time;
+	_windKeyTimes[1] = _time + keyInterval;
+	_windKeyTimes[2] = _time + 2 * keyInterval;
+	immediateSubmit([&](VkCommandBuffer cmd) {
+		vkutil::transitionImage(cmd, _windMapImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+		dispatchWindRows(cmd, 0, _windKeyTimes[0], 0, _windMapImage.imageExtent.height);
+		vkutil::transitionImage(cmd, _windMapImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+		dispatchWindRows(cmd, 1, _windKeyTimes[1], 0, _windMapImage.imageExtent.height);
 		});
 
 	{
@@ -3,11 +3,23 @@
 #include "vk_types.hpp"
 #include "vk_loader.hpp"
 #include "vk_descriptors.hpp"
+#include "vk_pipelines.hpp"
 #include "player.hpp"
 #include "vk_engine_settings.hpp"
+#include "asset_cache.hpp"
+#include "workgroup_tuner.hpp"
+#include "gpu_timer.hpp"
 
 #include "./Scene/clouds.hpp"
 #include "Scene/water.hpp"
+#include "Scene/grass_tiles.hpp"
+#include "Scene/terrain_heightmap.hpp"
+#include "Scene/terrain_lod.hpp"
+#include "Scene/terrain_tile_cache.hpp"
+#include "Scene/terrain_tile_file.hpp"
+#include "Scene/terrain_tile_streamer.hpp"
+
+#include <future>
 
 
 class VulkanEngine
@@ -24,6 +36,8 @@ public:
 		glm::vec4 sunlightColor;
 		glm::mat4 sunViewProj[CSM_COUNT];
 		glm::vec4 time;
+		glm::mat4 inverseViewProj;
+		glm::mat4 previousViewProj; //viewProj of the last frame, for reprojection
 	};
 	struct EngineStats
 	{
@@ -91,6 +105,10 @@ public:
 
 		DescriptorAllocatorGrowable descriptorAllocator;
 
+		//per frame upload buffers, persistently mapped and grown with reserveBuffer
+		AllocatedBuffer grassVisibleSlotBuffer{}; //slots grass_animate.comp animates, see updateGrassData
+		AllocatedBuffer grassShadowCascadeBuffer{}; //CSM_COUNT GrassShadowCascade
+		AllocatedBuffer terrainPatchBuffer{}; //TerrainPatch of every view, see updateTerrainPatches
 	};
 
 	bool _isInitialized{ false };
@@ -113,6 +131,8 @@ public:
 	std::vector<VkImage> _swapchainImages;
 	std::vector<VkImageView> _swapchainImageViews;
 	VkExtent2D _swapchainExtent;
+	bool _swapchainStorage = false; //the swapchain images can be written by deferred.comp, see createSwapchain
+	bool _storageWriteWithoutFormat = false; //shaderStorageImageWriteWithoutFormat, the bgra swapchain has no glsl format
 
 	FrameData _frames[FRAME_OVERLAP];
 	FrameData& getCurrentFrame() { return _frames[_frameNumber % FRAME_OVERLAP]; };
@@ -130,10 +150,18 @@ public:
 	AllocatedImage _positionsImage;
 	AllocatedImage _specularMapImage; 
 	AllocatedImage _finalDrawImage;
+	AllocatedImage _shadowMaskImage; //sun shadowing per pixel, resolved from the depth buffer before the deferred pass
+	AllocatedImage _visibilityImage; //visible grass blade triangle per pixel, see _grassVisibility.glsl
 	AllocatedImage _noiseImage;
 	VkExtent2D _drawExtent;
 	float _renderScale = 1.f;
+	int _qualityPreset = QUALITY_PRESET;
+	QualitySettings _quality = QUALITY_PRESETS[QUALITY_PRESET].settings; //selects the pipeline permutations, see vkutil::PipelinePermutations
+	QualitySettings _qualityEdit = _quality; //edited by the sliders, applied to _quality when a slider is released
+	bool _qualityPresetChanged = false; //the pipelines of the old settings are released by the next draw
 	VkSampler _defaultSampler;
+	VkSampler _linearSampler; //bilinear, clamps to the edge
+	VkSampler _linearRepeatSampler; //bilinear, wraps around
 
 	//shader descriptors
 	DescriptorAllocatorGrowable _globalDescriptorAllocator;
@@ -151,7 +179,49 @@ public:
 
 	//deferred pipeline
 	VkPipelineLayout _deferredPipelineLayout;
-	VkPipeline _deferredPipeline;
+	//specialized per tile class, see _deferredTiles.glsl, keyed on reflection steps, refine steps and whether it is deferred_swapchain.comp
+	vkutil::PipelinePermutations<std::tuple<int, int, bool>> _deferredPipelines[DEFERRED_TILE_CLASS_COUNT];
+	VkDescriptorSetLayout _deferredOutputDescriptorLayout; //_finalDrawImage or the swapchain image, written every frame
+	VkPipeline _deferredClassifyPipeline;
+	VkDescriptorSetLayout _deferredTilesDescriptorLayout;
+	VkDescriptorSet _deferredTilesDescriptorSet;
+	AllocatedBuffer _deferredDispatchBuffer;
+	AllocatedBuffer _deferredTileBuffer;
+	uint32_t _deferredTileCapacity; //tiles per class
+	VkDescriptorSetLayout _shadowMaskDescriptorLayout;
+	VkDescriptorSet _shadowMaskDescriptorSet;
+	VkPipelineLayout _shadowMaskPipelineLayout;
+	//scales _finalDrawImage to the swapchain when deferred.comp can not write it directly
+	VkDescriptorSetLayout _resolveDescriptorLayout;
+	VkDescriptorSet _resolveDescriptorSet;
+	VkPipelineLayout _resolvePipelineLayout;
+	VkPipeline _resolvePipeline;
+	vkutil::PipelinePermutations<std::pair<int, WorkgroupSize>> _shadowMaskPipelines; //keyed on the filter radius
+	int _shadowMaskKernel;
+	bool _shadowMaskHalfResolution = SHADOW_MASK_HALF_RESOLUTION;
+
+	//reflections, see drawReflections
+	AllocatedImage _hiZImage; //closest depth of 2x2, 4x4, ... pixel blocks, padded to a multiple of the smallest mip
+	std::vector<VkImageView> _hiZMipViews;
+	std::vector<VkDescriptorSet> _hiZDescriptorSets; //one per mip, reads the level before it
+	AllocatedImage _ssrTraceImage; //half resolution reflections of this frame
+	AllocatedImage _ssrImage; //accumulated reflections, read by deferred.comp
+	AllocatedImage _ssrHistoryImage; //_ssrImage of the last frame
+	VkDescriptorSetLayout _hiZDescriptorLayout;
+	VkDescriptorSetLayout _ssrDescriptorLayout;
+	VkDescriptorSetLayout _ssrTemporalDescriptorLayout;
+	VkDescriptorSet _ssrDescriptorSet;
+	VkDescriptorSet _ssrTemporalDescriptorSet;
+	VkPipelineLayout _hiZPipelineLayout;
+	vkutil::PipelinePermutations<WorkgroupSize> _hiZPipelines;
+	VkPipelineLayout _ssrPipelineLayout;
+	vkutil::PipelinePermutations<std::pair<int, WorkgroupSize>> _ssrPipelines; //keyed on the reflection steps
+	VkPipelineLayout _ssrTemporalPipelineLayout;
+	vkutil::PipelinePermutations<WorkgroupSize> _ssrTemporalPipelines;
+	int _hiZKernel;
+	int _ssrKernel;
+	int _ssrTemporalKernel;
+	bool _useHiZReflections = SSR_HIZ;
 
 	//mesh pipeline
 	VkDescriptorSetLayout _sceneDataDescriptorLayout;
@@ -164,7 +234,6 @@ public:
 	//scene
 	Player _player;
 	SceneData _sceneData;
-	glm::vec3 _sunPosition;
 	float _time = 0;
 	bool _isSunMoving = true;
 
@@ -176,27 +245,114 @@ public:
 
 	//grass
 	bool _settingsChanged = true;
+	//placement pattern generated off the render thread, swapped in by updateGrassData once ready
+	struct GrassPatternResult
+	{
+		std::vector<glm::vec4> pattern;
+		int density;
+		int maxDistance;
+		float generationTime; //ms
+	};
+	std::future<GrassPatternResult> _grassPatternFuture;
+	bool _grassPatternInline = false; //the future was deferred and generates on the render thread
+	bool _grassRebuildInline = false; //comparison path: pattern on the render thread and every tile in one frame
+	//the new configuration is generated into these over several frames while the current one keeps drawing
+	//	swapped with the live pool and buffers once every resident tile is generated
+	bool _grassBuilding = false;
+	GrassTilePool _grassBuildTiles;
+	AllocatedBuffer _grassBuildDataBuffer{};
+	AllocatedBuffer _grassBuildIndirectBuffer{};
+	AllocatedBuffer _grassBuildPatternBuffer{};
+	int _grassBuildDensity = 0;
+	int _grassBuildMaxDistance = 0;
+	//measured cost of the last rebuild, printed once the gpu times of all its frames are read back
+	struct GrassRebuildStats
+	{
+		bool inlinePath = false;
+		uint32_t blades = 0;
+		float patternTime = 0; //ms, on the render thread only for the inline path
+		int frames = 0; //frames that generated tiles of the build
+		float cpuTime = 0, maxCpuTime = 0; //ms of render thread time in updateGrassData, total and worst frame
+		int gpuFrames = 0;
+		float gpuTime = 0, maxGpuTime = 0; //ms of the build dispatches, total and worst frame
+		bool reported = false;
+	};
+	GrassRebuildStats _grassRebuildStats;
+	int _grassRebuildTimer = 0; //_gpuTimer region
 	int _grassCount = 0;
 	int _maxGrassDistance = 100;
 	int _grassDensity = 6;
 	int UI_maxGrassDistance = 100;
 	int UI_grassDensity = 6;
+	int _grassFarFieldBlend = 30; //meters before _maxGrassDistance where blades fade into the far field grass on the ground
 	VkPipelineLayout _grassPipelineLayout;
 	VkPipeline _grassPipeline;
 	VkPipelineLayout _grassComputePipelineLayout;
 	VkPipeline _grassComputePipeline;
+	VkPipelineLayout _grassAnimatePipelineLayout;
+	VkPipeline _grassAnimatePipeline;
+	//mesh shader grass, only created when VK_EXT_mesh_shader is supported. otherwise _grassPipeline is used
+	bool _meshShaderSupported = false;
+	bool _useMeshShaderGrass = true;
+	int _grassMeshLodDistance = 30; //blades further away are drawn as a single triangle
+	PFN_vkCmdDrawMeshTasksEXT _vkCmdDrawMeshTasksEXT = nullptr;
+	VkPipelineLayout _grassMeshPipelineLayout;
+	VkPipeline _grassMeshPipeline;
+	//visibility buffer grass, only depth and the blade triangle are drawn and grass_material.comp fills the G-buffer
+	//	note: the blade triangle comes from its provoking vertex, see getProvokedTriangle in _grassVisibility.glsl
+	bool _useVisibilityBuffer = false;
+	VkPipeline _grassVisibilityPipeline;
+	VkPipeline _grassMeshVisibilityPipeline;
+	VkDescriptorSetLayout _grassMaterialDescriptorLayout;
+	VkDescriptorSet _grassMaterialDescriptorSet;
+	VkPipelineLayout _grassMaterialPipelineLayout;
+	vkutil::PipelinePermutations<WorkgroupSize> _grassMaterialPipelines;
+	int _grassMaterialKernel;
 	VkDescriptorSetLayout _grassDataDescriptorLayout;
 	VkDescriptorSet _grassDataDescriptorSet;
-	AllocatedBuffer _grassDataBuffer;
-	std::shared_ptr<MeshAsset> _grassMesh;
+	AllocatedBuffer _grassDataBuffer{};
+	AllocatedBuffer _grassPatternBuffer{};
+	AllocatedBuffer _grassIndirectBuffer{}; //one VkDrawIndexedIndirectCommand per tile slot, instanceCount is the blade count
+	AllocatedBuffer _grassAnimatedBuffer{}; //AnimatedGrassBlade per instance, rewritten every frame
+	AllocatedBuffer _grassShadowInstanceBuffer{}; //CSM_COUNT lists of _grassCount instance indices
+	AllocatedBuffer _grassShadowIndirectBuffer{}; //one VkDrawIndexedIndirectCommand per cascade
+	AllocatedBuffer _grassLodInstanceBuffer{}; //GRASS_LOD_COUNT lists of _grassCount instance indices
+	AllocatedBuffer _grassLodIndirectBuffer{}; //one VkDrawIndexedIndirectCommand per segment lod of the main pass
+	GrassTilePool _grassTiles;
+	std::vector<GrassTilePool::DrawRange> _grassDrawRanges[1 + CSM_COUNT]; //culled slots, [0] = main view, [1+i] = shadow cascade i (only used to pick the slots to animate)
+	int _grassVisibleSlotCount = 0; //slots visible in any view this frame, see animateGrass
+	int UI_visibleGrassTiles = 0;
+	std::shared_ptr<MeshAsset> _grassMesh; //surface i is the index range of segment lod i
 	std::shared_ptr<MeshAsset> _lowQualityGrassMesh;
 
 	//terrain
-	AllocatedImage _heightMapImage;
-	VkPipelineLayout _heightMapComputePipelineLayout;
-	VkPipeline _heightMapComputePipeline;
-	VkDescriptorSetLayout _heightMapDescriptorLayout;
-	VkDescriptorSet _heightMapDescriptorSet;
+	TerrainTileFile _terrainTileFile; //memory mapped, every terrain texel comes from here
+	TerrainHeightMap _terrainHeightMap; //CPU queries for collisions and placement, reads through _terrainTileFile
+	TerrainTileCache _terrainTileCache;
+	TerrainTileStreamer _terrainTileStreamer;
+	AllocatedBuffer _terrainStagingBuffer; //ring of TERRAIN_STAGING_SLOTS tiles written by _terrainTileStreamer, then one layer table per frame in flight
+	std::vector<uint32_t> _terrainFreeStagingSlots;
+	std::deque<TerrainTileCache::Upload> _terrainWaitingUploads; //have a layer, wait for a staging slot
+	std::vector<int> _terrainPendingCopies; //per tile, copies not recorded yet, the table keeps these tiles on the overview
+	AllocatedImage _terrainHeightCacheImage; //one tile per layer, layer 0 is the overview
+	AllocatedImage _terrainNormalCacheImage; //same layers as the heights
+	VkImageView _terrainOverviewDebugImageView; //heights of the overview layer
+	VkDescriptorSet _terrainOverviewSamplerDescriptorSet;
+	AllocatedBuffer _terrainTileTableBuffer; //indirection from tile to cache layer, see _terrainTiles.glsl
+	VkDescriptorSetLayout _terrainTilesDescriptorLayout;
+	VkDescriptorSet _terrainTilesDescriptorSet;
+	TerrainLod _terrainLod;
+	float _terrainPixelError = 2.f; //vertex spacing in pixels a lod level may reach before the next finer one is used
+	struct TerrainPatchRange {
+		uint32_t firstPatch;
+		uint32_t patchCount;
+	} _terrainPatchRanges[1 + CSM_COUNT]{}; //selected patches, [0] = main view, [1+i] = shadow cascade i
+	VkDescriptorSetLayout _terrainDescriptorLayout;
+	VkDescriptorSet _terrainDescriptorSet; //per frame, patches
+	VkPipelineLayout _terrainPipelineLayout;
+	VkPipeline _terrainPipeline;
+	VkPipelineLayout _shadowTerrainPipelineLayout;
+	VkPipeline _shadowTerrainPipeline;
 	VkImageView _heightMapDebugImageView;
 	VkDescriptorSet _heightMapSamplerDescriptorSet;
 
@@ -206,7 +362,20 @@ public:
 	} _shadowMapData;
 	AllocatedImageArray _shadowMapImageArray;
 	AllocatedBuffer _shadowMapDataBuffer;
-	SceneData _shadowMapSceneData[CSM_COUNT];
+	SceneData _shadowMapSceneData[CSM_COUNT]; //matrices the cascades were last refreshed with, see updateShadowCascades
+	//static depth (terrain and meshes) of every cascade, only redrawn when the cascade refreshes
+	//	the shadow map only holds the animated grass, the shadow lookups take the min of both
+	AllocatedImage _shadowStaticImageArray;
+	int _shadowStaticTimer = 0; //_gpuTimer regions
+	int _shadowGrassTimer = 0;
+	struct ShadowCascadeCache {
+		glm::vec3 center;		//bounding sphere of the frustum slice the cascade was fitted to
+		float radius = 0;
+		glm::vec3 sunDirection;
+		int refreshFrame = -1;	//-1 = never drawn
+	} _shadowCascadeCache[CSM_COUNT];
+	bool _shadowCascadeRefresh[CSM_COUNT]{}; //cascades whose static depth is redrawn this frame
+	float _shadowSplitLambda = SHADOW_SPLIT_LAMBDA;
 
 	VkDescriptorSetLayout _shadowMapDescriptorLayout;
 	VkDescriptorSet _shadowMapDescriptorSet;
@@ -221,12 +390,19 @@ public:
 	//wind
 	AllocatedImage _windMapImage;
 	VkPipelineLayout _windMapComputePipelineLayout; 
-	VkPipeline _windMapComputePipeline;
+	vkutil::PipelinePermutations<WorkgroupSize> _windMapComputePipelines;
+	int _windMapKernel;
 	VkDescriptorSetLayout _windMapDescriptorLayout;
 	VkDescriptorSet _windMapDescriptorSet;
 
 	VkImageView _windMapDebugImageView;
 	VkDescriptorSet _windMapSamplerDescriptorSet;
+	//	note: rgb of _windMapImage hold three keys of the field, see updateWindMap
+	glm::vec2 _windVelocity{ -1.f, -4.f }; //prevailing wind in meters per second, the field scrolls with it
+	int _windKeyFrames = 16; //frames it takes to build a key, every frame re-evaluates 1/_windKeyFrames of the texels
+	int _windBuildKey = 2; //key being built, keys _windBuildKey-2 and _windBuildKey-1 are blended
+	int _windBuildRow = 0;
+	float _windKeyTimes[3]{}; //time the key in each channel was evaluated for
 
 	//skybox
 	std::shared_ptr<MeshAsset> _skyboxMesh;
@@ -248,21 +424,42 @@ public:
 	//draw loop
 	void draw();
 	void drawBackground(VkCommandBuffer cmd);
-	void drawImGui(VkCommandBuffer cmd, VkImageView targetImageView);
+	void drawImGui(VkCommandBuffer cmd, VkImageView targetImageView, bool resolve);
 	void drawGeometry(VkCommandBuffer cmd);
+	void drawGrassVisibility(VkCommandBuffer cmd, VkDescriptorSet sceneDataDescriptorSet, GPUDrawPushConstants& pushConstants);
+	void updateShadowCascades();
 	void drawShadowMap(VkCommandBuffer cmd);
 
-	void drawDeferred(VkCommandBuffer cmd);
+	void drawReflections(VkCommandBuffer cmd, VkDescriptorSet sceneDataDescriptorSet);
+	void releaseQualityPipelines();
+	void drawDeferred(VkCommandBuffer cmd, VkImageView targetImageView, bool swapchainOutput);
 
 	void updateGrassData(VkCommandBuffer cmd);
+	void generateGrassTiles(VkCommandBuffer cmd, const std::vector<GrassTilePool::Tile>& tiles, uint32_t bladesPerTile,
+		const AllocatedBuffer& dataBuffer, const AllocatedBuffer& indirectBuffer, VkDescriptorSet descriptorSet);
+	void reportGrassRebuild();
+	void animateGrass(VkCommandBuffer cmd);
+	void updateTerrainPatches();
+	//wait blocks until the worker copied every requested tile, only for startup
+	void streamTerrainTiles(VkCommandBuffer cmd, int maxUploads, bool wait = false);
+	void drawGrassLods(VkCommandBuffer cmd);
+	void drawGrassMeshTasks(VkCommandBuffer cmd, int view, GPUDrawPushConstants& pushConstants);
 
 	//run main loop
 	void run();
 
 	void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
+	//uploads the images from the asset cache, on a miss runs generate and stores its result in the cache
+	//	note: the images need transfer src and dst usage, generate has to leave them in GENERAL and so does a cache hit
+	void generateCachedImages(const std::string& name, const AssetCache::Key& key, const std::vector<AllocatedImage*>& images,
+		std::function<void(VkCommandBuffer cmd)>&& generate);
+	AssetCache _assetCache{ ASSET_CACHE_DIRECTORY };
+	WorkgroupTuner _workgroupTuner;
+	GpuTimer _gpuTimer;
 
 	//buffers
 	AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+	bool reserveBuffer(AllocatedBuffer& buffer, size_t requiredSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
 	void destroyBuffer(const AllocatedBuffer& buffer);
 
 	GPUMeshBuffers uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
@@ -270,6 +467,7 @@ public:
 	//scene
 	void updateScene(float deltaTime);
 	void updateWindMap(VkCommandBuffer cmd);
+	void dispatchWindRows(VkCommandBuffer cmd, int channel, float keyTime, int firstRow, int rowCount);
 
 private:
 
@@ -287,6 +485,7 @@ private:
 	void initPipelines();
 	void initBackgroundPipelines();
 	void initDeferredPipelines();
+	void initResolvePipeline();
 
 	void initSampler();
 
@@ -294,6 +493,7 @@ private:
 
 	void initMeshPipeline();
 	void initGrassPipeline();
+	void initTerrainPipelines();
 
 	void initDefaultData();
 	void initSceneData();
@@ -304,8 +504,11 @@ private:
 
 	void initGround();
 	void initGrass();
-	void initHeightMap();
+	void initTerrainTiles();
+	//compares the CPU terrain queries with what the shaders sample, runs at startup when validation layers are on
+	void validateTerrainHeightMap();
 	void initShadowMapResources();
+	void initReflectionResources();
 	void initWindMap();
 	void initSkybox();
 
@@ -1,11 +1,37 @@
 #pragma once
 
-
+#include <cstdint>
 
 static constexpr const int CSM_COUNT = 3;
 static constexpr const unsigned int FRAME_OVERLAP = 2;
 static constexpr const bool bUseValidationLayers = true;
+static constexpr const int QUALITY_PRESET = 2; //index into QUALITY_PRESETS (vk_types.hpp) used at startup
 static constexpr const int RENDER_DISTANCE = 600;
-static constexpr const int HEIGHT_MAP_SIZE = 2048;
+static constexpr const float CAMERA_NEAR_PLANE = 0.1f;
+static constexpr const char* ASSET_CACHE_DIRECTORY = "./cache"; //generated startup data, safe to delete
+static constexpr const int HEIGHT_MAP_SIZE = 2048; //procedural terrain that is baked into the asset cache when there is no terrain file
+static constexpr const char* TERRAIN_FILE_PATH = "./assets/terrain.tiles";
+static constexpr const int TERRAIN_TILE_SIZE = 256; //texels per tile side of a baked terrain file
+static constexpr const int TERRAIN_TILE_CACHE_LAYERS = 48; //GPU tile cache size in tiles, the overview gets its own layer
+static constexpr const int TERRAIN_TILE_UPLOADS_PER_FRAME = 2;
+static constexpr const uint32_t TERRAIN_STAGING_SLOTS = 8; //tiles the worker thread can copy ahead of the GPU uploads
+static constexpr const float TERRAIN_STREAM_RADIUS = RENDER_DISTANCE; //tiles closer than this are streamed in, must fit in the cache
+static constexpr const float TERRAIN_LEAF_NODE_SIZE = 16.f; //meters, smallest CDLOD node (0.5m vertex spacing)
 static constexpr const int SHADOWMAP_RESOLUTION = 2048;
-static constexpr const float CSM_SCALE = 3.5;
\ No newline at end of file
+static constexpr const float SHADOW_DISTANCE = 150.f; //view distance covered by the last cascade
+static constexpr const float SHADOW_SPLIT_LAMBDA = 0.75f; //cascade split scheme, 0 = uniform, 1 = logarithmic, in between = practical
+static constexpr const int SHADOW_CASCADE_UPDATE_INTERVAL[CSM_COUNT] = { 1, 4, 12 }; //max frames a cascade keeps its cached terrain depth
+static constexpr const float SHADOW_CASCADE_MAX_DRIFT = 0.1f; //fraction of the cascade radius the frustum slice can move before it refreshes
+static constexpr const float SHADOW_CASCADE_MAX_SUN_ANGLE = 0.5f; //degrees the sun can move before a cascade refreshes
+static constexpr const bool SHADOW_MASK_HALF_RESOLUTION = false; //resolve the shadow mask at half resolution and upsample it depth aware
+static constexpr const bool SSR_HIZ = true; //half resolution hi-z traced reflections with temporal accumulation, false = full resolution linear march
+static constexpr const int SSR_HIZ_MIPS = 6; //hi-z levels above the depth buffer, the largest cells are 2^SSR_HIZ_MIPS pixels
+static constexpr const float SSR_TEMPORAL_BLEND = 0.1f; //weight of the newest frame in the accumulated reflections
+static constexpr const int DEFERRED_TILE_CLASS_COUNT = 3; //sky, lit and reflective tiles, must match TILE_CLASS_COUNT in _deferredTiles.glsl
+static constexpr const int GRASS_TILE_SIZE = 16;
+static constexpr const int GRASS_TILE_UPDATES_PER_FRAME = 32; //max number of grass tiles generated per frame
+static constexpr const int GRASS_REBUILD_TILES_PER_FRAME = 64; //max number of tiles of a new grass configuration generated per frame
+static constexpr const int GRASS_BLADE_SEGMENTS = 4; //max curve segments per blade, must match GRASS_MAX_SEGMENTS in _animatedBlade.glsl
+static constexpr const int GRASS_LOD_COUNT = 3; //lod i has GRASS_BLADE_SEGMENTS >> i segments, must match GRASS_LOD_COUNT in _animatedBlade.glsl
+static constexpr const float GRASS_SEGMENT_LOD_DISTANCES[GRASS_LOD_COUNT - 1] = { 15.f, 40.f }; //blades get all, half, then a single segment
+static constexpr const float GRASS_SHADOW_CASCADE_DENSITY[CSM_COUNT] = { 1.f, 0.5f, 0.25f }; //fraction of blades casting shadows per cascade
\ No newline at end of file
@@ -3,7 +3,8 @@
 
 void vkutil::transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout,
 	VkPipelineStageFlags2 srcStageMask /* = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT */,
-	VkPipelineStageFlags2 dstStageMask /* = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT */)
+	VkPipelineStageFlags2 dstStageMask /* = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT */,
+	VkImageAspectFlags aspectMask /* = 0 */)
 {
 	VkImageMemoryBarrier2 imageBarrier{};
 	imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
@@ -24,7 +25,7 @@ void vkutil::transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout c
 	//subresourceRange lets us target a part of the image with the barrier
 	//useful for array images or mipmapped images, where we only need a barrier on a given layer or mipmap level
 	//we also target a specific ASPECTMASK
-	VkImageAspectFlags aspectMask = 
+	if (aspectMask == 0) aspectMask =
 		(newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
 			newLayout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL ||
 			currentLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ?
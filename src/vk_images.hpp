@@ -6,7 +6,8 @@ namespace vkutil
 {
 	void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout,
 		VkPipelineStageFlags2 srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-		VkPipelineStageFlags2 dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT); //note: ALL_COMMANDS is inefficient
+		VkPipelineStageFlags2 dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, //note: ALL_COMMANDS is inefficient
+		VkImageAspectFlags aspectMask = 0); //deduced from the layouts when 0, depth images in transfer layouts need it
 
 	void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "./vk_loader.hpp"
 #include "stb_image.h"
 #include <iostream>
+#include <limits>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include "./vk_engine.hpp"
@@ -125,6 +126,14 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngi
 					});
 			}
 
+			newSurface.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+			newSurface.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+			for (size_t i = initialVtx; i < vertices.size(); i++)
+			{
+				newSurface.boundsMin = glm::min(newSurface.boundsMin, vertices[i].position);
+				newSurface.boundsMax = glm::max(newSurface.boundsMax, vertices[i].position);
+			}
+
 			newmesh.surfaces.push_back(newSurface);
 		}
 
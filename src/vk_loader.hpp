@@ -8,6 +8,8 @@ struct GeoSurface
 {
 	uint32_t startIndex;
 	uint32_t count;
+	glm::vec3 boundsMin; //object space, for culling
+	glm::vec3 boundsMax;
 };
 
 struct MeshAsset
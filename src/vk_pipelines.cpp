@@ -1,5 +1,6 @@
 #include "vk_pipelines.hpp"
 #include <fstream>
+#include <bit>
 #include "vk_initializers.hpp"
 
 
@@ -43,6 +44,57 @@ bool vkutil::loadShaderModule(const char* filePath, VkDevice device, VkShaderMod
 	return true;
 }
 
+vkutil::SpecializationConstants& vkutil::SpecializationConstants::add(uint32_t constantId, int32_t value)
+{
+	addEntry(constantId, std::bit_cast<uint32_t>(value));
+	return *this;
+}
+
+vkutil::SpecializationConstants& vkutil::SpecializationConstants::add(uint32_t constantId, float value)
+{
+	addEntry(constantId, std::bit_cast<uint32_t>(value));
+	return *this;
+}
+
+vkutil::SpecializationConstants& vkutil::SpecializationConstants::add(uint32_t constantId, bool value)
+{
+	addEntry(constantId, value ? VK_TRUE : VK_FALSE);
+	return *this;
+}
+
+void vkutil::SpecializationConstants::addEntry(uint32_t constantId, uint32_t bits)
+{
+	VkSpecializationMapEntry entry{};
+	entry.constantID = constantId;
+	entry.offset = (uint32_t)(_data.size() * sizeof(uint32_t));
+	entry.size = sizeof(uint32_t);
+	_entries.push_back(entry);
+	_data.push_back(bits);
+}
+
+const VkSpecializationInfo* vkutil::SpecializationConstants::info()
+{
+	if (_entries.empty()) return nullptr;
+	_info.mapEntryCount = (uint32_t)_entries.size();
+	_info.pMapEntries = _entries.data();
+	_info.dataSize = _data.size() * sizeof(uint32_t);
+	_info.pData = _data.data();
+	return &_info;
+}
+
+VkPipeline vkutil::buildComputePipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shader, const VkSpecializationInfo* specialization)
+{
+	VkComputePipelineCreateInfo computePipelineCreateInfo{};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.layout = layout;
+	computePipelineCreateInfo.stage = vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shader);
+	computePipelineCreateInfo.stage.pSpecializationInfo = specialization;
+
+	VkPipeline pipeline;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &pipeline));
+	return pipeline;
+}
+
 void vkutil::PipelineBuilder::clear()
 {
 	_inputAssembly = {};
@@ -65,6 +117,7 @@ void vkutil::PipelineBuilder::clear()
 	_renderInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
 
 	_shaderStages.clear();
+	_specialization = nullptr;
 }
 
 VkPipeline vkutil::PipelineBuilder::buildPipeline(VkDevice device)
@@ -98,6 +151,9 @@ VkPipeline vkutil::PipelineBuilder::buildPipeline(VkDevice device)
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineInfo.pNext = &_renderInfo;
 
+	for (VkPipelineShaderStageCreateInfo& stage : _shaderStages)
+		stage.pSpecializationInfo = _specialization;
+
 	pipelineInfo.stageCount = (uint32_t)_shaderStages.size();
 	pipelineInfo.pStages = _shaderStages.data();
 	pipelineInfo.pVertexInputState = &vertexInputInfo;
@@ -137,6 +193,18 @@ void vkutil::PipelineBuilder::setShaders(VkShaderModule vertexShader, VkShaderMo
 	_shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, vertexShader));
 	_shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
 }
+void vkutil::PipelineBuilder::setMeshShaders(VkShaderModule taskShader, VkShaderModule meshShader, VkShaderModule fragmentShader)
+{
+	//	note: vertex input and input assembly are ignored by mesh pipelines
+	_shaderStages.clear();
+	_shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_TASK_BIT_EXT, taskShader));
+	_shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_MESH_BIT_EXT, meshShader));
+	_shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
+}
+void vkutil::PipelineBuilder::setSpecialization(const VkSpecializationInfo* specialization)
+{
+	_specialization = specialization;
+}
 void vkutil::PipelineBuilder::setVertexShader(VkShaderModule vertexShader)
 {
 	_shaderStages.clear();
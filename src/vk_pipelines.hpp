@@ -1,9 +1,76 @@
+#pragma once
+
 #include "vk_types.hpp"
+#include <map>
+#include <tuple>
 
 namespace vkutil
 {
 	bool loadShaderModule(const char* filePath, VkDevice device, VkShaderModule* outShaderModule);
 
+	//values of the layout(constant_id = n) constants of a shader, the driver compiles them in like literals
+	//	note: the returned info points into this object, keep it alive until the pipeline is built
+	class SpecializationConstants
+	{
+	public:
+		SpecializationConstants& add(uint32_t constantId, int32_t value);
+		SpecializationConstants& add(uint32_t constantId, float value);
+		SpecializationConstants& add(uint32_t constantId, bool value); //VkBool32
+
+		const VkSpecializationInfo* info();
+
+	private:
+		void addEntry(uint32_t constantId, uint32_t bits);
+
+		std::vector<VkSpecializationMapEntry> _entries;
+		std::vector<uint32_t> _data;
+		VkSpecializationInfo _info{};
+	};
+
+	//compute pipeline of a single shader module
+	VkPipeline buildComputePipeline(VkDevice device, VkPipelineLayout layout, VkShaderModule shader, const VkSpecializationInfo* specialization = nullptr);
+
+	//pipelines of one shader built per key (e.g. the quality constants it reads) on first use and kept until destroy or release,
+	//	so switching back and forth between settings never compiles twice
+	template<typename Key>
+	class PipelinePermutations
+	{
+	public:
+		void init(std::function<VkPipeline(const Key&)> build) { _build = std::move(build); }
+
+		VkPipeline get(const Key& key)
+		{
+			auto it = _pipelines.find(key);
+			if (it != _pipelines.end()) return it->second;
+
+			//	note: a failed build is not cached, so it is not bound as a null handle every frame
+			VkPipeline pipeline = _build(key);
+			if (pipeline != VK_NULL_HANDLE) _pipelines.emplace(key, pipeline);
+			return pipeline;
+		}
+
+		//hands over every pipeline built so far and forgets them, the caller destroys them once no frame uses them
+		std::vector<VkPipeline> release()
+		{
+			std::vector<VkPipeline> pipelines;
+			for (auto& [key, pipeline] : _pipelines)
+				pipelines.push_back(pipeline);
+			_pipelines.clear();
+			return pipelines;
+		}
+
+		void destroy(VkDevice device)
+		{
+			for (auto& [key, pipeline] : _pipelines)
+				vkDestroyPipeline(device, pipeline, nullptr);
+			_pipelines.clear();
+		}
+
+	private:
+		std::function<VkPipeline(const Key&)> _build;
+		std::map<Key, VkPipeline> _pipelines;
+	};
+
 	enum ColorBlendingMode {
 		DISABLED,
 		ADDITIVE,
@@ -23,6 +90,7 @@ namespace vkutil
 		VkPipelineDepthStencilStateCreateInfo _depthStencil;
 		VkPipelineRenderingCreateInfo _renderInfo;
 		std::vector<VkFormat> _colorAttachmentFormats;
+		const VkSpecializationInfo* _specialization;
 
 		PipelineBuilder() { clear(); }
 
@@ -32,6 +100,8 @@ namespace vkutil
 
 		void setShaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
 		void setVertexShader(VkShaderModule vertexShader);
+		void setMeshShaders(VkShaderModule taskShader, VkShaderModule meshShader, VkShaderModule fragmentShader); //needs VK_EXT_mesh_shader
+		void setSpecialization(const VkSpecializationInfo* specialization); //applied to all stages, a stage ignores the ids it does not declare
 		void setInputTopology(VkPrimitiveTopology topology);
 		void setPolygonMode(VkPolygonMode mode);
 		void setCullMode(VkCullModeFlags cullMode, VkFrontFace frontFace);
@@ -8,6 +8,7 @@
 #include <array>
 #include <functional>
 #include <deque>
+#include <compare>
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_enum_string_helper.h>
@@ -45,7 +46,7 @@ struct GPUDrawPushConstants
     glm::vec4 playerPosition;
     glm::vec4 data;
     VkDeviceAddress vertexBuffer;
-    glm::vec2 empty = glm::vec2(0);
+    glm::ivec2 shadow = glm::ivec2(0); //x = 1 in the layered shadow pass, see _shadowCascade.glsl
 };
 
 struct AllocatedImage
@@ -110,6 +111,7 @@ struct AllocatedBuffer
     VkBuffer buffer;
     VmaAllocation allocation;
     VmaAllocationInfo allocationInfo;
+    size_t size = 0; //requested size, the allocation may be bigger
 };
 
 //holds resources for mesh
@@ -123,4 +125,45 @@ struct GPUMeshBuffers
 struct GrassData
 {
     glm::vec4 position;
-};
\ No newline at end of file
+};
+
+//  per blade animation state, written once per frame by grass_animate.comp
+//  must match AnimatedBlade in _animatedBlade.glsl
+struct AnimatedGrassBlade
+{
+    glm::vec3 position;
+    uint32_t rotation;
+    glm::vec3 wind;
+    uint32_t params;
+};
+
+//  per cascade culling input for grass_animate.comp, must match ShadowCascade there
+struct GrassShadowCascade
+{
+    glm::mat4 viewProj;
+    glm::vec4 data; //x = fraction of blades that cast shadows
+};
+//  quality knobs that are compiled into the shaders as specialization constants
+//  pipelines are cached per value, see vkutil::PipelinePermutations
+struct QualitySettings
+{
+    int reflectionSteps;        //linear march of deferred.comp and hi-z iterations of ssr.comp
+    int reflectionRefineSteps;  //binary search after a hit in deferred.comp
+    int cloudSteps;             //view ray samples of cloud.frag
+    int cloudLightSteps;        //samples towards the sun per view ray sample
+    int shadowFilterRadius;     //PCF kernel of shadow_mask.comp is (2r+1)^2 taps
+
+    auto operator<=>(const QualitySettings&) const = default;
+};
+
+struct QualityPreset
+{
+    const char* name;
+    QualitySettings settings;
+};
+
+static constexpr const QualityPreset QUALITY_PRESETS[] = {
+    { "low",    { 32, 8, 40, 4, 0 } },
+    { "medium", { 64, 16, 70, 6, 1 } },
+    { "high",   { 100, 28, 100, 10, 1 } },
+};
@@ -0,0 +1,152 @@
+#include "workgroup_tuner.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void WorkgroupTuner::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, const AssetCache* cache, uint32_t frameCount)
+{
+	_device = device;
+	_cache = cache;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	//	note: the pipeline cache uuid changes with every driver build, even if the version number does not
+	_deviceKey.add(properties.vendorID)
+		.add(properties.deviceID)
+		.add(properties.driverVersion)
+		.add(properties.pipelineCacheUUID)
+		.add(std::string(properties.deviceName));
+
+	const WorkgroupSize candidates[] = { {8, 8}, {16, 8}, {16, 16}, {32, 4}, {32, 8}, {64, 4} };
+	for (WorkgroupSize candidate : candidates)
+	{
+		if (candidate.x * candidate.y <= properties.limits.maxComputeWorkGroupInvocations &&
+			candidate.x <= properties.limits.maxComputeWorkGroupSize[0] &&
+			candidate.y <= properties.limits.maxComputeWorkGroupSize[1])
+			_candidates.push_back(candidate);
+	}
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+	if (queueFamily < familyCount && families[queueFamily].timestampValidBits > 0)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = frameCount * MAX_KERNELS * 2;
+		VK_CHECK(vkCreateQueryPool(_device, &queryPoolInfo, nullptr, &_queryPool));
+	}
+	else
+		fmt::print("no timestamps on the graphics queue, workgroup sizes are not tuned\n");
+
+	std::array<int, MAX_KERNELS> untimed;
+	untimed.fill(-1);
+	_timedCandidates.assign(frameCount, untimed);
+}
+
+void WorkgroupTuner::cleanup()
+{
+	if (_queryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(_device, _queryPool, nullptr);
+	_queryPool = VK_NULL_HANDLE;
+}
+
+int WorkgroupTuner::addKernel(const std::string& name, const std::vector<std::string>& shaderPaths, WorkgroupSize fallback)
+{
+	Kernel kernel;
+	kernel.name = name;
+	kernel.key = _deviceKey;
+	for (const std::string& path : shaderPaths)
+		kernel.key.addFile(path);
+	for (WorkgroupSize candidate : _candidates)
+		kernel.key.add(candidate.x).add(candidate.y);
+
+	std::vector<uint8_t> cached;
+	if (_cache->load("workgroup-" + name, kernel.key, cached) && cached.size() == sizeof(WorkgroupSize))
+	{
+		std::memcpy(&kernel.chosen, cached.data(), sizeof(WorkgroupSize));
+		kernel.tuned = true;
+	}
+	else if (_queryPool == VK_NULL_HANDLE || _candidates.empty() || _kernels.size() >= MAX_KERNELS)
+	{
+		kernel.chosen = fallback;
+		kernel.tuned = true;
+	}
+
+	_kernels.push_back(std::move(kernel));
+	return (int)_kernels.size() - 1;
+}
+
+WorkgroupSize WorkgroupTuner::size(int kernel) const
+{
+	const Kernel& k = _kernels[kernel];
+	return k.tuned ? k.chosen : _candidates[k.candidate];
+}
+
+bool WorkgroupTuner::tuning() const
+{
+	return std::any_of(_kernels.begin(), _kernels.end(), [](const Kernel& kernel) { return !kernel.tuned; });
+}
+
+void WorkgroupTuner::beginFrame(VkCommandBuffer cmd, uint32_t frameSlot)
+{
+	_frameSlot = frameSlot;
+	if (_queryPool == VK_NULL_HANDLE) return;
+
+	std::array<int, MAX_KERNELS>& timed = _timedCandidates[frameSlot];
+	//	note: kernels past MAX_KERNELS run on their fallback and are never timed
+	for (int i = 0; i < (int)std::min(_kernels.size(), timed.size()); i++)
+	{
+		if (timed[i] < 0) continue;
+		Kernel& kernel = _kernels[i];
+
+		//timestamp and availability of the begin and the end
+		uint64_t results[4];
+		VkResult result = vkGetQueryPoolResults(_device, _queryPool, firstQuery(frameSlot, i), 2, sizeof(results), results, 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		//	note: a frame recorded before the kernel moved on timed the previous candidate
+		if (result == VK_SUCCESS && results[1] != 0 && results[3] != 0 && results[2] >= results[0] &&
+			!kernel.tuned && timed[i] == (int)kernel.candidate)
+			addSample(kernel, results[2] - results[0]);
+	}
+	timed.fill(-1);
+
+	if (!tuning()) return;
+	vkCmdResetQueryPool(cmd, _queryPool, firstQuery(frameSlot, 0), MAX_KERNELS * 2);
+}
+
+void WorkgroupTuner::beginTiming(VkCommandBuffer cmd, int kernel)
+{
+	if (_queryPool == VK_NULL_HANDLE || _kernels[kernel].tuned) return;
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _queryPool, firstQuery(_frameSlot, kernel));
+	_timedCandidates[_frameSlot][kernel] = (int)_kernels[kernel].candidate;
+}
+
+void WorkgroupTuner::endTiming(VkCommandBuffer cmd, int kernel)
+{
+	if (_queryPool == VK_NULL_HANDLE || kernel >= MAX_KERNELS || _timedCandidates[_frameSlot][kernel] < 0) return;
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _queryPool, firstQuery(_frameSlot, kernel) + 1);
+}
+
+void WorkgroupTuner::addSample(Kernel& kernel, uint64_t ticks)
+{
+	kernel.samples.push_back(ticks);
+	if (kernel.samples.size() < WARMUP_SAMPLES + SAMPLES_PER_CANDIDATE) return;
+
+	//median of the samples after the warmup, a single hitch does not decide
+	std::vector<uint64_t> samples(kernel.samples.begin() + WARMUP_SAMPLES, kernel.samples.end());
+	std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+	kernel.medians.push_back(samples[samples.size() / 2]);
+	kernel.samples.clear();
+
+	kernel.candidate++;
+	if (kernel.candidate < _candidates.size()) return;
+
+	size_t best = std::min_element(kernel.medians.begin(), kernel.medians.end()) - kernel.medians.begin();
+	kernel.chosen = _candidates[best];
+	kernel.tuned = true;
+	_cache->store("workgroup-" + kernel.name, kernel.key, &kernel.chosen, sizeof(WorkgroupSize));
+	fmt::print("workgroup size of {}: {}x{}\n", kernel.name, kernel.chosen.x, kernel.chosen.y);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "vk_types.hpp"
+#include "vk_pipelines.hpp"
+#include "asset_cache.hpp"
+
+//local size of a compute kernel, the shaders declare it as layout(local_size_x_id = 100, local_size_y_id = 101)
+struct WorkgroupSize
+{
+	static constexpr uint32_t SPECIALIZATION_ID_X = 100;
+	static constexpr uint32_t SPECIALIZATION_ID_Y = 101;
+
+	uint32_t x = 16;
+	uint32_t y = 16;
+
+	void specialize(vkutil::SpecializationConstants& constants) const
+	{
+		constants.add(SPECIALIZATION_ID_X, (int32_t)x).add(SPECIALIZATION_ID_Y, (int32_t)y);
+	}
+
+	//workgroups to cover width x height invocations
+	uint32_t groupsX(uint32_t width) const { return (width + x - 1) / x; }
+	uint32_t groupsY(uint32_t height) const { return (height + y - 1) / y; }
+
+	auto operator<=>(const WorkgroupSize&) const = default;
+};
+
+//picks the fastest workgroup size of every registered compute kernel on this device
+//	on the first run the kernels cycle through the candidate sizes while the frames render as usual,
+//	their dispatches are timed with timestamp queries and the candidate with the lowest median wins.
+//	the choice goes into the asset cache keyed by device, driver and the SPIR-V of the kernel,
+//	so later runs start with it and a driver or shader update tunes again.
+class WorkgroupTuner
+{
+public:
+	static constexpr int WARMUP_SAMPLES = 4; //first timings of a candidate are dropped, they include cold caches
+	static constexpr int SAMPLES_PER_CANDIDATE = 16;
+	static constexpr int MAX_KERNELS = 16;
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, const AssetCache* cache, uint32_t frameCount);
+	void cleanup();
+
+	//registers a kernel, shaderPaths are the SPIR-V of every shader dispatched in its timed region
+	//	note: all of them are dispatched with the same size, fallback is used when timestamps are not supported
+	int addKernel(const std::string& name, const std::vector<std::string>& shaderPaths, WorkgroupSize fallback);
+
+	//size the kernel has to be built and dispatched with this frame
+	WorkgroupSize size(int kernel) const;
+
+	//reads back the timings of the last frame that used this slot, call after its fence was waited on
+	void beginFrame(VkCommandBuffer cmd, uint32_t frameSlot);
+	//brackets the dispatches of a kernel, at most once per kernel and frame
+	void beginTiming(VkCommandBuffer cmd, int kernel);
+	void endTiming(VkCommandBuffer cmd, int kernel);
+
+	bool tuning() const;
+	int kernelCount() const { return (int)_kernels.size(); }
+	const std::string& name(int kernel) const { return _kernels[kernel].name; }
+
+private:
+	struct Kernel
+	{
+		std::string name;
+		AssetCache::Key key;
+		WorkgroupSize chosen;
+		bool tuned = false;
+		size_t candidate = 0;
+		std::vector<uint64_t> samples;	//ticks of the current candidate
+		std::vector<uint64_t> medians;	//per finished candidate
+	};
+
+	void addSample(Kernel& kernel, uint64_t ticks);
+	uint32_t firstQuery(uint32_t frameSlot, int kernel) const { return (frameSlot * MAX_KERNELS + kernel) * 2; }
+
+	VkDevice _device = VK_NULL_HANDLE;
+	const AssetCache* _cache = nullptr;
+	VkQueryPool _queryPool = VK_NULL_HANDLE; //null if the queue can not write timestamps
+	AssetCache::Key _deviceKey;
+	std::vector<WorkgroupSize> _candidates;
+	std::vector<Kernel> _kernels;
+	uint32_t _frameSlot = 0;
+	std::vector<std::array<int, MAX_KERNELS>> _timedCandidates; //per frame slot and kernel, -1 if it was not timed
+};